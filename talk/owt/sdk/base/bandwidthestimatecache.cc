@@ -0,0 +1,139 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/include/cpp/owt/base/bandwidthestimatecache.h"
+#include <algorithm>
+#include <ctime>
+#include <sstream>
+#include <vector>
+namespace owt {
+namespace base {
+// Estimates older than a week are not used.
+static const int64_t kMaxEntryAgeSeconds = 7 * 24 * 3600;
+static const size_t kMaxEntries = 64;
+static const char kFieldSeparator = '\t';
+static int64_t Now() {
+  return static_cast<int64_t>(std::time(nullptr));
+}
+// Separators in endpoint or network would break exported data.
+static std::string Sanitize(std::string value) {
+  std::replace(value.begin(), value.end(), kFieldSeparator, ' ');
+  std::replace(value.begin(), value.end(), '\n', ' ');
+  return value;
+}
+// Average with the previous estimate, so a single bad session doesn't
+// dominate.
+static int Blend(int previous, int current) {
+  if (current <= 0)
+    return previous;
+  if (previous <= 0)
+    return current;
+  return (previous + current) / 2;
+}
+BandwidthEstimateCache& BandwidthEstimateCache::Get() {
+  static BandwidthEstimateCache* cache = new BandwidthEstimateCache();
+  return *cache;
+}
+BandwidthEstimateCache::BandwidthEstimateCache() {}
+BandwidthEstimateCache::~BandwidthEstimateCache() {}
+std::string BandwidthEstimateCache::Key(const std::string& endpoint,
+                                        const std::string& network) {
+  return Sanitize(endpoint) + kFieldSeparator + Sanitize(network);
+}
+void BandwidthEstimateCache::Record(const std::string& endpoint,
+                                    const std::string& network,
+                                    int send_kbps,
+                                    int receive_kbps) {
+  if (send_kbps <= 0 && receive_kbps <= 0)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t now = Now();
+  auto it = entries_.find(Key(endpoint, network));
+  if (it != entries_.end() &&
+      now - it->second.updated_time <= kMaxEntryAgeSeconds) {
+    it->second.send_kbps = Blend(it->second.send_kbps, send_kbps);
+    it->second.receive_kbps = Blend(it->second.receive_kbps, receive_kbps);
+    it->second.updated_time = now;
+    return;
+  }
+  entries_[Key(endpoint, network)] =
+      Entry{std::max(send_kbps, 0), std::max(receive_kbps, 0), now};
+  Evict();
+}
+bool BandwidthEstimateCache::Lookup(const std::string& endpoint,
+                                    const std::string& network,
+                                    int& send_kbps,
+                                    int& receive_kbps) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(Key(endpoint, network));
+  if (it == entries_.end())
+    return false;
+  if (Now() - it->second.updated_time > kMaxEntryAgeSeconds) {
+    entries_.erase(it);
+    return false;
+  }
+  send_kbps = it->second.send_kbps;
+  receive_kbps = it->second.receive_kbps;
+  return true;
+}
+std::string BandwidthEstimateCache::Export() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::ostringstream data;
+  for (const auto& entry : entries_) {
+    data << entry.first << kFieldSeparator << entry.second.send_kbps
+         << kFieldSeparator << entry.second.receive_kbps << kFieldSeparator
+         << entry.second.updated_time << '\n';
+  }
+  return data.str();
+}
+bool BandwidthEstimateCache::Import(const std::string& data) {
+  std::map<std::string, Entry> imported;
+  std::istringstream lines(data);
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (line.empty())
+      continue;
+    std::vector<std::string> fields;
+    std::istringstream line_stream(line);
+    std::string field;
+    while (std::getline(line_stream, field, kFieldSeparator)) {
+      fields.push_back(field);
+    }
+    if (fields.size() != 5)
+      return false;
+    Entry entry;
+    std::istringstream numbers(fields[2] + ' ' + fields[3] + ' ' + fields[4]);
+    if (!(numbers >> entry.send_kbps >> entry.receive_kbps >>
+          entry.updated_time) ||
+        entry.send_kbps < 0 || entry.receive_kbps < 0)
+      return false;
+    imported[fields[0] + kFieldSeparator + fields[1]] = entry;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& entry : imported) {
+    entries_[entry.first] = entry.second;
+  }
+  Evict();
+  return true;
+}
+void BandwidthEstimateCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+}
+size_t BandwidthEstimateCache::Size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+void BandwidthEstimateCache::Evict() {
+  while (entries_.size() > kMaxEntries) {
+    auto oldest = std::min_element(
+        entries_.begin(), entries_.end(),
+        [](const std::pair<const std::string, Entry>& a,
+           const std::pair<const std::string, Entry>& b) {
+          return a.second.updated_time < b.second.updated_time;
+        });
+    entries_.erase(oldest);
+  }
+}
+}  // namespace base
+}  // namespace owt
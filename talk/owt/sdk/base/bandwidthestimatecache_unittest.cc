@@ -0,0 +1,38 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/include/cpp/owt/base/bandwidthestimatecache.h"
+#include "testing/gtest/include/gtest/gtest.h"
+namespace owt {
+namespace base {
+TEST(BandwidthEstimateCacheTest, RecordsPerEndpointAndNetwork) {
+  BandwidthEstimateCache cache;
+  int send = 0, receive = 0;
+  EXPECT_FALSE(cache.Lookup("example.com", "wifi/192.168.1.2", send, receive));
+  cache.Record("example.com", "wifi/192.168.1.2", 2000, 3000);
+  cache.Record("example.com", "cellular/10.0.0.2", 500, 800);
+  EXPECT_TRUE(cache.Lookup("example.com", "wifi/192.168.1.2", send, receive));
+  EXPECT_EQ(send, 2000);
+  EXPECT_EQ(receive, 3000);
+  // Later sessions are blended with the previous estimate.
+  cache.Record("example.com", "wifi/192.168.1.2", 1000, 0);
+  EXPECT_TRUE(cache.Lookup("example.com", "wifi/192.168.1.2", send, receive));
+  EXPECT_EQ(send, 1500);
+  EXPECT_EQ(receive, 3000);
+  EXPECT_EQ(cache.Size(), 2u);
+}
+TEST(BandwidthEstimateCacheTest, ExportAndImport) {
+  BandwidthEstimateCache cache;
+  cache.Record("example.com", "wifi/192.168.1.2", 2000, 3000);
+  BandwidthEstimateCache restored;
+  EXPECT_TRUE(restored.Import(cache.Export()));
+  int send = 0, receive = 0;
+  EXPECT_TRUE(
+      restored.Lookup("example.com", "wifi/192.168.1.2", send, receive));
+  EXPECT_EQ(send, 2000);
+  EXPECT_EQ(receive, 3000);
+  EXPECT_FALSE(restored.Import("malformed"));
+  EXPECT_EQ(restored.Size(), 1u);
+}
+}  // namespace base
+}  // namespace owt
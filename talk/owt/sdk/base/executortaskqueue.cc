@@ -0,0 +1,115 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/base/executortaskqueue.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include "talk/owt/sdk/base/timerservice.h"
+#include "webrtc/api/task_queue/default_task_queue_factory.h"
+#include "webrtc/api/task_queue/queued_task.h"
+#include "webrtc/api/task_queue/task_queue_base.h"
+namespace owt {
+namespace base {
+namespace {
+// A serial queue on top of an executor. At most one task of a queue is given
+// to the executor at any time, and it runs all pending tasks in order.
+class ExecutorTaskQueue : public webrtc::TaskQueueBase {
+ public:
+  explicit ExecutorTaskQueue(const CallbackExecutor& executor)
+      : state_(std::make_shared<State>()) {
+    state_->executor = executor;
+    state_->queue = this;
+  }
+  void Delete() override {
+    std::deque<std::unique_ptr<webrtc::QueuedTask>> dropped;
+    {
+      std::unique_lock<std::mutex> lock(state_->mutex);
+      state_->deleted = true;
+      dropped.swap(state_->tasks);
+      // Wait for the running task, unless it's the one deleting this queue.
+      if (!IsCurrent())
+        state_->idle.wait(lock, [this] { return !state_->running; });
+    }
+    delete this;
+  }
+  void PostTask(std::unique_ptr<webrtc::QueuedTask> task) override {
+    Post(state_, std::move(task));
+  }
+  void PostDelayedTask(std::unique_ptr<webrtc::QueuedTask> task,
+                       uint32_t milliseconds) override {
+    // Timer tasks must be copyable.
+    auto holder =
+        std::make_shared<std::unique_ptr<webrtc::QueuedTask>>(std::move(task));
+    std::weak_ptr<State> weak_state = state_;
+    TimerService::Get().Schedule(milliseconds, [weak_state, holder] {
+      if (auto state = weak_state.lock())
+        Post(state, std::move(*holder));
+    });
+  }
+ private:
+  // Shared with tasks given to the executor, which may outlive this queue.
+  struct State {
+    CallbackExecutor executor;
+    // Only valid before |deleted| is set.
+    ExecutorTaskQueue* queue = nullptr;
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::deque<std::unique_ptr<webrtc::QueuedTask>> tasks;
+    // Whether a drain is given to the executor.
+    bool scheduled = false;
+    bool running = false;
+    bool deleted = false;
+  };
+  ~ExecutorTaskQueue() override = default;
+  static void Post(std::shared_ptr<State> state,
+                   std::unique_ptr<webrtc::QueuedTask> task) {
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (state->deleted)
+        return;
+      state->tasks.push_back(std::move(task));
+      if (state->scheduled)
+        return;
+      state->scheduled = true;
+    }
+    state->executor([state] { Drain(state); });
+  }
+  static void Drain(std::shared_ptr<State> state) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (!state->deleted && !state->tasks.empty()) {
+      std::unique_ptr<webrtc::QueuedTask> task =
+          std::move(state->tasks.front());
+      state->tasks.pop_front();
+      state->running = true;
+      lock.unlock();
+      {
+        CurrentTaskQueueSetter set_current(state->queue);
+        // Returning false means the task has taken ownership of itself.
+        if (!task->Run())
+          task.release();
+      }
+      task.reset();
+      lock.lock();
+      state->running = false;
+      state->idle.notify_all();
+    }
+    state->scheduled = false;
+  }
+  std::shared_ptr<State> state_;
+};
+}  // namespace
+std::shared_ptr<rtc::TaskQueue> CreateCallbackQueue(
+    const CallbackExecutor& executor,
+    absl::string_view name) {
+  if (executor) {
+    return std::make_shared<rtc::TaskQueue>(
+        std::unique_ptr<webrtc::TaskQueueBase, webrtc::TaskQueueDeleter>(
+            new ExecutorTaskQueue(executor)));
+  }
+  auto task_queue_factory = webrtc::CreateDefaultTaskQueueFactory();
+  return std::make_shared<rtc::TaskQueue>(task_queue_factory->CreateTaskQueue(
+      name, webrtc::TaskQueueFactory::Priority::NORMAL));
+}
+}  // namespace base
+}  // namespace owt
@@ -0,0 +1,24 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OWT_BASE_EXECUTORTASKQUEUE_H_
+#define OWT_BASE_EXECUTORTASKQUEUE_H_
+#include <functional>
+#include <memory>
+#include "absl/strings/string_view.h"
+#include "webrtc/rtc_base/task_queue.h"
+namespace owt {
+namespace base {
+// Runs a task, usually on a thread pool. See
+// ClientConfiguration::callback_executor.
+typedef std::function<void(std::function<void()>)> CallbackExecutor;
+// Create a queue for callbacks and events. If |executor| is set, tasks are
+// run on it one at a time in order, so queues sharing the same executor run
+// concurrently without a thread for each of them. Otherwise, a new thread is
+// created for the queue.
+std::shared_ptr<rtc::TaskQueue> CreateCallbackQueue(
+    const CallbackExecutor& executor,
+    absl::string_view name);
+}  // namespace base
+}  // namespace owt
+#endif  // OWT_BASE_EXECUTORTASKQUEUE_H_
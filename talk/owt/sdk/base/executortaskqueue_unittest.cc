@@ -0,0 +1,63 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/base/executortaskqueue.h"
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+#include "testing/gtest/include/gtest/gtest.h"
+namespace owt {
+namespace base {
+// Runs every task on a new thread, so tasks may run concurrently.
+static void RunOnNewThread(std::function<void()> task) {
+  std::thread(task).detach();
+}
+TEST(ExecutorTaskQueueTest, RunsTasksInOrderOneAtATime) {
+  std::shared_ptr<rtc::TaskQueue> queue =
+      CreateCallbackQueue(RunOnNewThread, "ExecutorTaskQueueTest");
+  const int kTaskCount = 200;
+  std::vector<int> order;
+  std::atomic<int> running(0);
+  std::atomic<bool> overlapped(false);
+  std::promise<void> done;
+  for (int i = 0; i < kTaskCount; i++) {
+    queue->PostTask([&, i] {
+      if (running.fetch_add(1) != 0)
+        overlapped = true;
+      EXPECT_TRUE(queue->IsCurrent());
+      order.push_back(i);
+      running.fetch_sub(1);
+      if (i == kTaskCount - 1)
+        done.set_value();
+    });
+  }
+  done.get_future().wait();
+  EXPECT_FALSE(overlapped);
+  ASSERT_EQ(order.size(), static_cast<size_t>(kTaskCount));
+  for (int i = 0; i < kTaskCount; i++) {
+    EXPECT_EQ(order[i], i);
+  }
+}
+TEST(ExecutorTaskQueueTest, RunsDelayedTask) {
+  std::shared_ptr<rtc::TaskQueue> queue =
+      CreateCallbackQueue(RunOnNewThread, "ExecutorTaskQueueTest");
+  std::promise<void> done;
+  queue->PostDelayedTask([&done] { done.set_value(); }, 10);
+  EXPECT_EQ(done.get_future().wait_for(std::chrono::seconds(5)),
+            std::future_status::ready);
+}
+TEST(ExecutorTaskQueueTest, DropsTasksAfterDeleted) {
+  std::vector<std::function<void()>> pending;
+  std::shared_ptr<rtc::TaskQueue> queue = CreateCallbackQueue(
+      [&pending](std::function<void()> task) { pending.push_back(task); },
+      "ExecutorTaskQueueTest");
+  bool ran = false;
+  queue->PostTask([&ran] { ran = true; });
+  queue.reset();
+  ASSERT_EQ(pending.size(), 1u);
+  pending[0]();
+  EXPECT_FALSE(ran);
+}
+}  // namespace base
+}  // namespace owt
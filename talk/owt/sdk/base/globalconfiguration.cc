@@ -21,6 +21,7 @@ bool GlobalConfiguration::encoded_frame_ = false;
 int GlobalConfiguration::start_bitrate_kbps_ = 0; // not set
 int GlobalConfiguration::min_bitrate_kbps_ = 0; // not set
 int GlobalConfiguration::max_bitrate_kbps_ = 0; // not set
+bool GlobalConfiguration::bandwidth_estimate_cache_enabled_ = false;
 
 int GlobalConfiguration::delay_based_bwe_weight_ = 100;
 std::unique_ptr<AudioFrameGeneratorInterface>
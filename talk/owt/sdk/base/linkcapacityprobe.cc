@@ -0,0 +1,555 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/include/cpp/owt/base/linkcapacityprobe.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include "talk/owt/sdk/base/functionalobserver.h"
+#include "talk/owt/sdk/base/peerconnectiondependencyfactory.h"
+#include "talk/owt/sdk/base/timerservice.h"
+#include "webrtc/api/data_channel_interface.h"
+#include "webrtc/api/jsep.h"
+#include "webrtc/api/peer_connection_interface.h"
+#include "webrtc/api/task_queue/default_task_queue_factory.h"
+#include "webrtc/rtc_base/logging.h"
+#include "webrtc/rtc_base/task_queue.h"
+#include "webrtc/rtc_base/time_utils.h"
+namespace owt {
+namespace base {
+// Probe packets fit in one UDP packet with SCTP, DTLS and TURN overhead.
+static const size_t kProbePacketSize = 1000;
+// Sequence number and send time are at the beginning of each probe packet.
+static const size_t kProbeHeaderSize = 2 * sizeof(int64_t);
+static const int kProbeIntervalMs = 10;
+// Probe packets are only queued when the data channel has less buffered, so
+// throughput is limited by its congestion control instead of the queue.
+static const uint64_t kMaxBufferedAmount = 256 * 1024;
+// Time to wait for the relay to be connected.
+static const int kConnectTimeoutMs = 10000;
+// Time to wait for packets in flight after probing.
+static const int kDrainTimeMs = 500;
+// Share of measured throughput suggested for media.
+static const double kSuggestedBitrateRatio = 0.85;
+// Bitrate reserved for an audio encoding without max bitrate, in kbps.
+static const unsigned long kDefaultAudioBitrate = 64;
+// Video is still limited to this bitrate if audio takes all the suggested
+// bitrate, in kbps.
+static const unsigned long kMinVideoBitrate = 100;
+static bool IsTurnServer(const IceServer& server) {
+  for (const auto& url : server.urls) {
+    if (url.compare(0, 5, "turn:") == 0 || url.compare(0, 6, "turns:") == 0)
+      return true;
+  }
+  return false;
+}
+class LinkCapacityProbeImpl
+    : public std::enable_shared_from_this<LinkCapacityProbeImpl> {
+ public:
+  explicit LinkCapacityProbeImpl(
+      const LinkCapacityProbeConfiguration& configuration);
+  ~LinkCapacityProbeImpl();
+  void Start(std::function<void(LinkCapacityProbeResult)> on_success,
+             std::function<void(std::unique_ptr<Exception>)> on_failure);
+  void Stop();
+
+ private:
+  // Observes one of the two peer connections. Probe data is sent from the
+  // sender to the receiver.
+  class Endpoint : public webrtc::PeerConnectionObserver,
+                   public webrtc::DataChannelObserver {
+   public:
+    Endpoint(LinkCapacityProbeImpl* probe, bool sender)
+        : probe_(probe), sender_(sender) {}
+    // PeerConnectionObserver
+    void OnSignalingChange(
+        webrtc::PeerConnectionInterface::SignalingState new_state) override {}
+    void OnDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface>
+                           data_channel) override {
+      probe_->OnDataChannel(data_channel);
+    }
+    void OnIceGatheringChange(
+        webrtc::PeerConnectionInterface::IceGatheringState new_state) override {
+      if (new_state ==
+          webrtc::PeerConnectionInterface::kIceGatheringComplete) {
+        probe_->OnIceGatheringComplete(sender_);
+      }
+    }
+    void OnIceCandidate(
+        const webrtc::IceCandidateInterface* candidate) override {}
+    // DataChannelObserver
+    void OnStateChange() override { probe_->OnDataChannelStateChange(sender_); }
+    void OnMessage(const webrtc::DataBuffer& buffer) override {
+      probe_->OnProbePacket(buffer);
+    }
+
+   private:
+    LinkCapacityProbeImpl* probe_;
+    bool sender_;
+  };
+  void OnDataChannel(
+      rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel);
+  // Candidates are exchanged in SDP after gathering is completed, so there is
+  // no trickle ICE between the two peer connections.
+  void OnIceGatheringComplete(bool sender);
+  void OnDataChannelStateChange(bool sender);
+  void OnProbePacket(const webrtc::DataBuffer& buffer);
+  // Run |task| on the PeerConnection thread after |delay_ms|. Probing runs
+  // there because data channel calls block, which timer tasks must not do.
+  TimerService::TimerId ScheduleOnPeerConnectionThread(
+      int64_t delay_ms,
+      std::function<void(LinkCapacityProbeImpl&)> task);
+  void SendProbePackets();
+  void StopSending();
+  void Complete();
+  void Fail(const std::string& message);
+  // Close peer connections and run |callback| on |event_queue_|.
+  void Finish(std::function<void()> callback);
+  LinkCapacityProbeConfiguration configuration_;
+  Endpoint sender_endpoint_;
+  Endpoint receiver_endpoint_;
+  rtc::scoped_refptr<webrtc::PeerConnectionInterface> sender_pc_;
+  rtc::scoped_refptr<webrtc::PeerConnectionInterface> receiver_pc_;
+  rtc::scoped_refptr<webrtc::DataChannelInterface> sender_channel_;
+  std::shared_ptr<rtc::TaskQueue> event_queue_;
+  // Set before peer connections are created. Observers of peer connections
+  // use it instead of shared_from_this, which throws when they're invoked
+  // while this probe is being destroyed.
+  std::weak_ptr<LinkCapacityProbeImpl> weak_this_;
+  std::function<void(LinkCapacityProbeResult)> on_success_;
+  std::function<void(std::unique_ptr<Exception>)> on_failure_;
+  std::mutex mutex_;
+  bool started_;
+  bool finished_;
+  rtc::scoped_refptr<webrtc::DataChannelInterface> receiver_channel_;
+  owt::base::TimerService::TimerId connect_timer_;
+  owt::base::TimerService::TimerId probe_timer_;
+  // Below are only accessed on the PeerConnection thread.
+  int64_t start_time_us_;
+  int64_t probe_duration_ms_;
+  bool sending_;
+  int64_t sent_packets_;
+  uint64_t sent_bytes_;
+  // Bytes handed to the transport when sending is stopped.
+  uint64_t delivered_bytes_;
+  // Below are guarded by |mutex_|.
+  int64_t received_packets_;
+  uint64_t received_bytes_;
+  int64_t min_transit_us_;
+  int64_t last_transit_us_;
+  double jitter_us_;
+};
+LinkCapacityProbeImpl::LinkCapacityProbeImpl(
+    const LinkCapacityProbeConfiguration& configuration)
+    : configuration_(configuration),
+      sender_endpoint_(this, true),
+      receiver_endpoint_(this, false),
+      started_(false),
+      finished_(false),
+      connect_timer_(TimerService::kInvalidTimerId),
+      probe_timer_(TimerService::kInvalidTimerId),
+      start_time_us_(0),
+      probe_duration_ms_(0),
+      sending_(false),
+      sent_packets_(0),
+      sent_bytes_(0),
+      delivered_bytes_(0),
+      received_packets_(0),
+      received_bytes_(0),
+      min_transit_us_(-1),
+      last_transit_us_(-1),
+      jitter_us_(0) {
+  auto task_queue_factory = webrtc::CreateDefaultTaskQueueFactory();
+  event_queue_ =
+      std::make_shared<rtc::TaskQueue>(task_queue_factory->CreateTaskQueue(
+          "LinkCapacityProbeEventQueue",
+          webrtc::TaskQueueFactory::Priority::NORMAL));
+}
+LinkCapacityProbeImpl::~LinkCapacityProbeImpl() {
+  TimerService::Get().Cancel(connect_timer_);
+  TimerService::Get().Cancel(probe_timer_);
+  rtc::scoped_refptr<webrtc::DataChannelInterface> receiver_channel;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    receiver_channel = receiver_channel_;
+  }
+  if (sender_channel_)
+    sender_channel_->UnregisterObserver();
+  if (receiver_channel)
+    receiver_channel->UnregisterObserver();
+  if (sender_pc_)
+    sender_pc_->Close();
+  if (receiver_pc_)
+    receiver_pc_->Close();
+}
+void LinkCapacityProbeImpl::Start(
+    std::function<void(LinkCapacityProbeResult)> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (started_) {
+      if (on_failure) {
+        event_queue_->PostTask([on_failure] {
+          std::unique_ptr<Exception> e(new Exception(
+              ExceptionType::kUnknown, "Link capacity probe is started."));
+          on_failure(std::move(e));
+        });
+      }
+      return;
+    }
+    started_ = true;
+    on_success_ = on_success;
+    on_failure_ = on_failure;
+  }
+  weak_this_ = shared_from_this();
+  if (configuration_.duration_ms <= 0) {
+    Fail("Probe duration must be positive.");
+    return;
+  }
+  if (configuration_.max_bitrate_kbps == 0) {
+    Fail("Max probe bitrate must be positive.");
+    return;
+  }
+  if (std::none_of(configuration_.ice_servers.begin(),
+                   configuration_.ice_servers.end(), IsTurnServer)) {
+    Fail("Link capacity probe requires a TURN server.");
+    return;
+  }
+  webrtc::PeerConnectionInterface::RTCConfiguration config;
+  config.sdp_semantics = webrtc::SdpSemantics::kUnifiedPlan;
+  // Force probe data through the relay.
+  config.type = webrtc::PeerConnectionInterface::kRelay;
+  for (const auto& server : configuration_.ice_servers) {
+    webrtc::PeerConnectionInterface::IceServer ice_server;
+    ice_server.urls = server.urls;
+    ice_server.username = server.username;
+    ice_server.password = server.password;
+    config.servers.push_back(ice_server);
+  }
+  PeerConnectionDependencyFactory* factory =
+      PeerConnectionDependencyFactory::Get();
+  sender_pc_ = factory->CreatePeerConnection(config, &sender_endpoint_);
+  receiver_pc_ = factory->CreatePeerConnection(config, &receiver_endpoint_);
+  if (!sender_pc_ || !receiver_pc_) {
+    Fail("Failed to create PeerConnection.");
+    return;
+  }
+  // Lost probe packets are not retransmitted, so loss can be measured and
+  // retransmissions don't take bandwidth.
+  webrtc::DataChannelInit init;
+  init.ordered = false;
+  init.maxRetransmits = 0;
+  sender_channel_ = sender_pc_->CreateDataChannel("probe", &init);
+  if (!sender_channel_) {
+    Fail("Failed to create data channel.");
+    return;
+  }
+  sender_channel_->RegisterObserver(&sender_endpoint_);
+  std::weak_ptr<LinkCapacityProbeImpl> weak_this = weak_this_;
+  connect_timer_ =
+      TimerService::Get().Schedule(kConnectTimeoutMs, [weak_this] {
+        if (auto that = weak_this.lock())
+          that->Fail("Cannot connect to TURN server.");
+      });
+  auto on_sdp_failure = [weak_this](const std::string& error) {
+    if (auto that = weak_this.lock())
+      that->Fail(error);
+  };
+  rtc::scoped_refptr<FunctionalCreateSessionDescriptionObserver> observer =
+      FunctionalCreateSessionDescriptionObserver::Create(
+          [weak_this,
+           on_sdp_failure](webrtc::SessionDescriptionInterface* desc) {
+            auto that = weak_this.lock();
+            if (!that) {
+              delete desc;
+              return;
+            }
+            that->sender_pc_->SetLocalDescription(
+                FunctionalSetSessionDescriptionObserver::Create(
+                    nullptr, on_sdp_failure)
+                    .get(),
+                desc);
+          },
+          on_sdp_failure);
+  sender_pc_->CreateOffer(
+      observer.get(),
+      webrtc::PeerConnectionInterface::RTCOfferAnswerOptions());
+}
+void LinkCapacityProbeImpl::Stop() {
+  Fail("Link capacity probe is stopped.");
+}
+void LinkCapacityProbeImpl::OnDataChannel(
+    rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel) {
+  data_channel->RegisterObserver(&receiver_endpoint_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  receiver_channel_ = data_channel;
+}
+void LinkCapacityProbeImpl::OnIceGatheringComplete(bool sender) {
+  std::weak_ptr<LinkCapacityProbeImpl> weak_this = weak_this_;
+  auto on_sdp_failure = [weak_this](const std::string& error) {
+    if (auto that = weak_this.lock())
+      that->Fail(error);
+  };
+  std::string sdp;
+  if (sender) {
+    // Offer with all candidates is ready.
+    if (!sender_pc_->local_description() ||
+        !sender_pc_->local_description()->ToString(&sdp))
+      return;
+    receiver_pc_->SetRemoteDescription(
+        webrtc::CreateSessionDescription(webrtc::SdpType::kOffer, sdp),
+        FunctionalSetRemoteDescriptionObserver::Create(
+            [weak_this, on_sdp_failure](webrtc::RTCError error) {
+              auto that = weak_this.lock();
+              if (!that)
+                return;
+              if (!error.ok()) {
+                that->Fail(error.message());
+                return;
+              }
+              rtc::scoped_refptr<FunctionalCreateSessionDescriptionObserver>
+                  observer = FunctionalCreateSessionDescriptionObserver::Create(
+                      [weak_this, on_sdp_failure](
+                          webrtc::SessionDescriptionInterface* desc) {
+                        auto that = weak_this.lock();
+                        if (!that) {
+                          delete desc;
+                          return;
+                        }
+                        that->receiver_pc_->SetLocalDescription(
+                            FunctionalSetSessionDescriptionObserver::Create(
+                                nullptr, on_sdp_failure)
+                                .get(),
+                            desc);
+                      },
+                      on_sdp_failure);
+              that->receiver_pc_->CreateAnswer(
+                  observer.get(),
+                  webrtc::PeerConnectionInterface::RTCOfferAnswerOptions());
+            }));
+  } else {
+    // Answer with all candidates is ready.
+    if (!receiver_pc_->local_description() ||
+        !receiver_pc_->local_description()->ToString(&sdp))
+      return;
+    sender_pc_->SetRemoteDescription(
+        webrtc::CreateSessionDescription(webrtc::SdpType::kAnswer, sdp),
+        FunctionalSetRemoteDescriptionObserver::Create(
+            [weak_this](webrtc::RTCError error) {
+              auto that = weak_this.lock();
+              if (that && !error.ok())
+                that->Fail(error.message());
+            }));
+  }
+}
+void LinkCapacityProbeImpl::OnDataChannelStateChange(bool sender) {
+  if (!sender)
+    return;
+  auto state = sender_channel_->state();
+  if (state == webrtc::DataChannelInterface::kClosed) {
+    Fail("Probe data channel is closed.");
+    return;
+  }
+  if (state != webrtc::DataChannelInterface::kOpen)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished_)
+      return;
+  }
+  TimerService::Get().Cancel(connect_timer_);
+  RTC_LOG(LS_INFO) << "Relay is connected, start probing.";
+  // Timer tasks are posted to the PeerConnection thread in order, so the
+  // sending state is only accessed there.
+  ScheduleOnPeerConnectionThread(0, [](LinkCapacityProbeImpl& probe) {
+    probe.start_time_us_ = rtc::TimeMicros();
+    probe.sending_ = true;
+    probe.SendProbePackets();
+  });
+  ScheduleOnPeerConnectionThread(
+      configuration_.duration_ms,
+      [](LinkCapacityProbeImpl& probe) { probe.StopSending(); });
+}
+TimerService::TimerId LinkCapacityProbeImpl::ScheduleOnPeerConnectionThread(
+    int64_t delay_ms,
+    std::function<void(LinkCapacityProbeImpl&)> task) {
+  std::weak_ptr<LinkCapacityProbeImpl> weak_this = weak_this_;
+  auto run = [weak_this, task] {
+    if (auto that = weak_this.lock())
+      task(*that);
+  };
+  return TimerService::Get().Schedule(delay_ms, [run] {
+    PeerConnectionDependencyFactory::Get()->PostTask(run);
+  });
+}
+void LinkCapacityProbeImpl::SendProbePackets() {
+  if (!sending_)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished_)
+      return;
+  }
+  int64_t elapsed_us = rtc::TimeMicros() - start_time_us_;
+  // Bytes allowed by |max_bitrate_kbps| so far, including the next interval.
+  uint64_t allowed_bytes =
+      static_cast<uint64_t>(configuration_.max_bitrate_kbps) *
+      (elapsed_us / 1000 + kProbeIntervalMs) / 8;
+  std::string packet(kProbePacketSize, '\0');
+  while (sent_bytes_ + kProbePacketSize <= allowed_bytes &&
+         sender_channel_->buffered_amount() < kMaxBufferedAmount) {
+    int64_t header[2] = {sent_packets_, rtc::TimeMicros()};
+    memcpy(&packet[0], header, kProbeHeaderSize);
+    webrtc::DataBuffer buffer(rtc::CopyOnWriteBuffer(packet.data(),
+                                                     packet.size()),
+                              true);
+    if (!sender_channel_->Send(buffer))
+      break;
+    sent_packets_++;
+    sent_bytes_ += kProbePacketSize;
+  }
+  probe_timer_ = ScheduleOnPeerConnectionThread(
+      kProbeIntervalMs,
+      [](LinkCapacityProbeImpl& probe) { probe.SendProbePackets(); });
+}
+void LinkCapacityProbeImpl::StopSending() {
+  sending_ = false;
+  TimerService::Get().Cancel(probe_timer_);
+  probe_duration_ms_ = (rtc::TimeMicros() - start_time_us_) / 1000;
+  // Packets still buffered are not sent to the relay.
+  uint64_t buffered = sender_channel_->buffered_amount();
+  delivered_bytes_ = sent_bytes_ > buffered ? sent_bytes_ - buffered : 0;
+  ScheduleOnPeerConnectionThread(
+      kDrainTimeMs, [](LinkCapacityProbeImpl& probe) { probe.Complete(); });
+}
+void LinkCapacityProbeImpl::OnProbePacket(const webrtc::DataBuffer& buffer) {
+  if (buffer.size() < kProbeHeaderSize)
+    return;
+  int64_t header[2];
+  memcpy(header, buffer.data.data(), kProbeHeaderSize);
+  // Both peer connections are in this process, so send time and receive time
+  // are from the same clock, and transit time is the round trip to the relay.
+  int64_t transit_us = rtc::TimeMicros() - header[1];
+  std::lock_guard<std::mutex> lock(mutex_);
+  received_packets_++;
+  received_bytes_ += buffer.size();
+  if (min_transit_us_ < 0 || transit_us < min_transit_us_)
+    min_transit_us_ = transit_us;
+  // Interarrival jitter as defined in RFC 3550.
+  if (last_transit_us_ >= 0) {
+    double d = std::abs(static_cast<double>(transit_us - last_transit_us_));
+    jitter_us_ += (d - jitter_us_) / 16;
+  }
+  last_transit_us_ = transit_us;
+}
+void LinkCapacityProbeImpl::Complete() {
+  LinkCapacityProbeResult result;
+  int64_t duration_ms = std::max<int64_t>(1, probe_duration_ms_);
+  result.upload_kbps =
+      static_cast<uint32_t>(delivered_bytes_ * 8 / duration_ms);
+  int64_t delivered_packets = delivered_bytes_ / kProbePacketSize;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    result.download_kbps =
+        static_cast<uint32_t>(received_bytes_ * 8 / duration_ms);
+    result.rtt_ms = std::max<int64_t>(0, min_transit_us_) / 1000.0;
+    result.jitter_ms = jitter_us_ / 1000;
+    if (delivered_packets > 0) {
+      result.packet_loss = std::max(
+          0.0, 1 - static_cast<double>(received_packets_) / delivered_packets);
+    }
+  }
+  RTC_LOG(LS_INFO) << "Link capacity probe completed. Upload "
+                   << result.upload_kbps << "kbps, download "
+                   << result.download_kbps << "kbps, RTT " << result.rtt_ms
+                   << "ms, jitter " << result.jitter_ms << "ms, loss "
+                   << result.packet_loss << ".";
+  std::function<void(LinkCapacityProbeResult)> on_success;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    on_success = on_success_;
+  }
+  Finish([on_success, result] {
+    if (on_success)
+      on_success(result);
+  });
+}
+void LinkCapacityProbeImpl::Fail(const std::string& message) {
+  RTC_LOG(LS_WARNING) << "Link capacity probe failed: " << message;
+  std::function<void(std::unique_ptr<Exception>)> on_failure;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    on_failure = on_failure_;
+  }
+  Finish([on_failure, message] {
+    if (!on_failure)
+      return;
+    std::unique_ptr<Exception> e(
+        new Exception(ExceptionType::kUnknown, message));
+    on_failure(std::move(e));
+  });
+}
+void LinkCapacityProbeImpl::Finish(std::function<void()> callback) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished_)
+      return;
+    finished_ = true;
+  }
+  TimerService::Get().Cancel(connect_timer_);
+  // Peer connections are not closed in their own callbacks. The task doesn't
+  // keep this probe alive, so it's never destroyed on |event_queue_|.
+  rtc::scoped_refptr<webrtc::PeerConnectionInterface> sender_pc = sender_pc_;
+  rtc::scoped_refptr<webrtc::PeerConnectionInterface> receiver_pc =
+      receiver_pc_;
+  event_queue_->PostTask([sender_pc, receiver_pc, callback] {
+    if (sender_pc)
+      sender_pc->Close();
+    if (receiver_pc)
+      receiver_pc->Close();
+    callback();
+  });
+}
+uint32_t LinkCapacityProbeResult::SuggestedSendBitrate() const {
+  return static_cast<uint32_t>(upload_kbps * kSuggestedBitrateRatio);
+}
+uint32_t LinkCapacityProbeResult::SuggestedReceiveBitrate() const {
+  return static_cast<uint32_t>(download_kbps * kSuggestedBitrateRatio);
+}
+void LinkCapacityProbeResult::ApplyTo(PublishOptions& options) const {
+  // Audio encodings are alternatives and only one of them is sent, so the
+  // largest one is reserved.
+  unsigned long audio_bitrate = 0;
+  for (const auto& audio : options.audio) {
+    audio_bitrate = std::max(
+        audio_bitrate,
+        audio.max_bitrate > 0 ? audio.max_bitrate : kDefaultAudioBitrate);
+  }
+  unsigned long budget = SuggestedSendBitrate();
+  budget = budget > audio_bitrate + kMinVideoBitrate ? budget - audio_bitrate
+                                                      : kMinVideoBitrate;
+  for (auto& video : options.video) {
+    if (video.max_bitrate == 0 || video.max_bitrate > budget)
+      video.max_bitrate = budget;
+  }
+}
+std::shared_ptr<LinkCapacityProbe> LinkCapacityProbe::Create(
+    const LinkCapacityProbeConfiguration& configuration) {
+  return std::shared_ptr<LinkCapacityProbe>(
+      new LinkCapacityProbe(configuration));
+}
+LinkCapacityProbe::LinkCapacityProbe(
+    const LinkCapacityProbeConfiguration& configuration)
+    : impl_(std::make_shared<LinkCapacityProbeImpl>(configuration)) {}
+LinkCapacityProbe::~LinkCapacityProbe() {}
+void LinkCapacityProbe::Start(
+    std::function<void(LinkCapacityProbeResult)> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  impl_->Start(on_success, on_failure);
+}
+void LinkCapacityProbe::Stop() {
+  impl_->Stop();
+}
+}  // namespace base
+}  // namespace owt
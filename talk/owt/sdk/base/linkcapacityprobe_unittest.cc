@@ -0,0 +1,58 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/include/cpp/owt/base/linkcapacityprobe.h"
+#include "testing/gtest/include/gtest/gtest.h"
+namespace owt {
+namespace base {
+TEST(LinkCapacityProbeResultTest, SuggestsBitratesWithHeadroom) {
+  LinkCapacityProbeResult result;
+  EXPECT_EQ(result.SuggestedSendBitrate(), 0u);
+  EXPECT_EQ(result.SuggestedReceiveBitrate(), 0u);
+  result.upload_kbps = 1000;
+  result.download_kbps = 2000;
+  EXPECT_EQ(result.SuggestedSendBitrate(), 850u);
+  EXPECT_EQ(result.SuggestedReceiveBitrate(), 1700u);
+}
+TEST(LinkCapacityProbeResultTest, LimitsVideoAfterAudio) {
+  LinkCapacityProbeResult result;
+  result.upload_kbps = 1000;
+  PublishOptions options;
+  // Only the largest audio encoding is reserved.
+  options.audio.push_back(AudioEncodingParameters());
+  options.audio.push_back(AudioEncodingParameters());
+  options.audio[1].max_bitrate = 100;
+  options.video.resize(3);
+  options.video[1].max_bitrate = 500;
+  options.video[2].max_bitrate = 2000;
+  result.ApplyTo(options);
+  EXPECT_EQ(options.audio[0].max_bitrate, 0u);
+  EXPECT_EQ(options.audio[1].max_bitrate, 100u);
+  EXPECT_EQ(options.video[0].max_bitrate, 750u);
+  EXPECT_EQ(options.video[1].max_bitrate, 500u);
+  EXPECT_EQ(options.video[2].max_bitrate, 750u);
+}
+TEST(LinkCapacityProbeResultTest, ReservesDefaultAudioBitrate) {
+  LinkCapacityProbeResult result;
+  result.upload_kbps = 1000;
+  PublishOptions options;
+  // Audio without max bitrate takes 64 kbps.
+  options.audio.push_back(AudioEncodingParameters());
+  options.video.resize(1);
+  result.ApplyTo(options);
+  EXPECT_EQ(options.video[0].max_bitrate, 786u);
+}
+TEST(LinkCapacityProbeResultTest, LimitsVideoToFloorIfAudioTakesAll) {
+  LinkCapacityProbeResult result;
+  result.upload_kbps = 50;
+  PublishOptions options;
+  options.audio.push_back(AudioEncodingParameters());
+  options.video.resize(2);
+  options.video[0].max_bitrate = 2000;
+  options.video[1].max_bitrate = 80;
+  result.ApplyTo(options);
+  EXPECT_EQ(options.video[0].max_bitrate, 100u);
+  EXPECT_EQ(options.video[1].max_bitrate, 80u);
+}
+}  // namespace base
+}  // namespace owt
@@ -204,5 +204,57 @@ absl::optional<H265ProfileId> MediaUtils::ParseSdpForH265Profile(
   return StringToH265Profile(profile_str);
 }
 
+const RtpEncodingParameters* MediaUtils::FindRtpEncodingParameters(
+    const std::vector<RtpEncodingParameters>& parameters,
+    const std::string& rid,
+    size_t index) {
+  if (!rid.empty()) {
+    for (const auto& encoding : parameters) {
+      if (encoding.rid == rid)
+        return &encoding;
+    }
+  }
+  if (index < parameters.size() && parameters[index].rid.empty())
+    return &parameters[index];
+  return nullptr;
+}
+
+void MediaUtils::ApplyRtpEncodingParameters(
+    const RtpEncodingParameters& encoding,
+    int stream_max_bitrate_bps,
+    webrtc::RtpEncodingParameters& parameters) {
+  if (encoding.max_bitrate_bps > 0)
+    parameters.max_bitrate_bps = encoding.max_bitrate_bps;
+  else if (encoding.max_bitrate_bps == 0 && stream_max_bitrate_bps > 0)
+    parameters.max_bitrate_bps = stream_max_bitrate_bps;
+  else
+    parameters.max_bitrate_bps = absl::nullopt;
+  if (encoding.max_framerate > 0)
+    parameters.max_framerate = encoding.max_framerate;
+  else
+    parameters.max_framerate = absl::nullopt;
+  if (encoding.scale_resolution_down_by > 0)
+    parameters.scale_resolution_down_by = encoding.scale_resolution_down_by;
+  if (!encoding.scalability_mode.empty())
+    parameters.scalability_mode = encoding.scalability_mode;
+  switch (encoding.priority) {
+    case NetworkPriority::kVeryLow:
+      parameters.network_priority = webrtc::Priority::kVeryLow;
+      break;
+    case NetworkPriority::kLow:
+      parameters.network_priority = webrtc::Priority::kLow;
+      break;
+    case NetworkPriority::kMedium:
+      parameters.network_priority = webrtc::Priority::kMedium;
+      break;
+    case NetworkPriority::kHigh:
+      parameters.network_priority = webrtc::Priority::kHigh;
+      break;
+    default:
+      break;
+  }
+  parameters.active = encoding.active;
+}
+
 }  // namespace base
 }  // namespace owt
@@ -6,8 +6,10 @@
 #define OWT_BASE_MEDIAUTILS_H_
 
 #include "absl/types/optional.h"
+#include "api/rtp_parameters.h"
 #include "api/video_codecs/sdp_video_format.h"
 #include <string>
+#include <vector>
 #include "talk/owt/sdk/include/cpp/owt/base/commontypes.h"
 
 namespace owt {
@@ -179,6 +181,20 @@ class MediaUtils {
       const webrtc::SdpVideoFormat::Parameters& params);
   static absl::optional<H265ProfileId> ParseSdpForH265Profile(
       const webrtc::SdpVideoFormat::Parameters& params);
+  // Find parameters set by application for the |index|th encoding of a
+  // sender, whose rid is |rid|. Returns nullptr if there is none.
+  static const RtpEncodingParameters* FindRtpEncodingParameters(
+      const std::vector<RtpEncodingParameters>& parameters,
+      const std::string& rid,
+      size_t index);
+  // Copy encoding parameters set by application to |parameters|, except rid
+  // and number of temporal layers. Max bitrate of 0 falls back to
+  // |stream_max_bitrate_bps| if it's positive, and a negative one removes the
+  // limit. Max framerate that is not positive removes the limit.
+  static void ApplyRtpEncodingParameters(
+      const RtpEncodingParameters& encoding,
+      int stream_max_bitrate_bps,
+      webrtc::RtpEncodingParameters& parameters);
 };
 }
 }
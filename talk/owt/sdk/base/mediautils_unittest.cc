@@ -10,5 +10,43 @@ TEST(MediaUtilsTest, CorrectResolutionNameHd720p){
   const Resolution r(1280, 720);
   EXPECT_EQ(MediaUtils::GetResolutionName(r),"hd720p");
 }
+TEST(MediaUtilsTest, FindRtpEncodingParametersByRidOrIndex) {
+  std::vector<RtpEncodingParameters> parameters(3);
+  parameters[0].rid = "h";
+  parameters[2].rid = "l";
+  EXPECT_EQ(MediaUtils::FindRtpEncodingParameters(parameters, "l", 0),
+            &parameters[2]);
+  // Index is used only if the parameters don't have a rid.
+  EXPECT_EQ(MediaUtils::FindRtpEncodingParameters(parameters, "", 1),
+            &parameters[1]);
+  EXPECT_EQ(MediaUtils::FindRtpEncodingParameters(parameters, "", 0), nullptr);
+  EXPECT_EQ(MediaUtils::FindRtpEncodingParameters(parameters, "m", 3), nullptr);
+}
+TEST(MediaUtilsTest, ApplyRtpEncodingParametersSetsAndClearsLimits) {
+  RtpEncodingParameters encoding;
+  encoding.max_bitrate_bps = 500000;
+  encoding.max_framerate = 15;
+  encoding.active = false;
+  webrtc::RtpEncodingParameters parameters;
+  MediaUtils::ApplyRtpEncodingParameters(encoding, 1000000, parameters);
+  EXPECT_EQ(parameters.max_bitrate_bps, absl::optional<int>(500000));
+  EXPECT_EQ(parameters.max_framerate, absl::optional<double>(15));
+  EXPECT_FALSE(parameters.active);
+  // Unset max bitrate falls back to stream's max bitrate.
+  encoding.max_bitrate_bps = 0;
+  encoding.max_framerate = 0;
+  encoding.active = true;
+  MediaUtils::ApplyRtpEncodingParameters(encoding, 1000000, parameters);
+  EXPECT_EQ(parameters.max_bitrate_bps, absl::optional<int>(1000000));
+  EXPECT_FALSE(parameters.max_framerate.has_value());
+  EXPECT_TRUE(parameters.active);
+  // Without stream's max bitrate, the limit is removed.
+  MediaUtils::ApplyRtpEncodingParameters(encoding, 0, parameters);
+  EXPECT_FALSE(parameters.max_bitrate_bps.has_value());
+  // A negative max bitrate removes the limit even if stream has one.
+  encoding.max_bitrate_bps = -1;
+  MediaUtils::ApplyRtpEncodingParameters(encoding, 1000000, parameters);
+  EXPECT_FALSE(parameters.max_bitrate_bps.has_value());
+}
 }
 }
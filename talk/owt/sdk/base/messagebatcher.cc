@@ -0,0 +1,61 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/base/messagebatcher.h"
+namespace owt {
+namespace base {
+static const size_t kLengthPrefixSize = 2;
+MessageBatcher::MessageBatcher(const std::string& header,
+                               size_t max_batch_size)
+    : header_(header), max_batch_size_(max_batch_size) {}
+bool MessageBatcher::Add(const uint8_t* data,
+                         size_t size,
+                         std::vector<uint8_t>& full_batch) {
+  size_t header_size = kLengthPrefixSize + header_.size();
+  size_t record_size = kLengthPrefixSize + size;
+  if (size > kMaxMessageSize || header_.size() > kMaxMessageSize ||
+      header_size + record_size > max_batch_size_)
+    return false;
+  if (!batch_.empty() && batch_.size() + record_size > max_batch_size_)
+    full_batch = Flush();
+  if (batch_.empty()) {
+    AppendRecord(reinterpret_cast<const uint8_t*>(header_.data()),
+                 header_.size());
+  }
+  AppendRecord(data, size);
+  return true;
+}
+std::vector<uint8_t> MessageBatcher::Flush() {
+  std::vector<uint8_t> batch;
+  batch.swap(batch_);
+  return batch;
+}
+bool MessageBatcher::Unbatch(const uint8_t* data,
+                             size_t size,
+                             std::string& header,
+                             std::vector<std::vector<uint8_t>>& messages) {
+  std::vector<std::vector<uint8_t>> records;
+  size_t offset = 0;
+  while (offset < size) {
+    if (size - offset < kLengthPrefixSize)
+      return false;
+    size_t length = (static_cast<size_t>(data[offset]) << 8) | data[offset + 1];
+    offset += kLengthPrefixSize;
+    if (size - offset < length)
+      return false;
+    records.emplace_back(data + offset, data + offset + length);
+    offset += length;
+  }
+  if (records.empty())
+    return false;
+  header.assign(records[0].begin(), records[0].end());
+  messages.assign(records.begin() + 1, records.end());
+  return true;
+}
+void MessageBatcher::AppendRecord(const uint8_t* data, size_t size) {
+  batch_.push_back(static_cast<uint8_t>(size >> 8));
+  batch_.push_back(static_cast<uint8_t>(size & 0xff));
+  batch_.insert(batch_.end(), data, data + size);
+}
+}  // namespace base
+}  // namespace owt
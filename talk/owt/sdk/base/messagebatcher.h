@@ -0,0 +1,44 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OWT_BASE_MESSAGEBATCHER_H_
+#define OWT_BASE_MESSAGEBATCHER_H_
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+namespace owt {
+namespace base {
+// Packs messages sent in a short interval into one batch, so they share one
+// packet. A batch is a sequence of records, each of them is a 16-bit big
+// endian length followed by that many bytes. The first record is a header,
+// e.g. receiver's ID, and the rest are messages.
+class MessageBatcher {
+ public:
+  // Largest message a record can carry.
+  static const size_t kMaxMessageSize = 0xffff;
+  // |max_batch_size| is the size limit of a batch, including the header and
+  // length prefixes.
+  MessageBatcher(const std::string& header, size_t max_batch_size);
+  // Append a message to current batch. If it doesn't fit, current batch is
+  // moved to |full_batch| first. Returns false if the message is too large
+  // for an empty batch.
+  bool Add(const uint8_t* data, size_t size, std::vector<uint8_t>& full_batch);
+  // Take current batch. Returns an empty vector if no message is added.
+  std::vector<uint8_t> Flush();
+  // Returns true if no message is waiting to be flushed.
+  bool Empty() const { return batch_.empty(); }
+  // Split a batch into header and messages. Returns false if it's malformed.
+  static bool Unbatch(const uint8_t* data,
+                      size_t size,
+                      std::string& header,
+                      std::vector<std::vector<uint8_t>>& messages);
+ private:
+  void AppendRecord(const uint8_t* data, size_t size);
+  std::string header_;
+  size_t max_batch_size_;
+  std::vector<uint8_t> batch_;
+};
+}  // namespace base
+}  // namespace owt
+#endif  // OWT_BASE_MESSAGEBATCHER_H_
@@ -0,0 +1,52 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/base/messagebatcher.h"
+#include "testing/gtest/include/gtest/gtest.h"
+namespace owt {
+namespace base {
+TEST(MessageBatcherTest, BatchesMessagesWithHeader) {
+  MessageBatcher batcher("user", 64);
+  std::vector<uint8_t> full_batch;
+  const uint8_t first[] = {1, 2, 3};
+  const uint8_t second[] = {4};
+  EXPECT_TRUE(batcher.Empty());
+  EXPECT_TRUE(batcher.Add(first, sizeof(first), full_batch));
+  EXPECT_TRUE(batcher.Add(second, sizeof(second), full_batch));
+  EXPECT_TRUE(full_batch.empty());
+  std::vector<uint8_t> batch = batcher.Flush();
+  EXPECT_TRUE(batcher.Empty());
+  std::string header;
+  std::vector<std::vector<uint8_t>> messages;
+  EXPECT_TRUE(
+      MessageBatcher::Unbatch(batch.data(), batch.size(), header, messages));
+  EXPECT_EQ(header, "user");
+  ASSERT_EQ(messages.size(), 2u);
+  EXPECT_EQ(messages[0], std::vector<uint8_t>(first, first + 3));
+  EXPECT_EQ(messages[1], std::vector<uint8_t>(second, second + 1));
+}
+TEST(MessageBatcherTest, StartsNewBatchWhenFull) {
+  // Header takes 2 bytes, each 4-byte message takes 6 bytes.
+  MessageBatcher batcher("", 14);
+  std::vector<uint8_t> full_batch;
+  const uint8_t message[] = {1, 2, 3, 4};
+  EXPECT_TRUE(batcher.Add(message, sizeof(message), full_batch));
+  EXPECT_TRUE(batcher.Add(message, sizeof(message), full_batch));
+  EXPECT_TRUE(full_batch.empty());
+  EXPECT_TRUE(batcher.Add(message, sizeof(message), full_batch));
+  EXPECT_EQ(full_batch.size(), 14u);
+  EXPECT_EQ(batcher.Flush().size(), 8u);
+  const uint8_t large[16] = {};
+  EXPECT_FALSE(batcher.Add(large, sizeof(large), full_batch));
+  EXPECT_TRUE(batcher.Empty());
+}
+TEST(MessageBatcherTest, RejectsMalformedBatch) {
+  std::string header;
+  std::vector<std::vector<uint8_t>> messages;
+  const uint8_t truncated[] = {0, 4, 1, 2};
+  EXPECT_FALSE(MessageBatcher::Unbatch(truncated, sizeof(truncated), header,
+                                       messages));
+  EXPECT_FALSE(MessageBatcher::Unbatch(nullptr, 0, header, messages));
+}
+}  // namespace base
+}  // namespace owt
@@ -0,0 +1,75 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/base/messageframer.h"
+namespace owt {
+namespace base {
+// Largest value a variable-length integer can encode.
+static const uint64_t kMaxVarInt = (1ull << 62) - 1;
+MessageFramer::MessageFramer(size_t max_message_size)
+    : max_message_size_(max_message_size) {
+  if (max_message_size_ > kMaxVarInt)
+    max_message_size_ = static_cast<size_t>(kMaxVarInt);
+}
+bool MessageFramer::Frame(const uint8_t* data,
+                          size_t size,
+                          std::vector<uint8_t>& buffer) const {
+  if (size > max_message_size_)
+    return false;
+  size_t prefix_size = LengthPrefixSize(size);
+  // The two most significant bits of the first byte are log2 of
+  // |prefix_size|.
+  uint64_t prefix = static_cast<uint64_t>(size);
+  switch (prefix_size) {
+    case 2:
+      prefix |= 0x4000;
+      break;
+    case 4:
+      prefix |= 0x80000000ull;
+      break;
+    case 8:
+      prefix |= 0xc000000000000000ull;
+      break;
+  }
+  buffer.reserve(buffer.size() + prefix_size + size);
+  for (size_t i = prefix_size; i > 0; i--)
+    buffer.push_back(static_cast<uint8_t>(prefix >> ((i - 1) * 8)));
+  if (size > 0)
+    buffer.insert(buffer.end(), data, data + size);
+  return true;
+}
+MessageFramer::ParseResult MessageFramer::Parse(const uint8_t* data,
+                                                size_t size,
+                                                const uint8_t*& message,
+                                                size_t& message_size,
+                                                size_t& consumed) const {
+  if (size == 0)
+    return ParseResult::kIncomplete;
+  size_t prefix_size = static_cast<size_t>(1) << (data[0] >> 6);
+  if (size < prefix_size)
+    return ParseResult::kIncomplete;
+  uint64_t length = data[0] & 0x3f;
+  for (size_t i = 1; i < prefix_size; i++)
+    length = (length << 8) | data[i];
+  // Checked before waiting for the whole message, so a peer can't make the
+  // receiver buffer more than max message size.
+  if (length > max_message_size_)
+    return ParseResult::kTooLarge;
+  if (size - prefix_size < length)
+    return ParseResult::kIncomplete;
+  message = data + prefix_size;
+  message_size = static_cast<size_t>(length);
+  consumed = prefix_size + message_size;
+  return ParseResult::kMessage;
+}
+size_t MessageFramer::LengthPrefixSize(uint64_t size) {
+  if (size < (1ull << 6))
+    return 1;
+  if (size < (1ull << 14))
+    return 2;
+  if (size < (1ull << 30))
+    return 4;
+  return 8;
+}
+}  // namespace base
+}  // namespace owt
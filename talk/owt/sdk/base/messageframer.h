@@ -0,0 +1,46 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OWT_BASE_MESSAGEFRAMER_H_
+#define OWT_BASE_MESSAGEFRAMER_H_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+namespace owt {
+namespace base {
+// Delimits messages on a byte stream. Each message is prefixed by its length
+// encoded as a variable-length integer defined in RFC 9000 section 16, which
+// takes 1 byte for messages shorter than 64 bytes and 2 bytes for messages
+// shorter than 16 KB.
+class MessageFramer {
+ public:
+  enum class ParseResult : int {
+    kMessage = 0,  // A whole message is parsed.
+    kIncomplete,   // More data is needed.
+    kTooLarge,     // The message exceeds max message size.
+  };
+  // Largest length prefix.
+  static const size_t kMaxLengthPrefixSize = 8;
+  explicit MessageFramer(size_t max_message_size);
+  size_t MaxMessageSize() const { return max_message_size_; }
+  // Append |data| with its length prefix to |buffer|. Returns false if it
+  // exceeds max message size, and |buffer| is not changed.
+  bool Frame(const uint8_t* data,
+             size_t size,
+             std::vector<uint8_t>& buffer) const;
+  // Parse the first message in |data|. On kMessage, |message| points to the
+  // message in |data|, and |consumed| is the size of the message and its
+  // prefix. Nothing is set for other results.
+  ParseResult Parse(const uint8_t* data,
+                    size_t size,
+                    const uint8_t*& message,
+                    size_t& message_size,
+                    size_t& consumed) const;
+  // Size of the length prefix for a message of |size| bytes.
+  static size_t LengthPrefixSize(uint64_t size);
+ private:
+  size_t max_message_size_;
+};
+}  // namespace base
+}  // namespace owt
+#endif  // OWT_BASE_MESSAGEFRAMER_H_
@@ -0,0 +1,74 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/base/messageframer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+namespace owt {
+namespace base {
+TEST(MessageFramerTest, UsesShortestLengthPrefix) {
+  EXPECT_EQ(MessageFramer::LengthPrefixSize(0), 1u);
+  EXPECT_EQ(MessageFramer::LengthPrefixSize(63), 1u);
+  EXPECT_EQ(MessageFramer::LengthPrefixSize(64), 2u);
+  EXPECT_EQ(MessageFramer::LengthPrefixSize(16383), 2u);
+  EXPECT_EQ(MessageFramer::LengthPrefixSize(16384), 4u);
+  EXPECT_EQ(MessageFramer::LengthPrefixSize(1ull << 30), 8u);
+  MessageFramer framer(1024);
+  std::vector<uint8_t> buffer;
+  const uint8_t message[300] = {7};
+  EXPECT_TRUE(framer.Frame(message, 3, buffer));
+  EXPECT_TRUE(framer.Frame(message, sizeof(message), buffer));
+  ASSERT_EQ(buffer.size(), 1u + 3 + 2 + 300);
+  EXPECT_EQ(buffer[0], 3);
+  // 300 is 0x12c, with 0b01 in the two most significant bits.
+  EXPECT_EQ(buffer[4], 0x41);
+  EXPECT_EQ(buffer[5], 0x2c);
+}
+TEST(MessageFramerTest, ParsesMessagesAcrossPartialData) {
+  MessageFramer framer(1024);
+  std::vector<uint8_t> stream;
+  const uint8_t first[] = {1, 2, 3};
+  const uint8_t second[100] = {4};
+  framer.Frame(first, sizeof(first), stream);
+  framer.Frame(second, sizeof(second), stream);
+  framer.Frame(nullptr, 0, stream);
+  std::vector<std::vector<uint8_t>> messages;
+  std::vector<uint8_t> received;
+  // Deliver one byte at a time, and parse whatever has been received.
+  for (uint8_t byte : stream) {
+    received.push_back(byte);
+    const uint8_t* message;
+    size_t message_size;
+    size_t consumed;
+    while (framer.Parse(received.data(), received.size(), message,
+                        message_size, consumed) ==
+           MessageFramer::ParseResult::kMessage) {
+      messages.emplace_back(message, message + message_size);
+      received.erase(received.begin(), received.begin() + consumed);
+    }
+  }
+  EXPECT_TRUE(received.empty());
+  ASSERT_EQ(messages.size(), 3u);
+  EXPECT_EQ(messages[0], std::vector<uint8_t>(first, first + 3));
+  EXPECT_EQ(messages[1], std::vector<uint8_t>(second, second + 100));
+  EXPECT_TRUE(messages[2].empty());
+}
+TEST(MessageFramerTest, RejectsLargeMessages) {
+  MessageFramer framer(16);
+  std::vector<uint8_t> buffer;
+  const uint8_t large[17] = {};
+  EXPECT_FALSE(framer.Frame(large, sizeof(large), buffer));
+  EXPECT_TRUE(buffer.empty());
+  MessageFramer receiver(1024);
+  EXPECT_TRUE(receiver.Frame(large, sizeof(large), buffer));
+  const uint8_t* message;
+  size_t message_size;
+  size_t consumed;
+  // Only the prefix is needed to reject it.
+  EXPECT_EQ(framer.Parse(buffer.data(), 1, message, message_size, consumed),
+            MessageFramer::ParseResult::kTooLarge);
+  EXPECT_EQ(receiver.Parse(buffer.data(), buffer.size() - 1, message,
+                           message_size, consumed),
+            MessageFramer::ParseResult::kIncomplete);
+}
+}  // namespace base
+}  // namespace owt
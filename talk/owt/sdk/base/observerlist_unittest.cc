@@ -0,0 +1,123 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/include/cpp/owt/base/observerlist.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "testing/gtest/include/gtest/gtest.h"
+namespace owt {
+namespace base {
+class CountingObserver {
+ public:
+  virtual ~CountingObserver() = default;
+  virtual void OnEvent() { count++; }
+  int count = 0;
+};
+TEST(ObserverListTest, IgnoresDuplicateAndUnknownObservers) {
+  ObserverList<CountingObserver> observers;
+  CountingObserver first, second;
+  EXPECT_TRUE(observers.Add(first));
+  EXPECT_FALSE(observers.Add(first));
+  EXPECT_FALSE(observers.Remove(second));
+  EXPECT_TRUE(observers.Add(second));
+  observers.ForEach([](CountingObserver& o) { o.OnEvent(); });
+  EXPECT_EQ(first.count, 1);
+  EXPECT_EQ(second.count, 1);
+  EXPECT_TRUE(observers.Remove(first));
+  observers.ForEach([](CountingObserver& o) { o.OnEvent(); });
+  EXPECT_EQ(first.count, 1);
+  EXPECT_EQ(second.count, 2);
+}
+TEST(ObserverListTest, SnapshotIsNotAffectedByChanges) {
+  ObserverList<CountingObserver> observers;
+  CountingObserver first, second;
+  observers.Add(first);
+  auto snapshot = observers.Get();
+  observers.Add(second);
+  observers.Remove(first);
+  ASSERT_EQ(snapshot->size(), 1u);
+  EXPECT_EQ(&(*snapshot)[0].get(), &first);
+  ASSERT_EQ(observers.Get()->size(), 1u);
+  EXPECT_EQ(&(*observers.Get())[0].get(), &second);
+}
+// Removes itself and adds another observer when notified.
+class ReentrantObserver : public CountingObserver {
+ public:
+  ReentrantObserver(ObserverList<CountingObserver>& observers,
+                    CountingObserver& added)
+      : observers_(observers), added_(added) {}
+  void OnEvent() override {
+    CountingObserver::OnEvent();
+    observers_.Remove(*this);
+    observers_.Add(added_);
+  }
+
+ private:
+  ObserverList<CountingObserver>& observers_;
+  CountingObserver& added_;
+};
+TEST(ObserverListTest, ObserversMayChangeListDuringDispatch) {
+  ObserverList<CountingObserver> observers;
+  CountingObserver added, last;
+  ReentrantObserver reentrant(observers, added);
+  observers.Add(reentrant);
+  observers.Add(last);
+  observers.ForEach([](CountingObserver& o) { o.OnEvent(); });
+  EXPECT_EQ(reentrant.count, 1);
+  EXPECT_EQ(last.count, 1);
+  // Observer added during dispatch is notified from the next event.
+  EXPECT_EQ(added.count, 0);
+  observers.ForEach([](CountingObserver& o) { o.OnEvent(); });
+  EXPECT_EQ(reentrant.count, 1);
+  EXPECT_EQ(last.count, 2);
+  EXPECT_EQ(added.count, 1);
+}
+// Removes another observer when notified.
+class RemovingObserver : public CountingObserver {
+ public:
+  RemovingObserver(ObserverList<CountingObserver>& observers,
+                   CountingObserver& removed)
+      : observers_(observers), removed_(removed) {}
+  void OnEvent() override {
+    CountingObserver::OnEvent();
+    observers_.Remove(removed_);
+  }
+
+ private:
+  ObserverList<CountingObserver>& observers_;
+  CountingObserver& removed_;
+};
+TEST(ObserverListTest, ObserverRemovedDuringDispatchIsNotCalled) {
+  ObserverList<CountingObserver> observers;
+  CountingObserver removed;
+  RemovingObserver removing(observers, removed);
+  observers.Add(removing);
+  observers.Add(removed);
+  observers.ForEach([](CountingObserver& o) { o.OnEvent(); });
+  EXPECT_EQ(removing.count, 1);
+  EXPECT_EQ(removed.count, 0);
+}
+TEST(ObserverListTest, RemoveWaitsForDispatchOnOtherThread) {
+  ObserverList<CountingObserver> observers;
+  CountingObserver observer;
+  observers.Add(observer);
+  std::atomic<bool> dispatching(false);
+  std::atomic<bool> dispatched(false);
+  std::thread dispatch_thread([&] {
+    observers.ForEach([&](CountingObserver& o) {
+      dispatching = true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      o.OnEvent();
+      dispatched = true;
+    });
+  });
+  while (!dispatching)
+    std::this_thread::yield();
+  EXPECT_TRUE(observers.Remove(observer));
+  EXPECT_TRUE(dispatched);
+  EXPECT_EQ(observer.count, 1);
+  dispatch_thread.join();
+}
+}  // namespace base
+}  // namespace owt
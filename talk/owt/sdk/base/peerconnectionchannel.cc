@@ -2,23 +2,74 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 #include "talk/owt/sdk/base/peerconnectionchannel.h"
+#include <algorithm>
 #include <vector>
+#include "talk/owt/sdk/base/mediautils.h"
 #include "talk/owt/sdk/base/sdputils.h"
+#include "talk/owt/sdk/include/cpp/owt/base/bandwidthestimatecache.h"
+#include "talk/owt/sdk/include/cpp/owt/base/globalconfiguration.h"
 #include "webrtc/api/peer_connection_interface.h"
+#include "webrtc/api/transport/bitrate_settings.h"
+#include "webrtc/p2p/base/ice_transport_internal.h"
 #include "webrtc/rtc_base/logging.h"
 #include "webrtc/rtc_base/thread.h"
+#include "webrtc/rtc_base/time_utils.h"
 #include "webrtc/system_wrappers/include/field_trial.h"
 
 using namespace rtc;
 namespace owt {
 namespace base {
+// Interval of sampling bandwidth estimate while ICE is connected.
+static const int kBandwidthEstimateSampleIntervalMs = 2000;
+// Estimates sampled earlier than this after connected are not converged, and
+// are not recorded.
+static const int64_t kBandwidthEstimateConvergenceMs = 10000;
+// Identifies the local network by its type and address. Only the /64 prefix
+// of an IPv6 address is used, because the interface ID changes over time with
+// privacy extensions.
+static std::string NetworkFingerprint(const std::string& network_type,
+                                      const std::string& ip) {
+  int colons = 0;
+  for (size_t i = 0; i < ip.size(); i++) {
+    if (ip[i] == ':' && ++colons == 4)
+      return network_type + "/" + ip.substr(0, i);
+  }
+  return network_type + "/" + ip;
+}
+static const RTCIceCandidatePairStats* SelectedCandidatePair(
+    const RTCStatsReport& report) {
+  for (const RTCStats& stats : report) {
+    if (stats.type != RTCStatsType::kTransport)
+      continue;
+    const RTCStats* pair = report.Get(
+        stats.cast_to<RTCTransportStats>().selected_candidate_pair_id);
+    if (pair && pair->type == RTCStatsType::kCandidatePair)
+      return &pair->cast_to<RTCIceCandidatePairStats>();
+  }
+  return nullptr;
+}
 PeerConnectionChannel::PeerConnectionChannel(
     PeerConnectionChannelConfiguration configuration)
     : configuration_(configuration),
       peer_connection_(nullptr),
-      factory_(nullptr) {}
+      factory_(nullptr),
+      ice_connected_(false),
+      ice_disconnected_time_(0),
+      ice_restart_timer_(TimerService::kInvalidTimerId),
+      last_ice_restart_time_(0),
+      bwe_sample_(std::make_shared<BandwidthEstimateSample>()),
+      bwe_sampling_(false),
+      bwe_sample_timer_(TimerService::kInvalidTimerId) {
+  ResetVideoEncodingParameters();
+}
 
 PeerConnectionChannel::~PeerConnectionChannel() {
+  {
+    std::lock_guard<std::mutex> lock(ice_restart_mutex_);
+    TimerService::Get().Cancel(ice_restart_timer_);
+  }
+  StopBandwidthEstimateSampling();
+  RecordBandwidthEstimate();
   if (peer_connection_ != nullptr) {
     peer_connection_->Close();
     peer_connection_ = nullptr;
@@ -41,6 +92,18 @@ bool PeerConnectionChannel::InitializePeerConnection() {
     return false;
   }
   RTC_CHECK(peer_connection_);
+  // BWE rate limits are also applied by field trials, but field trials are
+  // initialized only once when the factory is created. Apply start bitrate
+  // per PeerConnection, so limits set later, e.g. from a link capacity probe,
+  // take effect.
+  int start_bitrate, min_bitrate, max_bitrate;
+  GlobalConfiguration::GetBweRateLimits(start_bitrate, min_bitrate,
+                                        max_bitrate);
+  if (start_bitrate > 0) {
+    webrtc::BitrateSettings bitrate_settings;
+    bitrate_settings.start_bitrate_bps = start_bitrate * 1000;
+    peer_connection_->SetBitrate(bitrate_settings);
+  }
   return true;
 }
 void PeerConnectionChannel::ApplyBitrateSettings() {
@@ -53,35 +116,135 @@ void PeerConnectionChannel::ApplyBitrateSettings() {
   }
   for (auto sender : senders) {
     auto sender_track = sender->track();
-    if (sender_track != nullptr) {
-      webrtc::RtpParameters rtp_parameters = sender->GetParameters();
-      for (size_t idx = 0; idx < rtp_parameters.encodings.size(); idx++) {
-        // TODO(jianlin): It may not be appropriate to set the same settings
-        // on all encodings. Update the logic when upstream implement the
-        // the per codec settings, and many other encoding specific setttings
-        // should move here instead of modifying SDP.
-        if (sender_track->kind() ==
-            webrtc::MediaStreamTrackInterface::kAudioKind) {
-          if (configuration_.audio.size() > 0 &&
-              configuration_.audio[0].max_bitrate > 0) {
-            rtp_parameters.encodings[idx].max_bitrate_bps =
-                absl::optional<int>(configuration_.audio[0].max_bitrate * 1024);
-            sender->SetParameters(rtp_parameters);
-          }
-        } else if (sender_track->kind() ==
-                   webrtc::MediaStreamTrackInterface::kVideoKind) {
-          if (configuration_.video.size() > 0 &&
-              configuration_.video[0].max_bitrate > 0) {
-            rtp_parameters.encodings[idx].max_bitrate_bps =
-                absl::optional<int>(configuration_.video[0].max_bitrate * 1024);
-            sender->SetParameters(rtp_parameters);
-          }
-        }
+    if (sender_track == nullptr)
+      continue;
+    // Per encoding max bitrate set by application takes precedence. Stream
+    // level max bitrate is applied to other encodings.
+    int max_bitrate_bps = 0;
+    std::vector<RtpEncodingParameters> encoding_parameters;
+    if (sender_track->kind() == webrtc::MediaStreamTrackInterface::kAudioKind) {
+      if (configuration_.audio.size() == 0)
+        continue;
+      max_bitrate_bps = configuration_.audio[0].max_bitrate * 1024;
+      encoding_parameters = configuration_.audio[0].rtp_encoding_parameters;
+    } else if (sender_track->kind() ==
+               webrtc::MediaStreamTrackInterface::kVideoKind) {
+      if (configuration_.video.size() == 0)
+        continue;
+      max_bitrate_bps = configuration_.video[0].max_bitrate * 1024;
+      encoding_parameters = GetVideoEncodingParameters();
+    } else {
+      continue;
+    }
+    webrtc::RtpParameters rtp_parameters = sender->GetParameters();
+    bool changed = false;
+    for (size_t idx = 0; idx < rtp_parameters.encodings.size(); idx++) {
+      int encoding_max_bitrate_bps = max_bitrate_bps;
+      const RtpEncodingParameters* encoding =
+          MediaUtils::FindRtpEncodingParameters(
+              encoding_parameters, rtp_parameters.encodings[idx].rid, idx);
+      if (encoding && encoding->max_bitrate_bps != 0)
+        encoding_max_bitrate_bps = encoding->max_bitrate_bps;
+      if (encoding_max_bitrate_bps > 0) {
+        rtp_parameters.encodings[idx].max_bitrate_bps =
+            absl::optional<int>(encoding_max_bitrate_bps);
+        changed = true;
       }
     }
+    if (changed)
+      sender->SetParameters(rtp_parameters);
   }
   return;
 }
+webrtc::RTCError PeerConnectionChannel::SetVideoEncodingParameters(
+    const std::string& stream_id,
+    const std::vector<RtpEncodingParameters>& parameters) {
+  if (peer_connection_ == nullptr) {
+    return webrtc::RTCError(webrtc::RTCErrorType::INVALID_STATE,
+                            "PeerConnection is not created.");
+  }
+  int stream_max_bitrate_bps = configuration_.video.size() > 0
+                                   ? configuration_.video[0].max_bitrate * 1024
+                                   : 0;
+  bool updated = false;
+  for (auto sender : peer_connection_->GetSenders()) {
+    auto sender_track = sender->track();
+    if (sender_track == nullptr ||
+        sender_track->kind() != webrtc::MediaStreamTrackInterface::kVideoKind)
+      continue;
+    std::vector<std::string> stream_ids = sender->stream_ids();
+    if (!stream_id.empty() &&
+        std::find(stream_ids.begin(), stream_ids.end(), stream_id) ==
+            stream_ids.end())
+      continue;
+    webrtc::RtpParameters rtp_parameters = sender->GetParameters();
+    for (size_t idx = 0; idx < rtp_parameters.encodings.size(); idx++) {
+      webrtc::RtpEncodingParameters& rtp_encoding =
+          rtp_parameters.encodings[idx];
+      const RtpEncodingParameters* encoding =
+          MediaUtils::FindRtpEncodingParameters(parameters, rtp_encoding.rid,
+                                                idx);
+      if (encoding == nullptr)
+        continue;
+      MediaUtils::ApplyRtpEncodingParameters(*encoding, stream_max_bitrate_bps,
+                                             rtp_encoding);
+      if (!IsEncodingDemanded(rtp_encoding.rid))
+        rtp_encoding.active = false;
+      // Only touch temporal layers when they are actually changed, since the
+      // default value of |num_temporal_layers| is not distinguishable from an
+      // explicit 1.
+      if (encoding->num_temporal_layers > 0 &&
+          encoding->num_temporal_layers <= 4 &&
+          encoding->num_temporal_layers !=
+              rtp_encoding.num_temporal_layers.value_or(1)) {
+        rtp_encoding.num_temporal_layers = encoding->num_temporal_layers;
+      }
+    }
+    webrtc::RTCError error = sender->SetParameters(rtp_parameters);
+    if (!error.ok()) {
+      RTC_LOG(LS_WARNING) << "Failed to set encoding parameters: "
+                          << error.message();
+      return error;
+    }
+    updated = true;
+  }
+  if (!updated) {
+    return webrtc::RTCError(webrtc::RTCErrorType::INVALID_STATE,
+                            "No video sender is found.");
+  }
+  std::lock_guard<std::mutex> lock(video_encoding_parameters_mutex_);
+  std::vector<RtpEncodingParameters>& kept = video_encoding_parameters_;
+  for (size_t idx = 0; idx < parameters.size(); idx++) {
+    const RtpEncodingParameters& encoding = parameters[idx];
+    auto it = kept.end();
+    if (!encoding.rid.empty()) {
+      it = std::find_if(kept.begin(), kept.end(),
+                        [&encoding](const RtpEncodingParameters& e) {
+                          return e.rid == encoding.rid;
+                        });
+    } else if (idx < kept.size()) {
+      it = kept.begin() + idx;
+    }
+    if (it != kept.end())
+      *it = encoding;
+    else
+      kept.push_back(encoding);
+  }
+  return webrtc::RTCError::OK();
+}
+std::vector<RtpEncodingParameters>
+PeerConnectionChannel::GetVideoEncodingParameters() {
+  std::lock_guard<std::mutex> lock(video_encoding_parameters_mutex_);
+  return video_encoding_parameters_;
+}
+void PeerConnectionChannel::ResetVideoEncodingParameters() {
+  std::lock_guard<std::mutex> lock(video_encoding_parameters_mutex_);
+  if (configuration_.video.size() > 0)
+    video_encoding_parameters_ =
+        configuration_.video[0].rtp_encoding_parameters;
+  else
+    video_encoding_parameters_.clear();
+}
 
 void PeerConnectionChannel::AddTransceiver(
     rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> track,
@@ -147,7 +310,23 @@ void PeerConnectionChannel::OnSetLocalSessionDescriptionFailure(
 void PeerConnectionChannel::OnIceCandidate(
     const webrtc::IceCandidateInterface* candidate) {}
 void PeerConnectionChannel::OnIceCandidatesRemoved(
-    const std::vector<cricket::Candidate>& candidates) {}
+    const std::vector<cricket::Candidate>& candidates) {
+  if (!ice_connected_)
+    return;
+  // With continual gathering, local candidates are removed when their network
+  // is gone. Other networks don't matter while the selected candidate pair
+  // works.
+  for (const auto& candidate : candidates) {
+    if (candidate.MatchesForRemoval(selected_local_candidate_)) {
+      OnNetworksChanged();
+      return;
+    }
+  }
+}
+void PeerConnectionChannel::OnIceSelectedCandidatePairChanged(
+    const cricket::CandidatePairChangeEvent& event) {
+  selected_local_candidate_ = event.selected_candidate_pair.local_candidate();
+}
 void PeerConnectionChannel::OnSignalingChange(
     webrtc::PeerConnectionInterface::SignalingState new_state) {}
 void PeerConnectionChannel::OnAddStream(
@@ -163,6 +342,230 @@ void PeerConnectionChannel::OnIceGatheringChange(
     webrtc::PeerConnectionInterface::IceGatheringState new_state) {}
 void PeerConnectionChannel::OnNetworksChanged() {
   RTC_LOG(LS_INFO) << "PeerConnectionChannel::OnNetworksChanged.";
+  // Networks usually change in a burst, e.g. all candidates of a network are
+  // removed one by one, so ICE is restarted once after they settle.
+  static const int kNetworkChangeIceRestartDelayMs = 500;
+  if (ice_connected_) {
+    ScheduleIceRestart(kNetworkChangeIceRestartDelayMs);
+  }
+}
+void PeerConnectionChannel::CheckIceConnectionForRestart(
+    webrtc::PeerConnectionInterface::IceConnectionState new_state) {
+  // Wait a while before restarting ICE, so temporary disconnections are
+  // recovered by ICE itself.
+  static const int kIceRestartDelayMs = 2000;
+  switch (new_state) {
+    case webrtc::PeerConnectionInterface::kIceConnectionConnected:
+    case webrtc::PeerConnectionInterface::kIceConnectionCompleted:
+      ice_connected_ = true;
+      if (ice_disconnected_time_ != 0) {
+        {
+          std::lock_guard<std::mutex> lock(ice_restart_mutex_);
+          TimerService::Get().Cancel(ice_restart_timer_);
+          ice_restart_timer_ = TimerService::kInvalidTimerId;
+        }
+        int64_t freeze_duration = rtc::TimeMillis() - ice_disconnected_time_;
+        ice_disconnected_time_ = 0;
+        RTC_LOG(LS_INFO) << "ICE connection recovered after "
+                         << freeze_duration << "ms.";
+        OnIceConnectionRecovered(freeze_duration);
+      }
+      break;
+    case webrtc::PeerConnectionInterface::kIceConnectionDisconnected:
+      if (ice_disconnected_time_ != 0)
+        break;
+      ice_disconnected_time_ = rtc::TimeMillis();
+      RTC_LOG(LS_INFO) << "ICE disconnected, restart ICE if it's not "
+                          "recovered in "
+                       << kIceRestartDelayMs << "ms.";
+      ScheduleIceRestart(kIceRestartDelayMs);
+      break;
+    case webrtc::PeerConnectionInterface::kIceConnectionFailed:
+    case webrtc::PeerConnectionInterface::kIceConnectionClosed: {
+      ice_connected_ = false;
+      ice_disconnected_time_ = 0;
+      std::lock_guard<std::mutex> lock(ice_restart_mutex_);
+      TimerService::Get().Cancel(ice_restart_timer_);
+      ice_restart_timer_ = TimerService::kInvalidTimerId;
+      break;
+    }
+    default:
+      break;
+  }
+}
+void PeerConnectionChannel::ScheduleIceRestart(int64_t delay_ms) {
+  // Each restart renegotiates with remote side, so restarts are rate limited
+  // when networks keep changing.
+  static const int64_t kMinIceRestartIntervalMs = 10000;
+  std::lock_guard<std::mutex> lock(ice_restart_mutex_);
+  if (ice_restart_timer_ != TimerService::kInvalidTimerId)
+    return;
+  if (last_ice_restart_time_ != 0) {
+    delay_ms = std::max(delay_ms, last_ice_restart_time_ +
+                                      kMinIceRestartIntervalMs -
+                                      rtc::TimeMillis());
+  }
+  std::weak_ptr<PeerConnectionChannel> weak_this = GetWeakPtr();
+  ice_restart_timer_ = TimerService::Get().Schedule(delay_ms, [weak_this]() {
+    auto that = weak_this.lock();
+    if (that)
+      that->OnIceRestartTimer();
+  });
+}
+void PeerConnectionChannel::OnIceRestartTimer() {
+  {
+    std::lock_guard<std::mutex> lock(ice_restart_mutex_);
+    ice_restart_timer_ = TimerService::kInvalidTimerId;
+    last_ice_restart_time_ = rtc::TimeMillis();
+  }
+  RestartIce();
+}
+void PeerConnectionChannel::UpdateBandwidthEstimateCache(
+    webrtc::PeerConnectionInterface::IceConnectionState new_state) {
+  if (!GlobalConfiguration::GetBandwidthEstimateCacheEnabled() ||
+      configuration_.bandwidth_estimate_cache_key.empty())
+    return;
+  switch (new_state) {
+    case webrtc::PeerConnectionInterface::kIceConnectionConnected:
+    case webrtc::PeerConnectionInterface::kIceConnectionCompleted: {
+      {
+        std::lock_guard<std::mutex> lock(bwe_sample_->mutex);
+        if (bwe_sample_->connected_time == 0)
+          bwe_sample_->connected_time = rtc::TimeMillis();
+      }
+      StartBandwidthEstimateSampling();
+      break;
+    }
+    case webrtc::PeerConnectionInterface::kIceConnectionDisconnected:
+      // Estimate drops while disconnected. Don't sample it.
+      StopBandwidthEstimateSampling();
+      break;
+    case webrtc::PeerConnectionInterface::kIceConnectionFailed:
+    case webrtc::PeerConnectionInterface::kIceConnectionClosed:
+      StopBandwidthEstimateSampling();
+      RecordBandwidthEstimate();
+      break;
+    default:
+      break;
+  }
+}
+void PeerConnectionChannel::StartBandwidthEstimateSampling() {
+  {
+    std::lock_guard<std::mutex> lock(bwe_sample_timer_mutex_);
+    TimerService::Get().Cancel(bwe_sample_timer_);
+    bwe_sample_timer_ = TimerService::kInvalidTimerId;
+    bwe_sampling_ = true;
+  }
+  SampleBandwidthEstimate();
+}
+void PeerConnectionChannel::StopBandwidthEstimateSampling() {
+  std::lock_guard<std::mutex> lock(bwe_sample_timer_mutex_);
+  // A sample task already running doesn't schedule the next one after this.
+  bwe_sampling_ = false;
+  TimerService::Get().Cancel(bwe_sample_timer_);
+  bwe_sample_timer_ = TimerService::kInvalidTimerId;
+}
+void PeerConnectionChannel::SampleBandwidthEstimate() {
+  {
+    std::lock_guard<std::mutex> lock(bwe_sample_timer_mutex_);
+    if (!bwe_sampling_)
+      return;
+  }
+  if (!peer_connection_)
+    return;
+  std::shared_ptr<BandwidthEstimateSample> sample = bwe_sample_;
+  rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection =
+      peer_connection_;
+  std::string endpoint = configuration_.bandwidth_estimate_cache_key;
+  rtc::scoped_refptr<FunctionalStandardRTCStatsCollectorCallback> observer =
+      FunctionalStandardRTCStatsCollectorCallback::Create(
+          [sample, peer_connection,
+           endpoint](std::shared_ptr<RTCStatsReport> report) {
+            const RTCIceCandidatePairStats* pair =
+                SelectedCandidatePair(*report);
+            if (!pair)
+              return;
+            const RTCStats* local_stats = report->Get(pair->local_candidate_id);
+            if (!local_stats ||
+                local_stats->type != RTCStatsType::kLocalCandidate)
+              return;
+            const RTCIceCandidateStats& local =
+                local_stats->cast_to<RTCIceCandidateStats>();
+            std::string network =
+                NetworkFingerprint(local.network_type, local.ip);
+            bool seed = false;
+            {
+              std::lock_guard<std::mutex> lock(sample->mutex);
+              sample->network = network;
+              seed = !sample->seeded;
+              sample->seeded = true;
+              if (rtc::TimeMillis() - sample->connected_time >=
+                  kBandwidthEstimateConvergenceMs) {
+                // Estimates are in bps, or negative if they're unknown.
+                sample->send_kbps =
+                    std::max(0, static_cast<int>(
+                                    pair->available_outgoing_bitrate / 1000));
+                sample->receive_kbps =
+                    std::max(0, static_cast<int>(
+                                    pair->available_incoming_bitrate / 1000));
+              }
+            }
+            int send_kbps = 0, receive_kbps = 0;
+            if (!seed || !BandwidthEstimateCache::Get().Lookup(
+                             endpoint, network, send_kbps, receive_kbps) ||
+                send_kbps <= 0)
+              return;
+            int start_bitrate, min_bitrate, max_bitrate;
+            GlobalConfiguration::GetBweRateLimits(start_bitrate, min_bitrate,
+                                                  max_bitrate);
+            if (min_bitrate > 0)
+              send_kbps = std::max(send_kbps, min_bitrate);
+            if (max_bitrate > 0)
+              send_kbps = std::min(send_kbps, max_bitrate);
+            RTC_LOG(LS_INFO) << "Start bitrate from bandwidth estimate cache: "
+                             << send_kbps << "kbps.";
+            webrtc::BitrateSettings bitrate_settings;
+            bitrate_settings.start_bitrate_bps = send_kbps * 1000;
+            webrtc::RTCError error =
+                peer_connection->SetBitrate(bitrate_settings);
+            if (!error.ok()) {
+              RTC_LOG(LS_WARNING) << "Failed to set start bitrate: "
+                                  << error.message();
+            }
+          });
+  peer_connection_->GetStats(observer.get());
+  std::lock_guard<std::mutex> lock(bwe_sample_timer_mutex_);
+  if (!bwe_sampling_)
+    return;
+  std::weak_ptr<PeerConnectionChannel> weak_this = GetWeakPtr();
+  bwe_sample_timer_ = TimerService::Get().Schedule(
+      kBandwidthEstimateSampleIntervalMs, [weak_this]() {
+        auto that = weak_this.lock();
+        if (that)
+          that->SampleBandwidthEstimate();
+      });
+}
+void PeerConnectionChannel::RecordBandwidthEstimate() {
+  if (configuration_.bandwidth_estimate_cache_key.empty())
+    return;
+  std::string network;
+  int send_kbps, receive_kbps;
+  {
+    std::lock_guard<std::mutex> lock(bwe_sample_->mutex);
+    network = bwe_sample_->network;
+    send_kbps = bwe_sample_->send_kbps;
+    receive_kbps = bwe_sample_->receive_kbps;
+    // A session is recorded once.
+    bwe_sample_->send_kbps = 0;
+    bwe_sample_->receive_kbps = 0;
+  }
+  if (network.empty() || (send_kbps <= 0 && receive_kbps <= 0))
+    return;
+  RTC_LOG(LS_INFO) << "Record bandwidth estimate: send " << send_kbps
+                   << "kbps, receive " << receive_kbps << "kbps.";
+  BandwidthEstimateCache::Get().Record(
+      configuration_.bandwidth_estimate_cache_key, network, send_kbps,
+      receive_kbps);
 }
 PeerConnectionChannelConfiguration::PeerConnectionChannelConfiguration()
     : RTCConfiguration() {}
@@ -3,11 +3,14 @@
 // SPDX-License-Identifier: Apache-2.0
 #ifndef WOOGEEN_BASE_PEERCONNECTIONCHANNEL_H_
 #define WOOGEEN_BASE_PEERCONNECTIONCHANNEL_H_
+#include <memory>
+#include <mutex>
 #include <vector>
 #include "webrtc/rtc_base/third_party/sigslot/sigslot.h"
 #include "webrtc/sdk/media_constraints.h"
 #include "talk/owt/sdk/base/peerconnectiondependencyfactory.h"
 #include "talk/owt/sdk/base/functionalobserver.h"
+#include "talk/owt/sdk/base/timerservice.h"
 #include "talk/owt/sdk/include/cpp/owt/base/commontypes.h"
 namespace rtc {
 class NetworkMonitorInterface;
@@ -22,6 +25,10 @@ struct PeerConnectionChannelConfiguration
   std::vector<AudioEncodingParameters> audio;
   /// Indicate whether this PeerConnection is used for sending encoded frame.
   bool encoded_video_frame_;
+  /// Remote endpoint in bandwidth estimate cache. Server host for conference,
+  /// remote user ID for P2P. Bandwidth estimate cache is not used if it's
+  /// empty.
+  std::string bandwidth_estimate_cache_key;
 };
 class PeerConnectionChannel : public webrtc::PeerConnectionObserver,
                               public webrtc::DataChannelObserver,
@@ -37,6 +44,22 @@ class PeerConnectionChannel : public webrtc::PeerConnectionObserver,
   // will result in a false return, with remaining settings applicable still applied.
   // Subclasses can override this to implementation specific bitrate allocation policies.
   void ApplyBitrateSettings();
+  // Update encoding parameters of video senders with SetParameters, so no
+  // renegotiation is needed. Encodings are matched by rid, or by index if rid
+  // is empty. Only senders of |stream_id| are updated unless it's empty.
+  // Updated values are kept by later ApplyBitrateSettings calls.
+  webrtc::RTCError SetVideoEncodingParameters(
+      const std::string& stream_id,
+      const std::vector<RtpEncodingParameters>& parameters);
+  // Video encoding parameters set by application, including updates from
+  // SetVideoEncodingParameters. Safe to call on any thread.
+  std::vector<RtpEncodingParameters> GetVideoEncodingParameters();
+  // Reload video encoding parameters from |configuration_| after it's
+  // replaced.
+  void ResetVideoEncodingParameters();
+  // Return false if video encoding |rid| is not used by any receiver, so it's
+  // kept inactive regardless of encoding parameters.
+  virtual bool IsEncodingDemanded(const std::string& rid) { return true; }
   // Subclasses should prepare observers for these functions and post
   // message to PeerConnectionChannel.
   virtual void CreateOffer() = 0;
@@ -64,6 +87,8 @@ class PeerConnectionChannel : public webrtc::PeerConnectionObserver,
   virtual void OnIceCandidate(const webrtc::IceCandidateInterface* candidate) override;
   virtual void OnIceCandidatesRemoved(
       const std::vector<cricket::Candidate>& candidates) override;
+  virtual void OnIceSelectedCandidatePairChanged(
+      const cricket::CandidatePairChangeEvent& event) override;
   // DataChannelObserver proxy
   // Data channel events will be bridged to these methods to avoid name
   // conflict.
@@ -79,8 +104,29 @@ class PeerConnectionChannel : public webrtc::PeerConnectionObserver,
   virtual void OnSetRemoteSessionDescriptionSuccess();
   virtual void OnSetRemoteSessionDescriptionFailure(const std::string& error);
   virtual void OnSetRemoteDescriptionComplete(webrtc::RTCError error);
-  // Fired when networks changed. (Only works on iOS)
+  // Fired when networks changed. Also fired when the local candidate of the
+  // selected candidate pair is removed after ICE connected, which usually
+  // means its network is gone. ICE is restarted shortly if it was connected.
   virtual void OnNetworksChanged();
+  // Subclasses call it when ICE connection state changes. ICE is restarted if
+  // connection doesn't recover shortly after disconnected, and
+  // OnIceConnectionRecovered is fired when it recovers.
+  void CheckIceConnectionForRestart(
+      webrtc::PeerConnectionInterface::IceConnectionState new_state);
+  // Restart ICE with new credentials. WebRTC keeps using the selected
+  // candidate pair until a new pair is nominated, so media keeps flowing if the
+  // old path still works. Subclasses renegotiate with remote side.
+  virtual void RestartIce() {}
+  // Fired when ICE connection is recovered after being disconnected.
+  virtual void OnIceConnectionRecovered(int64_t freeze_duration_ms) {}
+  // Returns a weak reference to this channel for tasks that may run after it
+  // is destroyed.
+  virtual std::weak_ptr<PeerConnectionChannel> GetWeakPtr() = 0;
+  // Subclasses call it when ICE connection state changes. If bandwidth
+  // estimate cache is enabled, start bitrate is seeded from the cache once
+  // connected, and the converged estimate is recorded when the session ends.
+  void UpdateBandwidthEstimateCache(
+      webrtc::PeerConnectionInterface::IceConnectionState new_state);
   PeerConnectionChannelConfiguration configuration_;
   // Use this data channel to send p2p messages.
   // Use a map if we need more than one data channels for a PeerConnection in
@@ -100,6 +146,54 @@ class PeerConnectionChannel : public webrtc::PeerConnectionObserver,
   // |factory_| is got from PeerConnectionDependencyFactory::Get() which is
   // shared among all PeerConnectionChannels.
   rtc::scoped_refptr<PeerConnectionDependencyFactory> factory_;
+  bool ice_connected_;
+  // Time when ICE was disconnected, in milliseconds. 0 if it's not
+  // disconnected.
+  int64_t ice_disconnected_time_;
+  // Copy of |configuration_.video[0].rtp_encoding_parameters| updated by
+  // SetVideoEncodingParameters on application's thread. It's read on
+  // signaling thread and TimerService's thread, so it's guarded by
+  // |video_encoding_parameters_mutex_|.
+  std::mutex video_encoding_parameters_mutex_;
+  std::vector<RtpEncodingParameters> video_encoding_parameters_;
+  // Local candidate of the selected candidate pair.
+  cricket::Candidate selected_local_candidate_;
+  // Restart ICE after |delay_ms|, or later if ICE was restarted recently. A
+  // restart already scheduled is kept.
+  void ScheduleIceRestart(int64_t delay_ms);
+  void OnIceRestartTimer();
+  // Guards |ice_restart_timer_| and |last_ice_restart_time_|, which are also
+  // accessed on TimerService's thread.
+  std::mutex ice_restart_mutex_;
+  owt::base::TimerService::TimerId ice_restart_timer_;
+  // Time of last ICE restart, in milliseconds. 0 if ICE is never restarted.
+  int64_t last_ice_restart_time_;
+  // Bandwidth estimate sampled from stats. It's shared with stats callbacks,
+  // which may run after this channel is destroyed.
+  struct BandwidthEstimateSample {
+    std::mutex mutex;
+    // Fingerprint of the local network of the selected candidate pair.
+    std::string network;
+    // Latest estimate after it converged. 0 if it's unknown.
+    int send_kbps = 0;
+    int receive_kbps = 0;
+    // Whether start bitrate is seeded from the cache.
+    bool seeded = false;
+    // Time when ICE connected first, in milliseconds.
+    int64_t connected_time = 0;
+  };
+  // Sample bandwidth estimate now and every few seconds until
+  // StopBandwidthEstimateSampling is called.
+  void StartBandwidthEstimateSampling();
+  void StopBandwidthEstimateSampling();
+  void SampleBandwidthEstimate();
+  void RecordBandwidthEstimate();
+  std::shared_ptr<BandwidthEstimateSample> bwe_sample_;
+  // Guards |bwe_sampling_| and |bwe_sample_timer_|, which are also accessed
+  // on TimerService's thread.
+  std::mutex bwe_sample_timer_mutex_;
+  bool bwe_sampling_;
+  owt::base::TimerService::TimerId bwe_sample_timer_;
 };
 }
 }
@@ -101,6 +101,9 @@ PeerConnectionDependencyFactory::CreatePeerConnection(
     return CreatePeerConnectionOnCurrentThread(config, observer);
   });
 }
+void PeerConnectionDependencyFactory::PostTask(std::function<void()> task) {
+  pc_thread_->PostTask(std::move(task));
+}
 PeerConnectionDependencyFactory* PeerConnectionDependencyFactory::Get() {
   std::call_once(get_pcdf_once, []() {
     dependency_factory_ =
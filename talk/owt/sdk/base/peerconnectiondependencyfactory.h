@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: Apache-2.0
 #ifndef OWT_BASE_PEERCONNECTIONDEPENDENCYFACTORY_H_
 #define OWT_BASE_PEERCONNECTIONDEPENDENCYFACTORY_H_
+#include <functional>
 #include <mutex>
 #include "webrtc/api/peer_connection_interface.h"
 #include "webrtc/api/media_stream_interface.h"
@@ -54,6 +55,9 @@ class PeerConnectionDependencyFactory : public rtc::RefCountInterface {
       webrtc::VideoTrackSourceInterface* video_source);
   rtc::scoped_refptr<AudioSourceInterface> CreateAudioSource(
       const cricket::AudioOptions& options);
+  // Run |task| on the thread where PeerConnections are created, without
+  // waiting for it.
+  void PostTask(std::function<void()> task);
   // Returns current |pc_factory_|.
   rtc::scoped_refptr<PeerConnectionFactoryInterface> PeerConnectionFactory()
       const;
@@ -0,0 +1,185 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifdef OWT_ENABLE_QUIC
+#include "talk/owt/sdk/include/cpp/owt/base/quicmessagestream.h"
+#include "talk/owt/sdk/base/messageframer.h"
+#include "talk/owt/sdk/base/timerservice.h"
+#include "webrtc/rtc_base/logging.h"
+namespace owt {
+namespace base {
+class QuicMessageStream::StreamObserver final : public QuicStreamObserver {
+ public:
+  explicit StreamObserver(std::weak_ptr<QuicMessageStream> message_stream)
+      : message_stream_(message_stream) {}
+  void OnCanRead() override {
+    auto message_stream = message_stream_.lock();
+    if (message_stream)
+      message_stream->OnCanRead();
+  }
+  void OnBufferedDataLow() override {
+    auto message_stream = message_stream_.lock();
+    if (message_stream)
+      message_stream->OnBufferedDataLow();
+  }
+
+ private:
+  std::weak_ptr<QuicMessageStream> message_stream_;
+};
+
+static QuicMessageStream::SendStatus ToSendStatus(
+    QuicStream::WriteStatus status) {
+  switch (status) {
+    case QuicStream::WriteStatus::kSuccess:
+      return QuicMessageStream::SendStatus::kSuccess;
+    case QuicStream::WriteStatus::kWouldBlock:
+      return QuicMessageStream::SendStatus::kWouldBlock;
+    default:
+      return QuicMessageStream::SendStatus::kClosed;
+  }
+}
+
+std::shared_ptr<QuicMessageStream> QuicMessageStream::Create(
+    std::shared_ptr<QuicStream> stream,
+    const QuicMessageStreamConfiguration& configuration) {
+  if (!stream)
+    return nullptr;
+  std::shared_ptr<QuicMessageStream> message_stream(
+      new QuicMessageStream(stream, configuration));
+  // Registered through a weak reference, so an event dispatched while the
+  // message stream is being destroyed doesn't reach it.
+  message_stream->stream_observer_.reset(new StreamObserver(message_stream));
+  stream->AddObserver(*message_stream->stream_observer_);
+  return message_stream;
+}
+
+QuicMessageStream::QuicMessageStream(
+    std::shared_ptr<QuicStream> stream,
+    const QuicMessageStreamConfiguration& configuration)
+    : stream_(stream),
+      configuration_(configuration),
+      framer_(new MessageFramer(configuration.max_message_size)),
+      receive_failed_(false),
+      flush_scheduled_(false),
+      blocked_(false) {}
+
+QuicMessageStream::~QuicMessageStream() {
+  stream_->RemoveObserver(*stream_observer_);
+}
+
+QuicMessageStream::SendStatus QuicMessageStream::Send(const uint8_t* data,
+                                                      size_t length) {
+  if (length > framer_->MaxMessageSize())
+    return SendStatus::kTooLarge;
+  // WriteMessage may wait for the thread of WebTransport, so |mutex_| is
+  // never locked on that thread.
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (blocked_) {
+    SendStatus status = FlushBatch();
+    if (status != SendStatus::kSuccess)
+      return status;
+  }
+  framer_->Frame(data, length, batch_);
+  if (configuration_.flush_interval_ms <= 0 ||
+      batch_.size() >= configuration_.max_batch_size) {
+    // The message is accepted even if the batch is blocked. It's written
+    // after OnBufferedDataLow.
+    SendStatus status = FlushBatch();
+    return status == SendStatus::kClosed ? status : SendStatus::kSuccess;
+  }
+  if (!flush_scheduled_)
+    ScheduleFlush(configuration_.flush_interval_ms);
+  return SendStatus::kSuccess;
+}
+
+QuicMessageStream::SendStatus QuicMessageStream::Flush() {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return FlushBatch();
+}
+
+QuicMessageStream::SendStatus QuicMessageStream::FlushBatch() {
+  if (batch_.empty())
+    return SendStatus::kSuccess;
+  QuicStream::WriteStatus status =
+      stream_->WriteMessage(batch_.data(), batch_.size());
+  // Keep the capacity for next batch.
+  if (status == QuicStream::WriteStatus::kSuccess)
+    batch_.clear();
+  blocked_ = status == QuicStream::WriteStatus::kWouldBlock;
+  return ToSendStatus(status);
+}
+
+void QuicMessageStream::ScheduleFlush(int delay_ms) {
+  flush_scheduled_ = true;
+  std::weak_ptr<QuicMessageStream> weak_this = shared_from_this();
+  TimerService::Get().Schedule(delay_ms, [weak_this] {
+    auto that = weak_this.lock();
+    if (!that)
+      return;
+    // Writing may block, so it's not done on the timer thread.
+    that->stream_->PostSendTask([weak_this] {
+      auto that = weak_this.lock();
+      if (!that)
+        return;
+      const std::lock_guard<std::mutex> lock(that->mutex_);
+      that->flush_scheduled_ = false;
+      that->FlushBatch();
+    });
+  });
+}
+
+void QuicMessageStream::AddObserver(QuicMessageStreamObserver& observer) {
+  if (!observers_.Add(observer)) {
+    RTC_LOG(LS_INFO) << "Adding duplicate observer.";
+    return;
+  }
+  // Messages may arrive before any observer is added. They are parsed on the
+  // thread of stream events, like other messages.
+  stream_->TriggerCanRead();
+}
+
+void QuicMessageStream::RemoveObserver(QuicMessageStreamObserver& observer) {
+  observers_.Remove(observer);
+}
+
+void QuicMessageStream::OnCanRead() {
+  if (receive_failed_)
+    return;
+  // Messages are parsed in the stream's read buffer. A partial message is
+  // left there until the rest of it arrives.
+  if (observers_.Get()->empty())
+    return;
+  QuicStreamBuffer buffer = stream_->PeekRead();
+  size_t offset = 0;
+  MessageFramer::ParseResult result;
+  const uint8_t* message;
+  size_t message_size;
+  size_t consumed;
+  while ((result = framer_->Parse(buffer.data + offset, buffer.length - offset,
+                                  message, message_size, consumed)) ==
+         MessageFramer::ParseResult::kMessage) {
+    observers_.ForEach([&](QuicMessageStreamObserver& o) {
+      o.OnMessage(message, message_size);
+    });
+    offset += consumed;
+  }
+  stream_->ConsumeRead(offset);
+  if (result == MessageFramer::ParseResult::kTooLarge) {
+    RTC_LOG(LS_WARNING) << "Received message exceeds max message size.";
+    receive_failed_ = true;
+    observers_.ForEach(
+        [](QuicMessageStreamObserver& o) { o.OnMessageTooLarge(); });
+  }
+}
+
+void QuicMessageStream::OnBufferedDataLow() {
+  std::weak_ptr<QuicMessageStream> weak_this = shared_from_this();
+  stream_->PostSendTask([weak_this] {
+    auto that = weak_this.lock();
+    if (that)
+      that->Flush();
+  });
+}
+}  // namespace base
+}  // namespace owt
+#endif  // OWT_ENABLE_QUIC
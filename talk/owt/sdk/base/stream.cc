@@ -2,6 +2,8 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 //
+#include <algorithm>
+#include <cstring>
 #include "modules/video_capture/video_capture.h"
 #include "pc/video_track_source.h"
 #include "talk/owt/sdk/base/vcmcapturer.h"
@@ -11,6 +13,8 @@
 #include "webrtc/sdk/media_constraints.h"
 
 #include "talk/owt/sdk/base/customizedframescapturer.h"
+#include "talk/owt/sdk/base/executortaskqueue.h"
+#include "talk/owt/sdk/base/timerservice.h"
 #include "talk/owt/sdk/base/webrtcaudiorendererimpl.h"
 #include "talk/owt/sdk/base/webrtcvideorendererimpl.h"
 #include "talk/owt/sdk/include/cpp/owt/base/framegeneratorinterface.h"
@@ -355,49 +359,26 @@ StreamSourceInfo Stream::Source() const {
   return source_;
 }
 void Stream::AddObserver(StreamObserver& observer) {
-  const std::lock_guard<std::mutex> lock(observer_mutex_);
-  std::vector<std::reference_wrapper<StreamObserver>>::iterator it =
-      std::find_if(observers_.begin(), observers_.end(),
-                   [&](std::reference_wrapper<StreamObserver> o) -> bool {
-                     return &observer == &(o.get());
-                   });
-  if (it != observers_.end()) {
+  if (!observers_.Add(observer))
     RTC_LOG(LS_INFO) << "Adding duplicate observer.";
-    return;
-  }
-  observers_.push_back(observer);
 }
 void Stream::RemoveObserver(StreamObserver& observer) {
-  const std::lock_guard<std::mutex> lock(observer_mutex_);
-  auto it = std::find_if(observers_.begin(), observers_.end(),
-                         [&](std::reference_wrapper<StreamObserver> o) -> bool {
-                           return &observer == &(o.get());
-                         });
-  if (it != observers_.end())
-    observers_.erase(it);
+  observers_.Remove(observer);
 }
 void Stream::TriggerOnStreamEnded() {
   ended_ = true;
-  for (auto its = observers_.begin(); its != observers_.end(); ++its) {
-    (*its).get().OnEnded();
-  }
+  observers_.ForEach([](StreamObserver& o) { o.OnEnded(); });
 }
 void Stream::TriggerOnStreamUpdated() {
-  for (auto its = observers_.begin(); its != observers_.end(); ++its) {
-    (*its).get().OnUpdated();
-  }
+  observers_.ForEach([](StreamObserver& o) { o.OnUpdated(); });
 }
 void Stream::TriggerOnStreamMute(TrackKind track_kind) {
   ended_ = true;
-  for (auto its = observers_.begin(); its != observers_.end(); ++its) {
-    (*its).get().OnMute(track_kind);
-  }
+  observers_.ForEach([&](StreamObserver& o) { o.OnMute(track_kind); });
 }
 void Stream::TriggerOnStreamUnmute(TrackKind track_kind) {
   ended_ = true;
-  for (auto its = observers_.begin(); its != observers_.end(); ++its) {
-    (*its).get().OnUnmute(track_kind);
-  }
+  observers_.ForEach([&](StreamObserver& o) { o.OnUnmute(track_kind); });
 }
 #if !defined(WEBRTC_WIN)
 LocalStream::LocalStream() {}
@@ -739,46 +720,356 @@ MediaStreamInterface* RemoteStream::MediaStream() {
 }
 
 #ifdef OWT_ENABLE_QUIC
+static const uint64_t kDefaultHighWatermark = 1024 * 1024;
+static const uint64_t kDefaultLowWatermark = 256 * 1024;
+static const int kDrainCheckIntervalMs = 10;
 QuicStream::QuicStream(owt::quic::WebTransportStreamInterface* quic_stream,
-           const std::string& session_id)
+                       const std::string& session_id,
+                       std::shared_ptr<rtc::TaskQueue> event_queue,
+                       std::weak_ptr<rtc::TaskQueue> transport_queue)
     : quic_stream_(quic_stream), session_id_(session_id), can_read_(true),
-      can_write_(true), fin_read_(false) {
+      can_write_(true), fin_read_(false), reset_(false),
+      read_buffer_offset_(0),
+      default_event_queue_(event_queue),
+      transport_queue_(transport_queue),
+      event_queue_(event_queue),
+      high_watermark_(kDefaultHighWatermark),
+      low_watermark_(kDefaultLowWatermark),
+      above_high_watermark_(false),
+      send_queue_offset_(0),
+      queued_bytes_(0),
+      drain_check_scheduled_(false) {
 }
 
 QuicStream::~QuicStream() {
+  // WebTransport may outlive this object. Stop its events from reaching here.
+  auto quic_stream = quic_stream_.load();
+  if (quic_stream)
+    quic_stream->SetVisitor(nullptr);
 }
 
 size_t QuicStream::Write(uint8_t* data, size_t length) {
-  if (quic_stream_ && data != nullptr && length > 0) {
-    return quic_stream_->Write(data, length);
+  auto quic_stream = quic_stream_.load();
+  if (quic_stream && data != nullptr && length > 0) {
+    size_t written = quic_stream->Write(data, length);
+    CheckWatermarks();
+    return written;
   }
   return 0;
 }
 
-size_t QuicStream::Read(uint8_t* data, size_t length) {
-  if (quic_stream_ && data != nullptr && length > 0 && !fin_read_) {
-    return quic_stream_->Read(data, length);
-  } else {
+size_t QuicStream::WriteV(const QuicStreamBuffer* buffers, size_t count) {
+  auto quic_stream = quic_stream_.load();
+  if (!quic_stream || buffers == nullptr)
     return 0;
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (buffers[i].data == nullptr || buffers[i].length == 0)
+      continue;
+    size_t written = quic_stream->Write(buffers[i].data, buffers[i].length);
+    total += written;
+    if (written < buffers[i].length)
+      break;
   }
+  if (total > 0)
+    CheckWatermarks();
+  return total;
 }
 
-size_t QuicStream::ReadableBytes() const {
-  if (quic_stream_ && !fin_read_) {
-    return quic_stream_->ReadableBytes();
+void QuicStream::SetBufferWatermarks(uint64_t high_watermark,
+                                     uint64_t low_watermark) {
+  RTC_DCHECK_LE(low_watermark, high_watermark);
+  {
+    const std::lock_guard<std::mutex> lock(send_mutex_);
+    high_watermark_ = high_watermark;
+    low_watermark_ = std::min(low_watermark, high_watermark);
+  }
+  CheckWatermarks();
+}
+
+QuicStream::WriteStatus QuicStream::WriteMessage(const uint8_t* data,
+                                                 size_t length) {
+  if (!quic_stream_ || reset_)
+    return WriteStatus::kClosed;
+  if (data == nullptr || length == 0)
+    return WriteStatus::kSuccess;
+  {
+    const std::lock_guard<std::mutex> lock(send_mutex_);
+    // Checked again since it may be closed while waiting for the lock.
+    auto quic_stream = quic_stream_.load();
+    if (!quic_stream)
+      return WriteStatus::kClosed;
+    if (above_high_watermark_)
+      return WriteStatus::kWouldBlock;
+    size_t written = 0;
+    // Keep the order of messages queued before.
+    if (send_queue_.empty())
+      written = quic_stream->Write(data, length);
+    if (written < length) {
+      send_queue_.emplace_back(data + written, data + length);
+      queued_bytes_ += length - written;
+    }
+  }
+  CheckWatermarks();
+  return WriteStatus::kSuccess;
+}
+
+void QuicStream::FlushSendQueue() {
+  auto quic_stream = quic_stream_.load();
+  if (!quic_stream)
+    return;
+  while (!send_queue_.empty() && !reset_) {
+    std::vector<uint8_t>& message = send_queue_.front();
+    size_t remaining = message.size() - send_queue_offset_;
+    size_t written =
+        quic_stream->Write(message.data() + send_queue_offset_, remaining);
+    queued_bytes_ -= written;
+    if (written < remaining) {
+      send_queue_offset_ += written;
+      return;
+    }
+    send_queue_.pop_front();
+    send_queue_offset_ = 0;
+  }
+}
+
+void QuicStream::CheckWatermarks() {
+  std::unique_lock<std::mutex> lock(send_mutex_);
+  UpdateWatermarks(lock);
+}
+
+void QuicStream::UpdateWatermarks(std::unique_lock<std::mutex>& lock) {
+  bool drained = false;
+  uint64_t buffered = BufferedDataBytes() + queued_bytes_;
+  if (!above_high_watermark_ && buffered >= high_watermark_) {
+    above_high_watermark_ = true;
+  } else if (above_high_watermark_ && buffered <= low_watermark_) {
+    above_high_watermark_ = false;
+    drained = true;
+  }
+  bool schedule_drain_check = (above_high_watermark_ || !send_queue_.empty()) &&
+                              !drain_check_scheduled_ && !reset_;
+  if (schedule_drain_check)
+    drain_check_scheduled_ = true;
+  lock.unlock();
+  if (schedule_drain_check) {
+    std::weak_ptr<QuicStream> weak_this = weak_from_this();
+    TimerService::Get().Schedule(kDrainCheckIntervalMs, [weak_this] {
+      auto that = weak_this.lock();
+      if (!that)
+        return;
+      // WebTransport calls may block, so they are not made on the timer
+      // thread shared by the whole SDK.
+      that->PostSendTask([weak_this] {
+        auto that = weak_this.lock();
+        if (that)
+          that->Drain();
+      });
+    });
+  }
+  if (drained)
+    TriggerEvent([](QuicStreamObserver& o) { o.OnBufferedDataLow(); });
+}
+
+void QuicStream::Drain() {
+  std::unique_lock<std::mutex> lock(send_mutex_);
+  drain_check_scheduled_ = false;
+  FlushSendQueue();
+  UpdateWatermarks(lock);
+}
+
+size_t QuicStream::Read(uint8_t* data, size_t length) {
+  if (data == nullptr || length == 0)
+    return 0;
+  // Data already taken by PeekRead goes first.
+  size_t buffered = read_buffer_.size() - read_buffer_offset_;
+  if (buffered > 0) {
+    size_t read = std::min(buffered, length);
+    memcpy(data, read_buffer_.data() + read_buffer_offset_, read);
+    ConsumeRead(read);
+    return read;
+  }
+  auto quic_stream = quic_stream_.load();
+  if (quic_stream && !fin_read_) {
+    return quic_stream->Read(data, length);
   } else {
     return 0;
   }
 }
 
+size_t QuicStream::ReadableBytes() const {
+  size_t readable = read_buffer_.size() - read_buffer_offset_;
+  auto quic_stream = quic_stream_.load();
+  if (quic_stream && !fin_read_)
+    readable += quic_stream->ReadableBytes();
+  return readable;
+}
+
 uint64_t QuicStream::BufferedDataBytes() const {
-  if (quic_stream_) {
-    return quic_stream_->BufferedDataBytes();
+  auto quic_stream = quic_stream_.load();
+  if (quic_stream) {
+    return quic_stream->BufferedDataBytes();
   } else {
     return 0;
   }
 }
 
+size_t QuicStream::ReadAll(std::vector<uint8_t>& buffer) {
+  size_t total = 0;
+  size_t readable = ReadableBytes();
+  while (readable > 0) {
+    size_t offset = buffer.size();
+    buffer.resize(offset + readable);
+    size_t read = Read(buffer.data() + offset, readable);
+    buffer.resize(offset + read);
+    total += read;
+    if (read == 0)
+      break;
+    readable = ReadableBytes();
+  }
+  return total;
+}
+
+QuicStreamBuffer QuicStream::PeekRead() {
+  auto quic_stream = quic_stream_.load();
+  size_t readable =
+      (quic_stream && !fin_read_) ? quic_stream->ReadableBytes() : 0;
+  if (readable > 0) {
+    // Move data not consumed yet to the front, so the buffer doesn't grow
+    // while its capacity is reused.
+    if (read_buffer_offset_ > 0) {
+      read_buffer_.erase(read_buffer_.begin(),
+                         read_buffer_.begin() + read_buffer_offset_);
+      read_buffer_offset_ = 0;
+    }
+    size_t size = read_buffer_.size();
+    read_buffer_.resize(size + readable);
+    size_t read = quic_stream->Read(read_buffer_.data() + size, readable);
+    read_buffer_.resize(size + read);
+  }
+  return QuicStreamBuffer{read_buffer_.data() + read_buffer_offset_,
+                          read_buffer_.size() - read_buffer_offset_};
+}
+
+void QuicStream::ConsumeRead(size_t length) {
+  RTC_DCHECK_LE(length, read_buffer_.size() - read_buffer_offset_);
+  read_buffer_offset_ =
+      std::min(read_buffer_offset_ + length, read_buffer_.size());
+  if (read_buffer_offset_ == read_buffer_.size()) {
+    // Keep the capacity for next PeekRead.
+    read_buffer_.clear();
+    read_buffer_offset_ = 0;
+  }
+}
+
+void QuicStream::AddObserver(QuicStreamObserver& observer) {
+  if (!observers_.Add(observer)) {
+    RTC_LOG(LS_INFO) << "Adding duplicate observer.";
+    return;
+  }
+  // Data may arrive before any observer is added. Data kept by PeekRead is
+  // not checked here because the reader has seen it. The event is triggered on
+  // the event queue like other events, never on the caller's thread.
+  auto quic_stream = quic_stream_.load();
+  if (quic_stream && !fin_read_ && quic_stream->ReadableBytes() > 0)
+    OnCanRead();
+}
+
+void QuicStream::RemoveObserver(QuicStreamObserver& observer) {
+  observers_.Remove(observer);
+}
+
+void QuicStream::SetEventExecutor(
+    std::function<void(std::function<void()>)> executor) {
+  std::shared_ptr<rtc::TaskQueue> event_queue = default_event_queue_;
+  if (executor)
+    event_queue = CreateCallbackQueue(executor, "QuicStreamEventQueue");
+  const std::lock_guard<std::mutex> lock(event_queue_mutex_);
+  event_queue_ = event_queue;
+}
+
+void QuicStream::OnCanRead() {
+  can_read_ = true;
+  TriggerEvent([](QuicStreamObserver& o) { o.OnCanRead(); });
+}
+
+void QuicStream::OnCanWrite() {
+  can_write_ = true;
+  {
+    // Don't block WebTransport's thread. The owner of |send_mutex_| may be
+    // waiting for this thread in a WebTransport call, and a drain check is
+    // always scheduled while data is queued.
+    std::unique_lock<std::mutex> lock(send_mutex_, std::try_to_lock);
+    if (lock.owns_lock()) {
+      FlushSendQueue();
+      UpdateWatermarks(lock);
+    }
+  }
+  TriggerEvent([](QuicStreamObserver& o) { o.OnCanWrite(); });
+}
+
+void QuicStream::OnFinRead() {
+  // OnFinRead the stream is no longer readable/writable
+  fin_read_ = true;
+  can_read_ = false;
+  TriggerEvent([](QuicStreamObserver& o) { o.OnFinRead(); });
+}
+
+void QuicStream::OnReset() {
+  if (reset_.exchange(true))
+    return;
+  can_read_ = false;
+  can_write_ = false;
+  TriggerEvent([](QuicStreamObserver& o) { o.OnReset(); });
+}
+
+void QuicStream::OnTransportClosed() {
+  OnReset();
+  const std::lock_guard<std::mutex> lock(send_mutex_);
+  quic_stream_ = nullptr;
+  send_queue_.clear();
+  send_queue_offset_ = 0;
+  queued_bytes_ = 0;
+}
+
+void QuicStream::TriggerCanRead() {
+  TriggerEvent([](QuicStreamObserver& o) { o.OnCanRead(); });
+}
+
+void QuicStream::PostSendTask(std::function<void()> task) {
+  std::shared_ptr<rtc::TaskQueue> queue = transport_queue_.lock();
+  if (!queue)
+    queue = default_event_queue_;
+  if (!queue) {
+    task();
+    return;
+  }
+  queue->PostTask([task] { task(); });
+}
+
+void QuicStream::TriggerEvent(std::function<void(QuicStreamObserver&)> event) {
+  if (observers_.Get()->empty())
+    return;
+  std::shared_ptr<rtc::TaskQueue> event_queue;
+  {
+    const std::lock_guard<std::mutex> lock(event_queue_mutex_);
+    event_queue = event_queue_;
+  }
+  if (!event_queue) {
+    observers_.ForEach(event);
+    return;
+  }
+  // Observers are looked up when the event is fired, so an observer removed
+  // before that is not called.
+  std::weak_ptr<QuicStream> weak_this = weak_from_this();
+  event_queue->PostTask([weak_this, event] {
+    auto that = weak_this.lock();
+    if (!that)
+      return;
+    that->observers_.ForEach(event);
+  });
+}
+
 std::shared_ptr<owt::base::QuicStream> LocalStream::Stream() {
   return quic_stream_;
 }
@@ -0,0 +1,105 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/base/timerservice.h"
+#include <algorithm>
+#include "webrtc/rtc_base/checks.h"
+namespace owt {
+namespace base {
+TimerService& TimerService::Get() {
+  // Intentionally leaked, so timers scheduled during static destruction don't
+  // touch a destroyed service.
+  static TimerService* service = new TimerService();
+  return *service;
+}
+TimerService::TimerService(int tick_ms, size_t slot_count)
+    : tick_(tick_ms),
+      slots_(slot_count),
+      cursor_(0),
+      next_id_(kInvalidTimerId + 1),
+      stopped_(false),
+      next_tick_time_(std::chrono::steady_clock::now()) {
+  RTC_DCHECK_GT(tick_ms, 0);
+  RTC_DCHECK_GT(slot_count, 0);
+  thread_ = std::thread(&TimerService::Run, this);
+}
+TimerService::~TimerService() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable())
+    thread_.join();
+}
+TimerService::TimerId TimerService::Schedule(int64_t delay_ms,
+                                             std::function<void()> task) {
+  if (!task)
+    return kInvalidTimerId;
+  int64_t ticks =
+      std::max<int64_t>(1, (delay_ms + tick_.count() - 1) / tick_.count());
+  TimerId id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (timers_.empty()) {
+      // The wheel doesn't turn while it's empty. Restart the clock.
+      next_tick_time_ = std::chrono::steady_clock::now() + tick_;
+    }
+    id = next_id_++;
+    size_t slot_index = (cursor_ + ticks) % slots_.size();
+    Slot& slot = slots_[slot_index];
+    slot.push_back(Timer{id, static_cast<size_t>((ticks - 1) / slots_.size()),
+                         std::move(task)});
+    timers_[id] = std::make_pair(slot_index, std::prev(slot.end()));
+  }
+  cv_.notify_one();
+  return id;
+}
+bool TimerService::Cancel(TimerId id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = timers_.find(id);
+  if (it == timers_.end())
+    return false;
+  slots_[it->second.first].erase(it->second.second);
+  timers_.erase(it);
+  return true;
+}
+size_t TimerService::PendingCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return timers_.size();
+}
+void TimerService::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopped_) {
+    if (timers_.empty()) {
+      cv_.wait(lock, [this] { return stopped_ || !timers_.empty(); });
+      continue;
+    }
+    if (cv_.wait_until(lock, next_tick_time_, [this] { return stopped_; }))
+      break;
+    next_tick_time_ += tick_;
+    cursor_ = (cursor_ + 1) % slots_.size();
+    std::vector<std::function<void()>> expired;
+    Slot& slot = slots_[cursor_];
+    for (auto it = slot.begin(); it != slot.end();) {
+      if (it->rounds > 0) {
+        it->rounds--;
+        ++it;
+        continue;
+      }
+      expired.push_back(std::move(it->task));
+      timers_.erase(it->id);
+      it = slot.erase(it);
+    }
+    if (expired.empty())
+      continue;
+    // Tasks may schedule or cancel timers.
+    lock.unlock();
+    for (auto& task : expired) {
+      task();
+    }
+    lock.lock();
+  }
+}
+}  // namespace base
+}  // namespace owt
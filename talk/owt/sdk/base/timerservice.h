@@ -0,0 +1,63 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OWT_BASE_TIMERSERVICE_H_
+#define OWT_BASE_TIMERSERVICE_H_
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+namespace owt {
+namespace base {
+/// Schedules delayed tasks on a hashed timer wheel driven by one thread.
+/// Scheduling and canceling a timer are O(1). Tasks run on the timer thread,
+/// so they should be short, and post long work to other task queues.
+class TimerService {
+ public:
+  typedef uint64_t TimerId;
+  /// ID never returned by Schedule.
+  static const TimerId kInvalidTimerId = 0;
+  /// Timer service shared by all clients.
+  static TimerService& Get();
+  /// Create a timer service whose precision is |tick_ms|. A wheel with
+  /// |slot_count| slots covers tick_ms*slot_count without extra rounds.
+  explicit TimerService(int tick_ms = 10, size_t slot_count = 512);
+  ~TimerService();
+  TimerService(const TimerService&) = delete;
+  TimerService& operator=(const TimerService&) = delete;
+  /// Run |task| after |delay_ms| milliseconds. Returns an ID for Cancel.
+  TimerId Schedule(int64_t delay_ms, std::function<void()> task);
+  /// Cancel a timer. Returns false if the timer is not found, which means it
+  /// has already fired, is running, or was canceled.
+  bool Cancel(TimerId id);
+  /// Number of timers not fired yet.
+  size_t PendingCount();
+ private:
+  struct Timer {
+    TimerId id;
+    // Times the cursor needs to pass the slot before this timer fires.
+    size_t rounds;
+    std::function<void()> task;
+  };
+  typedef std::list<Timer> Slot;
+  void Run();
+  const std::chrono::milliseconds tick_;
+  std::vector<Slot> slots_;
+  // Slot index and position of each pending timer, for canceling.
+  std::unordered_map<TimerId, std::pair<size_t, Slot::iterator>> timers_;
+  size_t cursor_;
+  TimerId next_id_;
+  bool stopped_;
+  std::chrono::steady_clock::time_point next_tick_time_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::thread thread_;
+};
+}  // namespace base
+}  // namespace owt
+#endif  // OWT_BASE_TIMERSERVICE_H_
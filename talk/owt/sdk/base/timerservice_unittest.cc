@@ -0,0 +1,46 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include <atomic>
+#include <future>
+#include "talk/owt/sdk/base/timerservice.h"
+#include "testing/gtest/include/gtest/gtest.h"
+namespace owt {
+namespace base {
+TEST(TimerServiceTest, FiresInOrderOfDeadline) {
+  TimerService service(1, 8);
+  std::mutex mutex;
+  std::vector<int> fired;
+  std::promise<void> done;
+  service.Schedule(30, [&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    fired.push_back(30);
+    done.set_value();
+  });
+  service.Schedule(5, [&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    fired.push_back(5);
+  });
+  // Longer than the wheel, so it needs extra rounds.
+  service.Schedule(20, [&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    fired.push_back(20);
+  });
+  done.get_future().wait();
+  std::lock_guard<std::mutex> lock(mutex);
+  EXPECT_EQ(fired, std::vector<int>({5, 20, 30}));
+}
+TEST(TimerServiceTest, CanceledTimerDoesNotFire) {
+  TimerService service(1, 8);
+  std::atomic<bool> canceled_fired(false);
+  std::promise<void> done;
+  auto id = service.Schedule(5, [&] { canceled_fired = true; });
+  service.Schedule(20, [&] { done.set_value(); });
+  EXPECT_TRUE(service.Cancel(id));
+  EXPECT_FALSE(service.Cancel(id));
+  done.get_future().wait();
+  EXPECT_FALSE(canceled_fired);
+  EXPECT_EQ(service.PendingCount(), 0u);
+}
+}  // namespace base
+}  // namespace owt
@@ -3,9 +3,13 @@
 // SPDX-License-Identifier: Apache-2.0
 #include "talk/owt/sdk/include/cpp/owt/conference/conferenceclient.h"
 #include <algorithm>
+#include <limits>
 #include <string>
+#include "talk/owt/sdk/base/executortaskqueue.h"
 #include "talk/owt/sdk/base/mediautils.h"
+#include "talk/owt/sdk/base/peerconnectiondependencyfactory.h"
 #include "talk/owt/sdk/base/stringutils.h"
+#include "talk/owt/sdk/base/timerservice.h"
 #include "talk/owt/sdk/conference/conferencepeerconnectionchannel.h"
 #ifdef OWT_ENABLE_QUIC
 #include "talk/owt/sdk/conference/conferencewebtransportchannel.h"
@@ -14,7 +18,6 @@
 #include "talk/owt/sdk/include/cpp/owt/conference/remotemixedstream.h"
 #include "talk/owt/sdk/include/cpp/owt/base/globalconfiguration.h"
 #include "webrtc/api/stats_types.h"
-#include "webrtc/api/task_queue/default_task_queue_factory.h"
 #include "webrtc/rtc_base/logging.h"
 #include "webrtc/rtc_base/strings/json.h"
 #include "webrtc/rtc_base/task_queue.h"
@@ -36,140 +39,222 @@ static const std::unordered_map<std::string, VideoSourceInfo>
                           {"encoded-file", VideoSourceInfo::kFile},
                           {"mcu", VideoSourceInfo::kMixed}};
 void Participant::AddObserver(ParticipantObserver& observer) {
-  const std::lock_guard<std::mutex> lock(observer_mutex_);
-  std::vector<std::reference_wrapper<ParticipantObserver>>::iterator it =
-      std::find_if(observers_.begin(), observers_.end(),
-                   [&](std::reference_wrapper<ParticipantObserver> o) -> bool {
-                     return &observer == &(o.get());
-                   });
-  if (it != observers_.end()) {
-    return;
-  }
-  observers_.push_back(observer);
+  observers_.Add(observer);
 }
 void Participant::RemoveObserver(ParticipantObserver& observer) {
-  const std::lock_guard<std::mutex> lock(observer_mutex_);
-  observers_.erase(
-      std::find_if(observers_.begin(), observers_.end(),
-                   [&](std::reference_wrapper<ParticipantObserver> o) -> bool {
-                     return &observer == &(o.get());
-                   }));
+  observers_.Remove(observer);
 }
 void Participant::TriggerOnParticipantLeft() {
-  // Not acquring locks for observer
-  for (auto its = observers_.begin(); its != observers_.end(); ++its) {
-    (*its).get().OnLeft();
-  }
+  observers_.ForEach([](ParticipantObserver& o) { o.OnLeft(); });
 }
 void ConferenceInfo::AddParticipant(std::shared_ptr<Participant> participant) {
-  if (!ParticipantPresent(participant->Id())) {
-    const std::lock_guard<std::mutex> lock(participants_mutex_);
+  const std::lock_guard<std::mutex> lock(participants_mutex_);
+  if (participants_by_id_.emplace(participant->Id(), participant).second) {
     participants_.push_back(participant);
   }
-  return;
 }
 void ConferenceInfo::AddOrUpdateStream(
     std::shared_ptr<RemoteStream> remote_stream,
     bool& update) {
   update = false;
   std::string stream_id = remote_stream->Id();
-  const std::lock_guard<std::mutex> lock(remote_streams_mutex_);
-  auto it = std::find_if(remote_streams_.begin(), remote_streams_.end(),
-                         [&](std::shared_ptr<RemoteStream> o) -> bool {
-                           bool match = (o->Id() == stream_id);
-                           if (match)
-                             update = true;
-                           return match;
-                         });
-  if (update && it != remote_streams_.end()) {
-    (*it)->Capabilities(remote_stream->Capabilities());
-    (*it)->Settings(remote_stream->Settings());
-    // Attributes is not supported to be updated so we will not update it.
-    TriggerOnStreamUpdated(stream_id);
-  } else {
-    remote_streams_.push_back(remote_stream);
+  std::shared_ptr<RemoteStream> existing_stream;
+  {
+    const std::lock_guard<std::mutex> lock(remote_streams_mutex_);
+    auto it = remote_streams_by_id_.find(stream_id);
+    if (it == remote_streams_by_id_.end()) {
+      remote_streams_by_id_[stream_id] = remote_stream;
+      remote_streams_.push_back(remote_stream);
+      return;
+    }
+    existing_stream = it->second;
   }
+  update = true;
+  existing_stream->Capabilities(remote_stream->Capabilities());
+  existing_stream->Settings(remote_stream->Settings());
+  // Attributes is not supported to be updated so we will not update it.
+  existing_stream->TriggerOnStreamUpdated();
 }
 void ConferenceInfo::RemoveParticipantById(const std::string& id) {
   const std::lock_guard<std::mutex> lock(participants_mutex_);
-  participants_.erase(std::find_if(
+  if (participants_by_id_.erase(id) == 0)
+    return;
+  auto it = std::find_if(
       participants_.begin(), participants_.end(),
-      [&](std::shared_ptr<Participant> o) -> bool { return o->Id() == id; }));
+      [&](std::shared_ptr<Participant> o) -> bool { return o->Id() == id; });
+  if (it != participants_.end())
+    participants_.erase(it);
 }
 void ConferenceInfo::RemoveStreamById(const std::string& stream_id) {
   const std::lock_guard<std::mutex> lock(remote_streams_mutex_);
-  remote_streams_.erase(
-      std::find_if(remote_streams_.begin(), remote_streams_.end(),
-                   [&](std::shared_ptr<RemoteStream> o) -> bool {
-                     return o->Id() == stream_id;
-                   }));
+  if (remote_streams_by_id_.erase(stream_id) == 0)
+    return;
+  auto it = std::find_if(remote_streams_.begin(), remote_streams_.end(),
+                         [&](std::shared_ptr<RemoteStream> o) -> bool {
+                           return o->Id() == stream_id;
+                         });
+  if (it != remote_streams_.end())
+    remote_streams_.erase(it);
 }
-bool ConferenceInfo::ParticipantPresent(const std::string& participant_id) {
+std::shared_ptr<Participant> ConferenceInfo::FindParticipant(
+    const std::string& participant_id) const {
   const std::lock_guard<std::mutex> lock(participants_mutex_);
-  for (auto& it : participants_) {
-    if (it->Id() == participant_id)
-      return true;
-  }
-  return false;
+  auto it = participants_by_id_.find(participant_id);
+  return it == participants_by_id_.end() ? nullptr : it->second;
 }
-bool ConferenceInfo::RemoteStreamPresent(const std::string& stream_id) {
+std::shared_ptr<RemoteStream> ConferenceInfo::FindRemoteStream(
+    const std::string& stream_id) const {
   const std::lock_guard<std::mutex> lock(remote_streams_mutex_);
-  for (auto& it : remote_streams_) {
-    if (it->Id() == stream_id)
-      return true;
-  }
-  return false;
+  auto it = remote_streams_by_id_.find(stream_id);
+  return it == remote_streams_by_id_.end() ? nullptr : it->second;
+}
+bool ConferenceInfo::ParticipantPresent(const std::string& participant_id) {
+  return FindParticipant(participant_id) != nullptr;
+}
+bool ConferenceInfo::RemoteStreamPresent(const std::string& stream_id) {
+  return FindRemoteStream(stream_id) != nullptr;
 }
 void ConferenceInfo::TriggerOnParticipantLeft(
     const std::string& participant_id) {
-  const std::lock_guard<std::mutex> lock(participants_mutex_);
-  for (auto& it : participants_) {
-    if (it->Id() == participant_id) {
-      it->TriggerOnParticipantLeft();
-      break;
-    }
-  }
+  auto participant = FindParticipant(participant_id);
+  if (participant)
+    participant->TriggerOnParticipantLeft();
 }
 void ConferenceInfo::TriggerOnStreamEnded(const std::string& stream_id) {
-  for (auto& it : remote_streams_) {
-    if (it->Id() == stream_id) {
-      it->TriggerOnStreamEnded();
-      break;
-    }
-  }
+  auto stream = FindRemoteStream(stream_id);
+  if (stream)
+    stream->TriggerOnStreamEnded();
 }
 void ConferenceInfo::TriggerOnStreamUpdated(const std::string& stream_id) {
-  for (auto& it : remote_streams_) {
-    if (it->Id() == stream_id) {
-      it->TriggerOnStreamUpdated();
-      break;
-    }
-  }
+  auto stream = FindRemoteStream(stream_id);
+  if (stream)
+    stream->TriggerOnStreamUpdated();
 }
 void ConferenceInfo::TriggerOnStreamMuteOrUnmute(
     const std::string& stream_id,
     owt::base::TrackKind track_kind,
     bool muted) {
-  for (auto& it : remote_streams_) {
-    if (it->Id() == stream_id) {
-      if (muted) {
-        it->TriggerOnStreamMute(track_kind);
-      } else {
-        it->TriggerOnStreamUnmute(track_kind);
-      }
-      break;
-    }
+  auto stream = FindRemoteStream(stream_id);
+  if (!stream)
+    return;
+  if (muted) {
+    stream->TriggerOnStreamMute(track_kind);
+  } else {
+    stream->TriggerOnStreamUnmute(track_kind);
   }
 }
 
+void ConferenceInfo::EnqueueEntry(std::function<void()> entry) {
+  const std::lock_guard<std::mutex> lock(pending_entries_mutex_);
+  pending_entries_.push_back(entry);
+}
+void ConferenceInfo::RunOrEnqueueEntry(std::function<void()> entry) {
+  {
+    const std::lock_guard<std::mutex> lock(pending_entries_mutex_);
+    bool run_now =
+        pending_entries_.empty() && draining_thread_ == std::thread::id();
+    pending_entries_.push_back(entry);
+    if (!run_now)
+      return;
+  }
+  // Entries enqueued by other threads meanwhile are run here as well.
+  RunPendingEntries(std::numeric_limits<size_t>::max(), false);
+}
+bool ConferenceInfo::ProcessPendingEntries(size_t max_entries) const {
+  return RunPendingEntries(max_entries, false);
+}
+void ConferenceInfo::FlushPendingEntries() const {
+  RunPendingEntries(std::numeric_limits<size_t>::max(), true);
+}
+bool ConferenceInfo::RunPendingEntries(size_t max_entries, bool wait) const {
+  std::unique_lock<std::mutex> lock(pending_entries_mutex_);
+  const std::thread::id current_thread = std::this_thread::get_id();
+  // Called by an entry, e.g. an observer accessing remote streams.
+  if (draining_thread_ == current_thread)
+    return !pending_entries_.empty();
+  if (draining_thread_ != std::thread::id()) {
+    // The other thread runs all entries, including the ones enqueued while it
+    // is running. Reporting them as left would make the caller retry
+    // immediately.
+    if (!wait)
+      return false;
+    pending_entries_cv_.wait(
+        lock, [this] { return draining_thread_ == std::thread::id(); });
+  }
+  draining_thread_ = current_thread;
+  for (size_t i = 0; i < max_entries && !pending_entries_.empty(); i++) {
+    auto entry = std::move(pending_entries_.front());
+    pending_entries_.pop_front();
+    lock.unlock();
+    entry();
+    lock.lock();
+  }
+  draining_thread_ = std::thread::id();
+  bool has_pending_entries = !pending_entries_.empty();
+  lock.unlock();
+  pending_entries_cv_.notify_all();
+  return has_pending_entries;
+}
+void ConferenceInfo::ClearPendingEntries() {
+  std::deque<std::function<void()>> entries;
+  {
+    const std::lock_guard<std::mutex> lock(pending_entries_mutex_);
+    entries.swap(pending_entries_);
+  }
+  // Entries are destroyed without holding the lock since they may hold the
+  // last reference to objects accessing this one.
+}
+
 enum ConferenceClient::StreamType : int {
   kStreamTypeCamera = 1,
   kStreamTypeScreen,
   kStreamTypeMix,
   kStreamTypeData,
 };
+// Number of room snapshot entries parsed in each task on event queue.
+static const size_t kRoomSnapshotBatchSize = 32;
 const std::string play_pause_failure_message =
     "Cannot play/pause a stream that have not been published or subscribed.";
+// Action of stream/subscription control message for |track_kind|.
+static std::string TrackKindToControlAction(TrackKind track_kind) {
+  switch (track_kind) {
+    case TrackKind::kAudio:
+      return "audio";
+    case TrackKind::kVideo:
+      return "video";
+    default:
+      return "av";
+  }
+}
+// Reorder SDP of a subscription according to preference list in |options|.
+static void AddSubscribeCodecPreferences(
+    const SubscribeOptions& options,
+    PeerConnectionChannelConfiguration& config) {
+  for (auto codec : options.video.codecs) {
+    config.video.push_back(VideoEncodingParameters(codec, 0, false));
+  }
+  for (auto codec : options.audio.codecs) {
+    config.audio.push_back(AudioEncodingParameters(codec, 0));
+  }
+}
+// Move channels in |pending| which have been assigned a session ID by server
+// to |indexed|. Caller should hold the lock protecting both containers.
+static void IndexChannelsBySessionId(
+    std::vector<std::shared_ptr<ConferencePeerConnectionChannel>>& pending,
+    std::unordered_map<std::string,
+                       std::shared_ptr<ConferencePeerConnectionChannel>>&
+        indexed) {
+  auto it = pending.begin();
+  while (it != pending.end()) {
+    std::string session_id = (*it)->GetSessionId();
+    if (session_id.empty()) {
+      ++it;
+      continue;
+    }
+    indexed[session_id] = *it;
+    it = pending.erase(it);
+  }
+}
 std::shared_ptr<ConferenceClient> ConferenceClient::Create(
     const ConferenceClientConfiguration& configuration) {
   return std::shared_ptr<ConferenceClient>(new ConferenceClient(configuration));
@@ -178,13 +263,21 @@ ConferenceClient::ConferenceClient(
     const ConferenceClientConfiguration& configuration)
     : configuration_(configuration),
       signaling_channel_(new ConferenceSocketSignalingChannel()),
-      signaling_channel_connected_(false) {
-  auto task_queue_factory_ = webrtc::CreateDefaultTaskQueueFactory();
-  event_queue_ =
-      std::make_unique<rtc::TaskQueue>(task_queue_factory_->CreateTaskQueue(
-          "ConferenceClientEventQueue",
-          webrtc::TaskQueueFactory::Priority::NORMAL));
+      signaling_channel_connected_(false),
+      pool_refresh_timer_(TimerService::kInvalidTimerId) {
+  event_queue_ = CreateCallbackQueue(configuration.callback_executor,
+                                     "ConferenceClientEventQueue");
+  if (configuration_.peer_connection_pool_size > 0 &&
+      configuration_.peer_connection_pool_ttl <= 0) {
+    RTC_LOG(LS_WARNING) << "Invalid PeerConnection pool TTL "
+                        << configuration_.peer_connection_pool_ttl
+                        << ", PeerConnection pool is disabled.";
+    configuration_.peer_connection_pool_size = 0;
+  }
   signaling_channel_->AddObserver(*this);
+  signaling_channel_->SetRequestTimeouts(
+      configuration.signaling_request_timeout,
+      configuration.signaling_request_timeouts);
 #ifdef OWT_ENABLE_QUIC
   // Quic transport client will be created when we join the meeting.
   web_transport_channel_connected_ = false;
@@ -196,51 +289,20 @@ ConferenceClient::~ConferenceClient() {
 }
 
 void ConferenceClient::AddObserver(ConferenceClientObserver& observer) {
-  const std::lock_guard<std::mutex> lock(observer_mutex_);
-  std::vector<std::reference_wrapper<ConferenceClientObserver>>::iterator it =
-      std::find_if(
-          observers_.begin(), observers_.end(),
-          [&](std::reference_wrapper<ConferenceClientObserver> o) -> bool {
-            return &observer == &(o.get());
-          });
-  if (it != observers_.end()) {
+  if (!observers_.Add(observer))
     RTC_LOG(LS_INFO) << "Adding duplicate observer.";
-    return;
-  }
-  observers_.push_back(observer);
 }
 void ConferenceClient::RemoveObserver(ConferenceClientObserver& observer) {
-  const std::lock_guard<std::mutex> lock(observer_mutex_);
-  observers_.erase(std::find_if(
-      observers_.begin(), observers_.end(),
-      [&](std::reference_wrapper<ConferenceClientObserver> o) -> bool {
-        return &observer == &(o.get());
-      }));
+  observers_.Remove(observer);
 }
 void ConferenceClient::AddStreamUpdateObserver(
     ConferenceStreamUpdateObserver& observer) {
-  const std::lock_guard<std::mutex> lock(stream_update_observer_mutex_);
-  std::vector<std::reference_wrapper<ConferenceStreamUpdateObserver>>::iterator
-      it = std::find_if(
-          stream_update_observers_.begin(), stream_update_observers_.end(),
-          [&](std::reference_wrapper<ConferenceStreamUpdateObserver> o)
-              -> bool { return &observer == &(o.get()); });
-  if (it != stream_update_observers_.end()) {
+  if (!stream_update_observers_.Add(observer))
     RTC_LOG(LS_INFO) << "Adding duplicate observer.";
-    return;
-  }
-  stream_update_observers_.push_back(observer);
 }
 void ConferenceClient::RemoveStreamUpdateObserver(
     ConferenceStreamUpdateObserver& observer) {
-  const std::lock_guard<std::mutex> lock(stream_update_observer_mutex_);
-  auto it = std::find_if(
-      stream_update_observers_.begin(), stream_update_observers_.end(),
-      [&](std::reference_wrapper<ConferenceStreamUpdateObserver> o) -> bool {
-        return &observer == &(o.get());
-      });
-  if (it != stream_update_observers_.end())
-    stream_update_observers_.erase(it);
+  stream_update_observers_.Remove(observer);
 }
 
 #ifdef OWT_ENABLE_QUIC
@@ -384,6 +446,7 @@ void ConferenceClient::Join(
     token_base64 = rtc::Base64::Encode(token);
   }
 
+  std::weak_ptr<ConferenceClient> weak_this = shared_from_this();
   signaling_channel_->Connect(
       token_base64,
       [=](sio::message::ptr info) {
@@ -411,6 +474,7 @@ void ConferenceClient::Join(
           role = info->get_map()["role"]->get_string();
           const std::lock_guard<std::mutex> lock(conference_info_mutex_);
           if (current_conference_info_.get()) {
+            current_conference_info_->ClearPendingEntries();
             current_conference_info_.reset();
           }
           current_conference_info_.reset(new ConferenceInfo);
@@ -431,30 +495,37 @@ void ConferenceClient::Join(
           current_conference_info_->id_ =
               room_info->get_map()["id"]->get_string();
         }
-        // Trigger OnUserJoin for existed users, and also fill in the
-        // ConferenceInfo.
+        // Existing users and remote streams are not parsed here. They are
+        // queued in the ConferenceInfo and parsed in batches after joining,
+        // or when they are accessed for the first time.
         if (room_info->get_map()["participants"]->get_flag() !=
             sio::message::flag_array) {
           RTC_LOG(LS_WARNING) << "Room info doesn't contain valid users.";
         } else {
-          auto users = room_info->get_map()["participants"]->get_vector();
-          // Make sure |on_success| is triggered before any other events because
-          // OnUserJoined and OnStreamAdded should be triggered after join a
-          // conference.
+          auto& users = room_info->get_map()["participants"]->get_vector();
           for (auto it = users.begin(); it != users.end(); ++it) {
-            TriggerOnUserJoined(*it, true);
+            sio::message::ptr user = *it;
+            current_conference_info_->EnqueueEntry([weak_this, user] {
+              auto that = weak_this.lock();
+              if (that)
+                that->TriggerOnUserJoined(user, true);
+            });
           }
         }
-        // Trigger OnStreamAdded for existed remote streams, and also fill in
-        // the ConferenceInfo.
         if (room_info->get_map()["streams"]->get_flag() !=
             sio::message::flag_array) {
           RTC_LOG(LS_WARNING) << "Room info doesn't contain valid streams.";
         } else {
-          auto streams = room_info->get_map()["streams"]->get_vector();
+          auto& streams = room_info->get_map()["streams"]->get_vector();
+          RTC_LOG(LS_INFO) << "Find " << streams.size()
+                           << " streams in the conference.";
           for (auto it = streams.begin(); it != streams.end(); ++it) {
-            RTC_LOG(LS_INFO) << "Find streams in the conference.";
-            TriggerOnStreamAdded(*it, true);
+            sio::message::ptr stream = *it;
+            current_conference_info_->EnqueueEntry([weak_this, stream] {
+              auto that = weak_this.lock();
+              if (that)
+                that->TriggerOnStreamAdded(stream, true);
+            });
           }
         }
 #ifdef OWT_ENABLE_QUIC
@@ -479,9 +550,54 @@ void ConferenceClient::Join(
           event_queue_->PostTask(
               [on_success, this]() { on_success(current_conference_info_); });
         }
+        ParseRoomSnapshotInBatches(current_conference_info_);
+        RefillPeerConnectionPool();
       },
       on_failure);
 }
+void ConferenceClient::ParseRoomSnapshotInBatches(
+    std::shared_ptr<ConferenceInfo> conference_info) {
+  std::weak_ptr<ConferenceClient> weak_this = shared_from_this();
+  event_queue_->PostTask([weak_this, conference_info] {
+    auto that = weak_this.lock();
+    if (!that)
+      return;
+    {
+      const std::lock_guard<std::mutex> lock(that->conference_info_mutex_);
+      if (that->current_conference_info_ != conference_info)
+        return;
+    }
+    if (conference_info->ProcessPendingEntries(kRoomSnapshotBatchSize))
+      that->ParseRoomSnapshotInBatches(conference_info);
+  });
+}
+void ConferenceClient::ClearPendingRoomEntries() {
+  std::shared_ptr<ConferenceInfo> conference_info;
+  {
+    const std::lock_guard<std::mutex> lock(conference_info_mutex_);
+    conference_info = current_conference_info_;
+  }
+  if (conference_info)
+    conference_info->ClearPendingEntries();
+}
+void ConferenceClient::RunInRoomEventOrder(
+    std::function<void(ConferenceClient&)> task) {
+  std::shared_ptr<ConferenceInfo> conference_info;
+  {
+    const std::lock_guard<std::mutex> lock(conference_info_mutex_);
+    conference_info = current_conference_info_;
+  }
+  if (!conference_info) {
+    task(*this);
+    return;
+  }
+  std::weak_ptr<ConferenceClient> weak_this = shared_from_this();
+  conference_info->RunOrEnqueueEntry([weak_this, task] {
+    auto that = weak_this.lock();
+    if (that)
+      task(*that);
+  });
+}
 
 #ifdef OWT_ENABLE_QUIC
 static  void ConvertUUID(const char* src_ptr, uint8_t* dest) {
@@ -607,13 +723,12 @@ void ConferenceClient::Publish(
   for (auto codec : options.audio) {
     config.audio.push_back(AudioEncodingParameters(codec));
   }
-  std::shared_ptr<ConferencePeerConnectionChannel> pcc(
-      new ConferencePeerConnectionChannel(config, signaling_channel_,
-                                          event_queue_));
+  std::shared_ptr<ConferencePeerConnectionChannel> pcc =
+      CreatePeerConnectionChannel(config);
   pcc->AddObserver(*this);
   {
     std::lock_guard<std::mutex> lock(publish_pcs_mutex_);
-    publish_pcs_.push_back(pcc);
+    pending_publish_pcs_.push_back(pcc);
   }
   std::weak_ptr<ConferenceClient> weak_this = shared_from_this();
   std::string stream_id = stream->Id();
@@ -702,10 +817,8 @@ void ConferenceClient::Subscribe(
     RTC_LOG(LS_ERROR) << "Remote stream cannot be nullptr.";
     return;
   }
-  if (added_stream_type_.find(stream->Id()) == added_stream_type_.end()) {
-    std::string failure_message(
-        "Subscribing an invalid stream. Please check whether this stream is "
-        "removed.");
+  std::string failure_message;
+  if (!ReserveSubscription(stream, options, failure_message)) {
     if (on_failure != nullptr) {
       event_queue_->PostTask([on_failure, failure_message]() {
         std::unique_ptr<Exception> e(
@@ -715,74 +828,151 @@ void ConferenceClient::Subscribe(
     }
     return;
   }
-  if (options.video.disabled && options.audio.disabled) {
-    std::string failure_message(
-        "Subscribing with both audio and video disabled is not allowed.");
-    if (on_failure != nullptr) {
-      event_queue_->PostTask([on_failure, failure_message]() {
-        std::unique_ptr<Exception> e(
-            new Exception(ExceptionType::kConferenceUnknown, failure_message));
-        on_failure(std::move(e));
-      });
+  PeerConnectionChannelConfiguration config =
+      GetPeerConnectionChannelConfiguration();
+  AddSubscribeCodecPreferences(options, config);
+  std::weak_ptr<ConferenceClient> weak_this = shared_from_this();
+  std::string stream_id = stream->Id();
+  auto subscribe_success = [on_success, weak_this,
+                            stream_id](std::string session_id) {
+    auto that = weak_this.lock();
+    if (!that)
+      return;
+    // map current pcc
+    if (on_success != nullptr) {
+      std::shared_ptr<ConferenceSubscription> cp(
+          new ConferenceSubscription(that, session_id, stream_id));
+      on_success(cp);
     }
+  };
+  if (configuration_.multiplex_subscriptions) {
+    GetMultiplexedSubscribeChannel(config)->AddSubscription(
+        stream, options, subscribe_success, on_failure);
     return;
   }
-  // Avoid subscribing the same stream twice.
+  std::shared_ptr<ConferencePeerConnectionChannel> pcc =
+      CreatePeerConnectionChannel(config);
+  pcc->AddObserver(*this);
   {
     std::lock_guard<std::mutex> lock(subscribe_pcs_mutex_);
-    // Search subscirbe pcs
-    auto it = std::find_if(
-        subscribe_pcs_.begin(), subscribe_pcs_.end(),
-        [&](std::shared_ptr<ConferencePeerConnectionChannel> o) -> bool {
-          return o->GetSubStreamId() == stream->Id();
-        });
-    if (it != subscribe_pcs_.end()) {
-      std::string failure_message(
-          "The same remote stream has already been subscribed. Subcribe after "
-          "it is unsubscribed");
-      if (on_failure != nullptr) {
-        event_queue_->PostTask([on_failure, failure_message]() {
-          std::unique_ptr<Exception> e(new Exception(
-              ExceptionType::kConferenceUnknown, failure_message));
-          on_failure(std::move(e));
-        });
-      }
-      return;
+    pending_subscribe_pcs_.push_back(pcc);
+  }
+  pcc->Subscribe(stream, options, subscribe_success, on_failure);
+}
+void ConferenceClient::Subscribe(
+    const std::vector<std::pair<std::shared_ptr<RemoteStream>,
+                                SubscribeOptions>>& streams,
+    std::function<void(std::vector<SubscribeResult>)> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  if (!CheckSignalingChannelOnline(on_failure)) {
+    return;
+  }
+  if (streams.empty()) {
+    if (on_success != nullptr) {
+      event_queue_->PostTask(
+          [on_success]() { on_success(std::vector<SubscribeResult>()); });
     }
+    return;
   }
-  // Reorder SDP according to perference list.
-  PeerConnectionChannelConfiguration config =
+  // Results of subscriptions in this batch. Shared by callbacks of all
+  // subscriptions, the last completed one reports the results.
+  struct BatchSubscribeResults {
+    std::mutex mutex;
+    size_t pending_count;
+    std::vector<SubscribeResult> results;
+  };
+  auto batch = std::make_shared<BatchSubscribeResults>();
+  batch->pending_count = streams.size();
+  batch->results.resize(streams.size());
+  auto complete = [batch, on_success](
+                      size_t index,
+                      std::shared_ptr<ConferenceSubscription> subscription,
+                      std::shared_ptr<Exception> error) {
+    {
+      std::lock_guard<std::mutex> lock(batch->mutex);
+      batch->results[index].subscription = subscription;
+      batch->results[index].error = error;
+      if (--batch->pending_count > 0)
+        return;
+    }
+    if (on_success != nullptr)
+      on_success(batch->results);
+  };
+  std::weak_ptr<ConferenceClient> weak_this = shared_from_this();
+  std::vector<ConferencePeerConnectionChannel::SubscriptionRequest>
+      multiplexed_requests;
+  PeerConnectionChannelConfiguration multiplexed_config =
       GetPeerConnectionChannelConfiguration();
-  for (auto codec : options.video.codecs) {
-    config.video.push_back(VideoEncodingParameters(codec, 0, false));
-  }
-  for (auto codec : options.audio.codecs) {
-    config.audio.push_back(AudioEncodingParameters(codec, 0));
+  for (size_t i = 0; i < streams.size(); i++) {
+    auto& stream = streams[i].first;
+    auto& options = streams[i].second;
+    std::function<void(std::unique_ptr<Exception>)> subscribe_failure =
+        [complete, i](std::unique_ptr<Exception> e) {
+          complete(i, nullptr, std::shared_ptr<Exception>(std::move(e)));
+        };
+#ifdef OWT_ENABLE_QUIC
+    if (stream && stream->DataEnabled()) {
+      Subscribe(stream, options,
+                [complete, i](std::shared_ptr<ConferenceSubscription> cs) {
+                  complete(i, cs, nullptr);
+                },
+                subscribe_failure);
+      continue;
+    }
+#endif
+    std::string failure_message;
+    if (!stream) {
+      failure_message = "Remote stream cannot be nullptr.";
+    } else {
+      ReserveSubscription(stream, options, failure_message);
+    }
+    if (!failure_message.empty()) {
+      event_queue_->PostTask([subscribe_failure, failure_message]() {
+        std::unique_ptr<Exception> e(
+            new Exception(ExceptionType::kConferenceUnknown, failure_message));
+        subscribe_failure(std::move(e));
+      });
+      continue;
+    }
+    std::string stream_id = stream->Id();
+    auto subscribe_success = [complete, i, weak_this,
+                              stream_id](std::string session_id) {
+      auto that = weak_this.lock();
+      if (!that)
+        return;
+      std::shared_ptr<ConferenceSubscription> cp(
+          new ConferenceSubscription(that, session_id, stream_id));
+      complete(i, cp, nullptr);
+    };
+    if (configuration_.multiplex_subscriptions) {
+      if (multiplexed_requests.empty()) {
+        // Only used if the shared PeerConnection is not created yet.
+        AddSubscribeCodecPreferences(options, multiplexed_config);
+      }
+      ConferencePeerConnectionChannel::SubscriptionRequest request;
+      request.stream = stream;
+      request.options = options;
+      request.on_success = subscribe_success;
+      request.on_failure = subscribe_failure;
+      multiplexed_requests.push_back(request);
+      continue;
+    }
+    PeerConnectionChannelConfiguration config =
+        GetPeerConnectionChannelConfiguration();
+    AddSubscribeCodecPreferences(options, config);
+    std::shared_ptr<ConferencePeerConnectionChannel> pcc =
+        CreatePeerConnectionChannel(config);
+    pcc->AddObserver(*this);
+    {
+      std::lock_guard<std::mutex> lock(subscribe_pcs_mutex_);
+      pending_subscribe_pcs_.push_back(pcc);
+    }
+    pcc->Subscribe(stream, options, subscribe_success, subscribe_failure);
   }
-  std::shared_ptr<ConferencePeerConnectionChannel> pcc(
-      new ConferencePeerConnectionChannel(config, signaling_channel_,
-                                          event_queue_));
-  pcc->AddObserver(*this);
-  {
-    std::lock_guard<std::mutex> lock(subscribe_pcs_mutex_);
-    subscribe_pcs_.push_back(pcc);
+  if (!multiplexed_requests.empty()) {
+    GetMultiplexedSubscribeChannel(multiplexed_config)
+        ->AddSubscriptions(multiplexed_requests);
   }
-  std::weak_ptr<ConferenceClient> weak_this = shared_from_this();
-  std::string stream_id = stream->Id();
-  pcc->Subscribe(
-      stream, options,
-      [on_success, weak_this, stream_id](std::string session_id) {
-        auto that = weak_this.lock();
-        if (!that)
-          return;
-        // map current pcc
-        if (on_success != nullptr) {
-          std::shared_ptr<ConferenceSubscription> cp(
-              new ConferenceSubscription(that, session_id, stream_id));
-          on_success(cp);
-        }
-      },
-      on_failure);
 }
 void ConferenceClient::UnPublish(
     const std::string& session_id,
@@ -821,14 +1011,7 @@ void ConferenceClient::UnPublish(
                      event_queue_->PostTask([on_success]() { on_success(); });
                    {
                      std::lock_guard<std::mutex> lock(publish_pcs_mutex_);
-                     auto it = publish_pcs_.begin();
-                     while (it != publish_pcs_.end()) {
-                       if ((*it)->GetSessionId() == session_id) {
-                         publish_pcs_.erase(it);
-                         break;
-                       }
-                       ++it;
-                     }
+                     publish_pcs_.erase(session_id);
                    }
                  },
                  on_failure);
@@ -863,20 +1046,15 @@ void ConferenceClient::UnSubscribe(
     }
     return;
   }
+  std::string sub_stream_id = pcc->GetSubStreamId(session_id);
   pcc->Unsubscribe(session_id,
                    [=]() {
                      if (on_success != nullptr)
                        event_queue_->PostTask([on_success]() { on_success(); });
                      {
                        std::lock_guard<std::mutex> lock(subscribe_pcs_mutex_);
-                       auto it = subscribe_pcs_.begin();
-                       while (it != subscribe_pcs_.end()) {
-                         if ((*it)->GetSessionId() == session_id) {
-                           subscribe_pcs_.erase(it);
-                           break;
-                         }
-                         ++it;
-                       }
+                       subscribe_pcs_.erase(session_id);
+                       subscribed_stream_ids_.erase(sub_stream_id);
                        subscribe_id_label_map_.erase(session_id);
                      }
                    },
@@ -980,6 +1158,13 @@ void ConferenceClient::Mute(
     }
     return;
   }
+  if (pcc->IsMultiplexed()) {
+    // Channel's own session ID is the shared transport's ID.
+    signaling_channel_->SendSubscriptionControlMessage(
+        session_id, TrackKindToControlAction(track_kind), "pause",
+        RunInEventQueue(on_success), on_failure);
+    return;
+  }
   switch (track_kind) {
     case TrackKind::kAudio:
       pcc->PauseAudio(on_success, on_failure);
@@ -1016,6 +1201,12 @@ void ConferenceClient::Unmute(
     }
     return;
   }
+  if (pcc->IsMultiplexed()) {
+    signaling_channel_->SendSubscriptionControlMessage(
+        session_id, TrackKindToControlAction(track_kind), "play",
+        RunInEventQueue(on_success), on_failure);
+    return;
+  }
   switch (track_kind) {
     case TrackKind::kAudio:
       pcc->PlayAudio(on_success, on_failure);
@@ -1033,18 +1224,18 @@ void ConferenceClient::Unmute(
 void ConferenceClient::Leave(
     std::function<void()> on_success,
     std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  Leave(on_success, on_failure, nullptr);
+}
+void ConferenceClient::Leave(
+    std::function<void()> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure,
+    std::function<void()> on_released) {
   if (!CheckSignalingChannelOnline(on_failure)) {
     return;
   }
-  {
-    std::lock_guard<std::mutex> lock(publish_pcs_mutex_);
-    publish_id_label_map_.clear();
-    publish_pcs_.clear();
-  }
-  {
-    std::lock_guard<std::mutex> lock(subscribe_pcs_mutex_);
-    subscribe_pcs_.clear();
-  }
+  ClearPendingRoomEntries();
+  std::vector<std::shared_ptr<ConferencePeerConnectionChannel>> pccs =
+      TakePeerConnectionChannels();
 #ifdef OWT_ENABLE_QUIC
   {
     // Do not hold the lock of quic_publications_ as only Stop
@@ -1061,7 +1252,10 @@ void ConferenceClient::Leave(
     quic_subscriptions_.clear();
   }
 #endif
+  // MCU releases all sessions of a participant when it leaves, so leave is
+  // sent first, and channels are closed without notifying MCU one by one.
   signaling_channel_->Disconnect(RunInEventQueue(on_success), on_failure);
+  ClosePeerConnectionChannels(std::move(pccs), on_released);
 }
 void ConferenceClient::GetConnectionStats(
     const std::string& session_id,
@@ -1105,6 +1299,34 @@ void ConferenceClient::GetConnectionStats(
   pcc->GetConnectionStats(on_success, on_failure);
 }
 
+void ConferenceClient::UpdateEncodingParameters(
+    const std::string& session_id,
+    const std::vector<RtpEncodingParameters>& parameters,
+    std::function<void()> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  auto pcc = GetConferencePeerConnectionChannel(session_id);
+  if (pcc == nullptr) {
+    if (on_failure) {
+      event_queue_->PostTask([on_failure]() {
+        std::unique_ptr<Exception> e(
+            new Exception(ExceptionType::kConferenceUnknown,
+                          "Stream is not published."));
+        on_failure(std::move(e));
+      });
+    }
+    RTC_LOG(LS_WARNING)
+        << "Tried to update encoding parameters of unknown stream.";
+    return;
+  }
+  pcc->UpdateEncodingParameters(parameters, on_success, on_failure);
+}
+SignalingRequestStats ConferenceClient::GetSignalingRequestStats() const {
+  return signaling_channel_->GetRequestStats();
+}
+SignalingAckCallbackStats ConferenceClient::GetSignalingAckCallbackStats()
+    const {
+  return signaling_channel_->GetAckCallbackStats();
+}
 void ConferenceClient::GetStats(
     const std::string& session_id,
     std::function<void(const std::vector<const webrtc::StatsReport*>& reports)>
@@ -1127,15 +1349,17 @@ void ConferenceClient::GetStats(
   pcc->GetStats(on_success, on_failure);
 }
 void ConferenceClient::OnStreamAdded(sio::message::ptr stream) {
-  TriggerOnStreamAdded(stream);
+  RunInRoomEventOrder([stream](ConferenceClient& client) {
+    client.TriggerOnStreamAdded(stream);
+  });
 }
 void ConferenceClient::OnCustomMessage(std::string& from,
                                        std::string& message,
                                        std::string& to) {
   RTC_LOG(LS_INFO) << "ConferenceClient OnCustomMessage";
-  for (auto its = observers_.begin(); its != observers_.end(); ++its) {
-    (*its).get().OnMessageReceived(message, from, to);
-  }
+  observers_.ForEach([&](ConferenceClientObserver& o) {
+    o.OnMessageReceived(message, from, to);
+  });
 }
 void ConferenceClient::OnSignalingMessage(sio::message::ptr message) {
   // v1.2 may return SessionProgress which is  {id: SessionId, status: "ready|error"}.
@@ -1160,6 +1384,18 @@ void ConferenceClient::OnSignalingMessage(sio::message::ptr message) {
     RTC_LOG(LS_WARNING) << "Received signaling message from unknown sender.";
     return;
   }
+  if (pcc->IsMultiplexed() && soac_status->get_string() != "soac") {
+    // Progress of a subscription carried by the shared transport.
+    auto session_id_obj = message->get_map()["sessionId"];
+    std::string session_id =
+        (session_id_obj != nullptr &&
+         session_id_obj->get_flag() == sio::message::flag_string)
+            ? session_id_obj->get_string()
+            : stream_id;
+    pcc->OnSubscriptionProgress(session_id,
+                                soac_status->get_string() == "ready");
+    return;
+  }
   if (soac_status->get_string() == "ready") {
     sio::message::ptr success_msg = sio::string_message::create("success");
     pcc->OnSignalingMessage(success_msg);
@@ -1181,10 +1417,14 @@ void ConferenceClient::OnSignalingMessage(sio::message::ptr message) {
 }
 void ConferenceClient::OnStreamRemoved(sio::message::ptr stream) {
   RTC_LOG(LS_INFO) << "Stream removed.";
-  TriggerOnStreamRemoved(stream);
+  RunInRoomEventOrder([stream](ConferenceClient& client) {
+    client.TriggerOnStreamRemoved(stream);
+  });
 }
 void ConferenceClient::OnStreamUpdated(sio::message::ptr stream) {
-  TriggerOnStreamUpdated(stream);
+  RunInRoomEventOrder([stream](ConferenceClient& client) {
+    client.TriggerOnStreamUpdated(stream);
+  });
 }
 // ConferencePeerConnectionChannel observer implemenation.
 void ConferenceClient::OnStreamError(sio::message::ptr stream) {
@@ -1206,25 +1446,34 @@ void ConferenceClient::OnStreamError(sio::message::ptr stream) {
 }
 void ConferenceClient::OnServerDisconnected() {
   signaling_channel_connected_ = false;
-  {
-    std::lock_guard<std::mutex> lock(publish_pcs_mutex_);
-    publish_id_label_map_.clear();
-    publish_pcs_.clear();
-  }
+  ClearPendingRoomEntries();
+  std::vector<std::shared_ptr<ConferencePeerConnectionChannel>> pccs =
+      TakePeerConnectionChannels();
   {
     std::lock_guard<std::mutex> lock(subscribe_pcs_mutex_);
-    subscribe_pcs_.clear();
     subscribe_id_label_map_.clear();
   }
-  for (auto its = observers_.begin(); its != observers_.end(); ++its) {
-    (*its).get().OnServerDisconnected();
-  }
+  std::weak_ptr<ConferenceClient> weak_this = shared_from_this();
+  ClosePeerConnectionChannels(std::move(pccs), [weak_this] {
+    auto that = weak_this.lock();
+    if (!that)
+      return;
+    that->observers_.ForEach(
+        [](ConferenceClientObserver& o) { o.OnServerDisconnected(); });
+  });
 }
 void ConferenceClient::OnStreamError(
     std::shared_ptr<Stream> stream,
     std::shared_ptr<const Exception> exception) {
   TriggerOnStreamError(stream, exception);
 }
+void ConferenceClient::OnConnectionRecovered(const std::string& session_id,
+                                             int64_t freeze_duration_ms) {
+  PostToObservers(
+      [session_id, freeze_duration_ms](ConferenceClientObserver& o) {
+        o.OnConnectionRecovered(session_id, freeze_duration_ms);
+      });
+}
 void ConferenceClient::OnStreamId(const std::string& id,
                                   const std::string& publish_stream_label) {
   {
@@ -1597,17 +1846,18 @@ void ConferenceClient::ParseStreamInfo(sio::message::ptr stream_info,
       remote_stream->has_audio_ = false;
       remote_stream->has_video_ = false;
       remote_stream->has_data_ = true;
-      added_streams_[id] = remote_stream;
-      added_stream_type_[id] = StreamType::kStreamTypeData;
       {
-        const std::lock_guard<std::mutex> lock(stream_update_observer_mutex_);
+        const std::lock_guard<std::mutex> lock(added_streams_mutex_);
+        added_streams_[id] = remote_stream;
+        added_stream_type_[id] = StreamType::kStreamTypeData;
+      }
+      {
+        const std::lock_guard<std::mutex> lock(stream_added_mutex_);
         current_conference_info_->AddOrUpdateStream(remote_stream, updated);
         if (!joining && !updated) {
-          for (auto its = observers_.begin(); its != observers_.end(); ++its) {
-            auto& o = (*its).get();
-            event_queue_->PostTask(
-                [&o, remote_stream] { o.OnStreamAdded(remote_stream); });
-          }
+          PostToObservers([remote_stream](ConferenceClientObserver& o) {
+            o.OnStreamAdded(remote_stream);
+          });
         }
       }
     } else {
@@ -1629,18 +1879,18 @@ void ConferenceClient::ParseStreamInfo(sio::message::ptr stream_info,
         remote_stream->Attributes(attributes);
         remote_stream->source_.audio = audio_source_info;
         remote_stream->source_.video = video_source_info;
-        added_streams_[id] = remote_stream;
-        added_stream_type_[id] = StreamType::kStreamTypeCamera;
         {
-          const std::lock_guard<std::mutex> lock(stream_update_observer_mutex_);
+          const std::lock_guard<std::mutex> lock(added_streams_mutex_);
+          added_streams_[id] = remote_stream;
+          added_stream_type_[id] = StreamType::kStreamTypeCamera;
+        }
+        {
+          const std::lock_guard<std::mutex> lock(stream_added_mutex_);
           current_conference_info_->AddOrUpdateStream(remote_stream, updated);
           if (!joining && !updated) {
-            for (auto its = observers_.begin(); its != observers_.end();
-                 ++its) {
-              auto& o = (*its).get();
-              event_queue_->PostTask(
-                  [&o, remote_stream] { o.OnStreamAdded(remote_stream); });
-            }
+            PostToObservers([remote_stream](ConferenceClientObserver& o) {
+              o.OnStreamAdded(remote_stream);
+            });
           }
         }
       } else {
@@ -1652,18 +1902,18 @@ void ConferenceClient::ParseStreamInfo(sio::message::ptr stream_info,
         remote_stream->Attributes(attributes);
         remote_stream->source_.audio = audio_source_info;
         remote_stream->source_.video = video_source_info;
-        added_streams_[id] = remote_stream;
-        added_stream_type_[id] = StreamType::kStreamTypeScreen;
         {
-          const std::lock_guard<std::mutex> lock(stream_update_observer_mutex_);
+          const std::lock_guard<std::mutex> lock(added_streams_mutex_);
+          added_streams_[id] = remote_stream;
+          added_stream_type_[id] = StreamType::kStreamTypeScreen;
+        }
+        {
+          const std::lock_guard<std::mutex> lock(stream_added_mutex_);
           current_conference_info_->AddOrUpdateStream(remote_stream, updated);
           if (!joining && !updated) {
-            for (auto its = observers_.begin(); its != observers_.end();
-                 ++its) {
-              auto& o = (*its).get();
-              event_queue_->PostTask(
-                  [&o, remote_stream] { o.OnStreamAdded(remote_stream); });
-            }
+            PostToObservers([remote_stream](ConferenceClientObserver& o) {
+              o.OnStreamAdded(remote_stream);
+            });
           }
         }
       }
@@ -1678,17 +1928,18 @@ void ConferenceClient::ParseStreamInfo(sio::message::ptr stream_info,
     remote_stream->has_video_ = has_video;
     remote_stream->source_.audio = AudioSourceInfo::kMixed;
     remote_stream->source_.video = VideoSourceInfo::kMixed;
-    added_streams_[id] = remote_stream;
-    added_stream_type_[id] = StreamType::kStreamTypeMix;
     {
-      const std::lock_guard<std::mutex> lock(stream_update_observer_mutex_);
+      const std::lock_guard<std::mutex> lock(added_streams_mutex_);
+      added_streams_[id] = remote_stream;
+      added_stream_type_[id] = StreamType::kStreamTypeMix;
+    }
+    {
+      const std::lock_guard<std::mutex> lock(stream_added_mutex_);
       current_conference_info_->AddOrUpdateStream(remote_stream, updated);
       if (!joining) {
-        for (auto its = observers_.begin(); its != observers_.end(); ++its) {
-          auto& o = (*its).get();
-          event_queue_->PostTask(
-              [&o, remote_stream] { o.OnStreamAdded(remote_stream); });
-        }
+        PostToObservers([remote_stream](ConferenceClientObserver& o) {
+          o.OnStreamAdded(remote_stream);
+        });
       }
     }
   }
@@ -1704,11 +1955,9 @@ void ConferenceClient::TriggerOnUserJoined(sio::message::ptr user_info,
     std::shared_ptr<Participant> user(user_raw);
     current_conference_info_->AddParticipant(user);
     if (!joining) {
-      const std::lock_guard<std::mutex> lock(observer_mutex_);
-      for (auto its = observers_.begin(); its != observers_.end(); ++its) {
-        auto& o = (*its).get();
-        event_queue_->PostTask([&o, user] { o.OnParticipantJoined(user); });
-      }
+      PostToObservers([user](ConferenceClientObserver& o) {
+        o.OnParticipantJoined(user);
+      });
     }
   }
 }
@@ -1727,11 +1976,9 @@ void ConferenceClient::TriggerOnUserLeft(sio::message::ptr user_info) {
 void ConferenceClient::TriggerOnIncomingStream(
     const std::string& session_id,
                              owt::quic::WebTransportStreamInterface* stream) {
-  const std::lock_guard<std::mutex> lock(stream_update_observer_mutex_);
-  for (auto its = stream_update_observers_.begin();
-       its != stream_update_observers_.end(); ++its) {
-    (*its).get().OnIncomingStream(session_id, stream);
-  }
+  stream_update_observers_.ForEach([&](ConferenceStreamUpdateObserver& o) {
+    o.OnIncomingStream(session_id, stream);
+  });
 }
 #endif
 
@@ -1758,29 +2005,33 @@ bool ConferenceClient::ParseUser(sio::message::ptr user_message,
 }
 std::shared_ptr<ConferencePeerConnectionChannel>
 ConferenceClient::GetConferencePeerConnectionChannel(
-    const std::string& session_id) const {
+    const std::string& session_id) {
   {
     std::lock_guard<std::mutex> lock(subscribe_pcs_mutex_);
     // Search subscribe pcs.
-    auto it = std::find_if(
-        subscribe_pcs_.begin(), subscribe_pcs_.end(),
-        [&](std::shared_ptr<ConferencePeerConnectionChannel> o) -> bool {
-          return o->GetSessionId() == session_id;
-        });
+    auto it = subscribe_pcs_.find(session_id);
+    if (it == subscribe_pcs_.end() && !pending_subscribe_pcs_.empty()) {
+      IndexChannelsBySessionId(pending_subscribe_pcs_, subscribe_pcs_);
+      it = subscribe_pcs_.find(session_id);
+    }
     if (it != subscribe_pcs_.end()) {
-      return *it;
+      return it->second;
+    }
+    if (multiplexed_subscribe_pcc_ &&
+        multiplexed_subscribe_pcc_->HasSubscription(session_id)) {
+      return multiplexed_subscribe_pcc_;
     }
   }
   {
     std::lock_guard<std::mutex> lock(publish_pcs_mutex_);
     // Search publish pcs
-    auto it = std::find_if(
-        publish_pcs_.begin(), publish_pcs_.end(),
-        [&](std::shared_ptr<ConferencePeerConnectionChannel> o) -> bool {
-          return o->GetSessionId() == session_id;
-        });
+    auto it = publish_pcs_.find(session_id);
+    if (it == publish_pcs_.end() && !pending_publish_pcs_.empty()) {
+      IndexChannelsBySessionId(pending_publish_pcs_, publish_pcs_);
+      it = publish_pcs_.find(session_id);
+    }
     if (it != publish_pcs_.end()) {
-      return *it;
+      return it->second;
     }
   }
   RTC_LOG(LS_ERROR) << "Cannot find PeerConnectionChannel for specific session";
@@ -1808,41 +2059,259 @@ ConferenceClient::GetPeerConnectionChannelConfiguration() const {
                 kCandidateNetworkPolicyAll;
   config.continual_gathering_policy =
       webrtc::PeerConnectionInterface::ContinualGatheringPolicy::GATHER_CONTINUALLY;
+  config.bandwidth_estimate_cache_key = signaling_channel_->ServerHost();
   return config;
 }
+bool ConferenceClient::ReserveSubscription(
+    std::shared_ptr<RemoteStream> stream,
+    const SubscribeOptions& options,
+    std::string& failure_message) {
+  bool stream_added;
+  {
+    const std::lock_guard<std::mutex> lock(added_streams_mutex_);
+    stream_added =
+        added_stream_type_.find(stream->Id()) != added_stream_type_.end();
+  }
+  if (!stream_added) {
+    failure_message =
+        "Subscribing an invalid stream. Please check whether this stream is "
+        "removed.";
+    return false;
+  }
+  if (options.video.disabled && options.audio.disabled) {
+    failure_message =
+        "Subscribing with both audio and video disabled is not allowed.";
+    return false;
+  }
+  // Avoid subscribing the same stream twice.
+  std::lock_guard<std::mutex> lock(subscribe_pcs_mutex_);
+  if (subscribed_stream_ids_.find(stream->Id()) !=
+      subscribed_stream_ids_.end()) {
+    failure_message =
+        "The same remote stream has already been subscribed. Subcribe after "
+        "it is unsubscribed";
+    return false;
+  }
+  subscribed_stream_ids_.insert(stream->Id());
+  return true;
+}
+std::shared_ptr<ConferencePeerConnectionChannel>
+ConferenceClient::GetMultiplexedSubscribeChannel(
+    PeerConnectionChannelConfiguration& config) {
+  std::lock_guard<std::mutex> lock(subscribe_pcs_mutex_);
+  if (!multiplexed_subscribe_pcc_) {
+    // Codec preference of the first subscription applies to all
+    // subscriptions on the shared PeerConnection.
+    multiplexed_subscribe_pcc_.reset(new ConferencePeerConnectionChannel(
+        config, signaling_channel_, CreateSessionEventQueue(), true));
+    multiplexed_subscribe_pcc_->AddObserver(*this);
+    // Indexed by transport ID once it's known.
+    pending_subscribe_pcs_.push_back(multiplexed_subscribe_pcc_);
+  }
+  return multiplexed_subscribe_pcc_;
+}
+std::shared_ptr<ConferencePeerConnectionChannel>
+ConferenceClient::CreatePeerConnectionChannel(
+    PeerConnectionChannelConfiguration& config) {
+  std::shared_ptr<ConferencePeerConnectionChannel> pcc;
+  {
+    std::lock_guard<std::mutex> lock(pooled_pcs_mutex_);
+    auto ttl = std::chrono::seconds(configuration_.peer_connection_pool_ttl);
+    auto now = std::chrono::steady_clock::now();
+    while (!pooled_pcs_.empty()) {
+      auto pooled = pooled_pcs_.front();
+      pooled_pcs_.pop_front();
+      if (now - pooled.second < ttl) {
+        pcc = pooled.first;
+        break;
+      }
+    }
+  }
+  if (pcc) {
+    pcc->SetCodecPreferences(config.audio, config.video);
+    RefillPeerConnectionPool();
+    return pcc;
+  }
+  return std::make_shared<ConferencePeerConnectionChannel>(
+      config, signaling_channel_, CreateSessionEventQueue());
+}
+std::shared_ptr<rtc::TaskQueue> ConferenceClient::CreateSessionEventQueue() {
+  if (!configuration_.callback_executor)
+    return event_queue_;
+  return CreateCallbackQueue(configuration_.callback_executor,
+                             "ConferenceSessionEventQueue");
+}
+void ConferenceClient::RefillPeerConnectionPool() {
+  if (configuration_.peer_connection_pool_size <= 0)
+    return;
+  std::weak_ptr<ConferenceClient> weak_this = shared_from_this();
+  // Creating a PeerConnection blocks until it's created on PeerConnection
+  // factory's thread, so it's done there instead of |event_queue_|, where
+  // application callbacks run.
+  PeerConnectionDependencyFactory::Get()->PostTask([weak_this] {
+    auto that = weak_this.lock();
+    if (!that || !that->signaling_channel_connected_)
+      return;
+    size_t pool_size = that->configuration_.peer_connection_pool_size;
+    auto ttl =
+        std::chrono::seconds(that->configuration_.peer_connection_pool_ttl);
+    size_t missing_count = 0;
+    {
+      std::lock_guard<std::mutex> lock(that->pooled_pcs_mutex_);
+      auto now = std::chrono::steady_clock::now();
+      while (!that->pooled_pcs_.empty() &&
+             now - that->pooled_pcs_.front().second >= ttl) {
+        that->pooled_pcs_.pop_front();
+      }
+      if (that->pooled_pcs_.size() < pool_size)
+        missing_count = pool_size - that->pooled_pcs_.size();
+    }
+    // Creating PeerConnections is slow, so the lock is not held here.
+    for (size_t i = 0; i < missing_count; i++) {
+      PeerConnectionChannelConfiguration config =
+          that->GetPeerConnectionChannelConfiguration();
+      // Start gathering candidates before SetLocalDescription.
+      config.ice_candidate_pool_size = 1;
+      auto pcc = std::make_shared<ConferencePeerConnectionChannel>(
+          config, that->signaling_channel_, that->CreateSessionEventQueue());
+      std::lock_guard<std::mutex> lock(that->pooled_pcs_mutex_);
+      that->pooled_pcs_.push_back(
+          std::make_pair(pcc, std::chrono::steady_clock::now()));
+    }
+    // Check again when channels just created expire.
+    std::lock_guard<std::mutex> lock(that->pooled_pcs_mutex_);
+    if (that->pool_refresh_timer_ != TimerService::kInvalidTimerId)
+      return;
+    that->pool_refresh_timer_ = TimerService::Get().Schedule(
+        static_cast<int64_t>(that->configuration_.peer_connection_pool_ttl) *
+            1000,
+        [weak_this] {
+          auto that = weak_this.lock();
+          if (!that)
+            return;
+          {
+            std::lock_guard<std::mutex> lock(that->pooled_pcs_mutex_);
+            that->pool_refresh_timer_ = TimerService::kInvalidTimerId;
+          }
+          that->RefillPeerConnectionPool();
+        });
+  });
+}
+std::vector<std::shared_ptr<ConferencePeerConnectionChannel>>
+ConferenceClient::TakePeerConnectionChannels() {
+  std::vector<std::shared_ptr<ConferencePeerConnectionChannel>> pccs;
+  {
+    std::lock_guard<std::mutex> lock(publish_pcs_mutex_);
+    for (auto& pcc : publish_pcs_)
+      pccs.push_back(pcc.second);
+    pccs.insert(pccs.end(), pending_publish_pcs_.begin(),
+                pending_publish_pcs_.end());
+    publish_id_label_map_.clear();
+    publish_pcs_.clear();
+    pending_publish_pcs_.clear();
+  }
+  {
+    std::lock_guard<std::mutex> lock(subscribe_pcs_mutex_);
+    for (auto& pcc : subscribe_pcs_)
+      pccs.push_back(pcc.second);
+    pccs.insert(pccs.end(), pending_subscribe_pcs_.begin(),
+                pending_subscribe_pcs_.end());
+    if (multiplexed_subscribe_pcc_)
+      pccs.push_back(multiplexed_subscribe_pcc_);
+    subscribe_pcs_.clear();
+    pending_subscribe_pcs_.clear();
+    subscribed_stream_ids_.clear();
+    multiplexed_subscribe_pcc_.reset();
+  }
+  {
+    std::lock_guard<std::mutex> lock(pooled_pcs_mutex_);
+    for (auto& pooled : pooled_pcs_)
+      pccs.push_back(pooled.first);
+    pooled_pcs_.clear();
+    TimerService::Get().Cancel(pool_refresh_timer_);
+    pool_refresh_timer_ = TimerService::kInvalidTimerId;
+  }
+  // A channel may be indexed more than once.
+  std::sort(pccs.begin(), pccs.end());
+  pccs.erase(std::unique(pccs.begin(), pccs.end()), pccs.end());
+  return pccs;
+}
+void ConferenceClient::ClosePeerConnectionChannels(
+    std::vector<std::shared_ptr<ConferencePeerConnectionChannel>> pccs,
+    std::function<void()> on_closed) {
+  std::weak_ptr<ConferenceClient> weak_this = shared_from_this();
+  auto closed = [weak_this, on_closed] {
+    auto that = weak_this.lock();
+    if (!that || !on_closed)
+      return;
+    that->event_queue_->PostTask([on_closed] { on_closed(); });
+  };
+  if (pccs.empty()) {
+    closed();
+    return;
+  }
+  // Each channel is closed on its own event queue, so channels are closed in
+  // parallel when a callback executor is configured. Otherwise they are closed
+  // one by one on |event_queue_|. The caller is not blocked in either case.
+  auto remaining = std::make_shared<std::atomic<size_t>>(pccs.size());
+  for (auto& pcc : pccs) {
+    std::shared_ptr<rtc::TaskQueue> queue = pcc->EventQueue();
+    // The task owns the only reference kept by this client, so the channel is
+    // released after it's closed rather than when all channels are closed.
+    queue->PostTask([pcc = std::move(pcc), remaining, closed]() mutable {
+      pcc->Close();
+      // The channel is destroyed here unless a task it posted earlier still
+      // holds a reference.
+      pcc.reset();
+      if (remaining->fetch_sub(1) == 1)
+        closed();
+    });
+  }
+  pccs.clear();
+}
 void ConferenceClient::OnUserJoined(std::shared_ptr<sio::message> user) {
-  TriggerOnUserJoined(user);
+  RunInRoomEventOrder(
+      [user](ConferenceClient& client) { client.TriggerOnUserJoined(user); });
 }
 void ConferenceClient::OnUserLeft(std::shared_ptr<sio::message> user) {
-  TriggerOnUserLeft(user);
+  RunInRoomEventOrder(
+      [user](ConferenceClient& client) { client.TriggerOnUserLeft(user); });
 }
 void ConferenceClient::TriggerOnStreamRemoved(sio::message::ptr stream_info) {
   std::string id = stream_info->get_map()["id"]->get_string();
-  auto stream_it = added_streams_.find(id);
-  auto stream_type = added_stream_type_.find(id);
-  if (stream_it == added_streams_.end() ||
-      stream_type == added_stream_type_.end()) {
-    RTC_LOG(LS_WARNING) << "Invalid stream or type.";
-    return;
+  {
+    const std::lock_guard<std::mutex> lock(added_streams_mutex_);
+    auto stream_it = added_streams_.find(id);
+    auto stream_type = added_stream_type_.find(id);
+    if (stream_it == added_streams_.end() ||
+        stream_type == added_stream_type_.end()) {
+      RTC_LOG(LS_WARNING) << "Invalid stream or type.";
+      return;
+    }
+    added_streams_.erase(stream_it);
+    added_stream_type_.erase(stream_type);
   }
-  added_streams_.erase(stream_it);
-  added_stream_type_.erase(stream_type);
   current_conference_info_->TriggerOnStreamEnded(id);
   current_conference_info_->RemoveStreamById(id);
-  const std::lock_guard<std::mutex> lock(stream_update_observer_mutex_);
-  for (auto its = stream_update_observers_.begin();
-       its != stream_update_observers_.end(); ++its) {
-    (*its).get().OnStreamRemoved(id);
-  }
+  stream_update_observers_.ForEach(
+      [&](ConferenceStreamUpdateObserver& o) { o.OnStreamRemoved(id); });
+}
+void ConferenceClient::PostToObservers(
+    std::function<void(ConferenceClientObserver&)> func) {
+  std::weak_ptr<ConferenceClient> weak_this = weak_from_this();
+  event_queue_->PostTask([weak_this, func] {
+    auto that = weak_this.lock();
+    if (!that)
+      return;
+    that->observers_.ForEach(func);
+  });
 }
 void ConferenceClient::TriggerOnStreamError(
     std::shared_ptr<Stream> stream,
     std::shared_ptr<const Exception> exception) {
-  const std::lock_guard<std::mutex> lock(stream_update_observer_mutex_);
-  for (auto its = stream_update_observers_.begin();
-       its != stream_update_observers_.end(); ++its) {
-    (*its).get().OnStreamError(exception->Message());
-  }
+  stream_update_observers_.ForEach([&](ConferenceStreamUpdateObserver& o) {
+    o.OnStreamError(exception->Message());
+  });
 }
 
 void ConferenceClient::TriggerOnStreamUpdated(sio::message::ptr stream_info) {
@@ -1856,16 +2325,29 @@ void ConferenceClient::TriggerOnStreamUpdated(sio::message::ptr stream_info) {
   }
   std::string id = stream_info->get_map()["id"]->get_string();
   auto event = stream_info->get_map()["event"];
-  auto stream_it = added_streams_.find(id);
-  auto stream_type = added_stream_type_.find(id);
-  if (stream_it == added_streams_.end() ||
-      stream_type == added_stream_type_.end()) {
-    RTC_DCHECK(false);
-    RTC_LOG(LS_WARNING) << "Invalid stream or type.";
+  // MCU hints which simulcast layers of a local publication are subscribed.
+  // Local publications are not in |added_streams_|.
+  auto field = event->get_map()["field"];
+  if (field != nullptr && field->get_flag() == sio::message::flag_string &&
+      field->get_string() == "video.subscribedLayers") {
+    OnSubscribedLayersChanged(id, event->get_map()["value"]);
     return;
   }
-  auto stream = stream_it->second;
-  auto type = stream_type->second;
+  std::shared_ptr<RemoteStream> stream;
+  StreamType type;
+  {
+    const std::lock_guard<std::mutex> lock(added_streams_mutex_);
+    auto stream_it = added_streams_.find(id);
+    auto stream_type = added_stream_type_.find(id);
+    if (stream_it == added_streams_.end() ||
+        stream_type == added_stream_type_.end()) {
+      RTC_DCHECK(false);
+      RTC_LOG(LS_WARNING) << "Invalid stream or type.";
+      return;
+    }
+    stream = stream_it->second;
+    type = stream_type->second;
+  }
   if (event == nullptr || event->get_flag() != sio::message::flag_object ||
       event->get_map()["field"] == nullptr ||
       event->get_map()["field"]->get_flag() != sio::message::flag_string) {
@@ -1900,10 +2382,9 @@ void ConferenceClient::TriggerOnStreamUpdated(sio::message::ptr stream_info) {
     TrackKind track_kind =
         (event_field == "audio.status") ? TrackKind::kAudio : TrackKind::kVideo;
     bool muted = (status_value == "inactive") ? true : false;
-    for (auto its = stream_update_observers_.begin();
-         its != stream_update_observers_.end(); ++its) {
-      (*its).get().OnStreamMuteOrUnmute(id, track_kind, muted);
-    }
+    stream_update_observers_.ForEach([&](ConferenceStreamUpdateObserver& o) {
+      o.OnStreamMuteOrUnmute(id, track_kind, muted);
+    });
     current_conference_info_->TriggerOnStreamMuteOrUnmute(id, track_kind,
                                                           muted);
   } else if (event_field == ".") {
@@ -1917,6 +2398,25 @@ void ConferenceClient::TriggerOnStreamUpdated(sio::message::ptr stream_info) {
     }
   }
 }
+void ConferenceClient::OnSubscribedLayersChanged(
+    const std::string& publication_id,
+    sio::message::ptr layers) {
+  if (layers == nullptr || layers->get_flag() != sio::message::flag_array) {
+    RTC_LOG(LS_WARNING) << "Invalid subscribed layers.";
+    return;
+  }
+  std::vector<std::string> rids;
+  for (const auto& layer : layers->get_vector()) {
+    if (layer != nullptr && layer->get_flag() == sio::message::flag_string)
+      rids.push_back(layer->get_string());
+  }
+  auto pcc = GetConferencePeerConnectionChannel(publication_id);
+  if (pcc == nullptr) {
+    RTC_LOG(LS_WARNING) << "Received subscribed layers of unknown stream.";
+    return;
+  }
+  pcc->OnSubscribedLayersChanged(rids);
+}
 std::unordered_map<std::string, std::string>
 ConferenceClient::AttributesFromStreamInfo(
     std::shared_ptr<sio::message> stream_info) {
@@ -2,6 +2,7 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 #include "talk/owt/sdk/conference/conferencepeerconnectionchannel.h"
+#include <algorithm>
 #include <future>
 #include <thread>
 #include <vector>
@@ -58,27 +59,67 @@ const string kSessionDescriptionTiebreakerKey = "tiebreaker";
 const string kIceCandidateSdpMidKey = "sdpMid";
 const string kIceCandidateSdpMLineIndexKey = "sdpMLineIndex";
 const string kIceCandidateSdpNameKey = "candidate";
+// Message channel
+const string kMessageDataChannelLabel = "owt-message";
+// Unreliable messages larger than MTU are fragmented, and losing any fragment
+// loses the whole message.
+const size_t kMaxMessageBatchSize = 1200;
+// Drop messages instead of queuing them when the channel is congested, since
+// late real-time messages are useless.
+const uint64_t kMaxMessageBufferedAmount = 64 * 1024;
 ConferencePeerConnectionChannel::ConferencePeerConnectionChannel(
     PeerConnectionChannelConfiguration& configuration,
     std::shared_ptr<ConferenceSocketSignalingChannel> signaling_channel,
-    std::shared_ptr<rtc::TaskQueue> event_queue)
+    std::shared_ptr<rtc::TaskQueue> event_queue,
+    bool multiplexed)
     : PeerConnectionChannel(configuration),
       signaling_channel_(signaling_channel),
       session_id_(""),
       ice_restart_needed_(false),
+      ice_restart_offer_(false),
       connected_(false),
+      closed_(false),
       sub_stream_added_(false),
       sub_server_ready_(false),
-      event_queue_(event_queue) {
+      event_queue_(event_queue),
+      multiplexed_(multiplexed),
+      negotiating_(false),
+      subscribed_layers_known_(false),
+      layer_deactivation_timer_(TimerService::kInvalidTimerId),
+      message_batch_interval_ms_(0),
+      message_flush_timer_(TimerService::kInvalidTimerId) {
   InitializePeerConnection();
   RTC_CHECK(signaling_channel_);
 }
 ConferencePeerConnectionChannel::~ConferencePeerConnectionChannel() {
   RTC_LOG(LS_INFO) << "Deconstruct conference peer connection channel";
+  TimerService::Get().Cancel(layer_deactivation_timer_);
+  TimerService::Get().Cancel(message_flush_timer_);
+  if (message_data_channel_)
+    message_data_channel_->UnregisterObserver();
+  if (closed_)
+    return;
+  if (message_data_channel_)
+    Unpublish(GetSessionId(), nullptr, nullptr);
   if (published_stream_)
     Unpublish(GetSessionId(), nullptr, nullptr);
   if (subscribed_stream_)
     Unsubscribe(GetSessionId(), nullptr, nullptr);
+  if (multiplexed_) {
+    for (auto& subscription : multiplexed_subscriptions_) {
+      signaling_channel_->SendStreamEvent("unsubscribe", subscription.first,
+                                          nullptr, nullptr);
+    }
+    ClosePeerConnection();
+  }
+}
+void ConferencePeerConnectionChannel::SetCodecPreferences(
+    const std::vector<AudioEncodingParameters>& audio,
+    const std::vector<VideoEncodingParameters>& video) {
+  RTC_DCHECK(!published_stream_ && !subscribed_stream_);
+  configuration_.audio = audio;
+  configuration_.video = video;
+  ResetVideoEncodingParameters();
 }
 void ConferencePeerConnectionChannel::AddObserver(
     ConferencePeerConnectionChannelObserver& observer) {
@@ -117,10 +158,25 @@ void ConferencePeerConnectionChannel::CreateOffer() {
   auto offer_answer_options =
       webrtc::PeerConnectionInterface::RTCOfferAnswerOptions();
   offer_answer_options.use_rtp_mux = !rtp_no_mux;
+  offer_answer_options.ice_restart = ice_restart_offer_;
+  ice_restart_offer_ = false;
   peer_connection_->CreateOffer(observer.get(), offer_answer_options);
 }
 
 void ConferencePeerConnectionChannel::IceRestart() {
+  if (multiplexed_) {
+    // Offers of a multiplexed channel are serialized with subscription
+    // changes, so the restart waits for the negotiation in progress.
+    std::weak_ptr<ConferencePeerConnectionChannel> weak_this =
+        shared_from_this();
+    EnqueueNegotiation([weak_this] {
+      auto that = weak_this.lock();
+      if (!that)
+        return;
+      that->DoIceRestart();
+    });
+    return;
+  }
   if (SignalingState() == webrtc::PeerConnectionInterface::SignalingState::kStable) {
     DoIceRestart();
   } else {
@@ -131,6 +187,7 @@ void ConferencePeerConnectionChannel::DoIceRestart() {
   RTC_LOG(LS_INFO) << "ICE restart";
   RTC_DCHECK(SignalingState() ==
              webrtc::PeerConnectionInterface::SignalingState::kStable);
+  ice_restart_offer_ = true;
   this->CreateOffer();
 }
 
@@ -172,6 +229,10 @@ void ConferencePeerConnectionChannel::OnSignalingChange(
 void ConferencePeerConnectionChannel::OnAddStream(
     rtc::scoped_refptr<MediaStreamInterface> stream) {
   RTC_LOG(LS_INFO) << "On add stream.";
+  // Tracks of a multiplexed channel are associated with subscriptions by mid in
+  // OnTrack.
+  if (multiplexed_)
+    return;
   if (subscribed_stream_ != nullptr)
     subscribed_stream_->MediaStream(stream.get());
   std::weak_ptr<ConferencePeerConnectionChannel> weak_this = shared_from_this();
@@ -198,12 +259,69 @@ void ConferencePeerConnectionChannel::OnAddStream(
 }
 void ConferencePeerConnectionChannel::OnRemoveStream(
     rtc::scoped_refptr<MediaStreamInterface> stream) {}
+void ConferencePeerConnectionChannel::OnTrack(
+    rtc::scoped_refptr<webrtc::RtpTransceiverInterface> transceiver) {
+  if (!multiplexed_)
+    return;
+  auto mid = transceiver->mid();
+  if (!mid) {
+    RTC_LOG(LS_WARNING) << "Received a track without mid.";
+    return;
+  }
+  std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+  auto session_it = mid_session_map_.find(*mid);
+  if (session_it == mid_session_map_.end()) {
+    RTC_LOG(LS_WARNING) << "Received a track for unknown subscription.";
+    return;
+  }
+  auto subscription_it = multiplexed_subscriptions_.find(session_it->second);
+  if (subscription_it == multiplexed_subscriptions_.end())
+    return;
+  MultiplexedSubscription& subscription = subscription_it->second;
+  if (!subscription.media_stream) {
+    subscription.media_stream =
+        PeerConnectionDependencyFactory::Get()->CreateLocalMediaStream(
+            session_it->second);
+  }
+  auto track = transceiver->receiver()->track();
+  if (track->kind() == webrtc::MediaStreamTrackInterface::kAudioKind) {
+    subscription.media_stream->AddTrack(
+        static_cast<webrtc::AudioTrackInterface*>(track.get()));
+  } else {
+    subscription.media_stream->AddTrack(
+        static_cast<webrtc::VideoTrackInterface*>(track.get()));
+  }
+  subscription.received_track_count++;
+  MaybeCompleteSubscription(session_it->second, subscription);
+}
 void ConferencePeerConnectionChannel::OnDataChannel(
     rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel) {}
+void ConferencePeerConnectionChannel::OnDataChannelMessage(
+    const webrtc::DataBuffer& buffer) {
+  // Batches from MCU have sender's ID as header.
+  std::string from;
+  std::vector<std::vector<uint8_t>> messages;
+  if (!buffer.binary ||
+      !MessageBatcher::Unbatch(buffer.data.cdata(), buffer.data.size(), from,
+                               messages)) {
+    RTC_LOG(LS_WARNING) << "Ignore malformed message batch.";
+    return;
+  }
+  auto on_message = message_callback_;
+  if (on_message == nullptr)
+    return;
+  event_queue_->PostTask([on_message, from, messages] {
+    for (auto& message : messages) {
+      on_message(from, message);
+    }
+  });
+}
 void ConferencePeerConnectionChannel::OnRenegotiationNeeded() {}
 void ConferencePeerConnectionChannel::OnIceConnectionChange(
     webrtc::PeerConnectionInterface::IceConnectionState new_state) {
   RTC_LOG(LS_INFO) << "Ice connection state changed: " << new_state;
+  CheckIceConnectionForRestart(new_state);
+  UpdateBandwidthEstimateCache(new_state);
   if (new_state == webrtc::PeerConnectionInterface::kIceConnectionConnected ||
       new_state == webrtc::PeerConnectionInterface::kIceConnectionCompleted) {
     connected_ = true;
@@ -282,6 +400,7 @@ void ConferencePeerConnectionChannel::OnIceCandidatesRemoved(
   if (signaling_channel_) {
     signaling_channel_->SendSdp(message, nullptr, nullptr);
   }
+  PeerConnectionChannel::OnIceCandidatesRemoved(candidates);
 }
 void ConferencePeerConnectionChannel::OnCreateSessionDescriptionSuccess(
     webrtc::SessionDescriptionInterface* desc) {
@@ -322,11 +441,30 @@ void ConferencePeerConnectionChannel::OnCreateSessionDescriptionSuccess(
 void ConferencePeerConnectionChannel::OnCreateSessionDescriptionFailure(
     const std::string& error) {
   RTC_LOG(LS_INFO) << "Create sdp failed.";
+  if (multiplexed_) {
+    FailSubscriptionBatch("Failed to create offer.");
+    OnNegotiationCompleted();
+  }
 }
 void ConferencePeerConnectionChannel::OnSetLocalSessionDescriptionSuccess() {
   RTC_LOG(LS_INFO) << "Set local sdp success.";
   // For conference, it's now OK to set bandwidth
   ApplyBitrateSettings();
+  if (multiplexed_) {
+    std::shared_ptr<SubscriptionBatch> batch;
+    {
+      std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+      batch.swap(negotiating_batch_);
+    }
+    // The offer is sent after MCU accepts subscriptions in it.
+    if (batch) {
+      OnSubscriptionOfferApplied(batch);
+      return;
+    }
+  }
+  SendLocalDescription();
+}
+void ConferencePeerConnectionChannel::SendLocalDescription() {
   auto desc = LocalDescription();
   string sdp;
   desc->ToString(&sdp);
@@ -341,6 +479,10 @@ void ConferencePeerConnectionChannel::OnSetLocalSessionDescriptionSuccess() {
 void ConferencePeerConnectionChannel::OnSetLocalSessionDescriptionFailure(
     const std::string& error) {
   RTC_LOG(LS_INFO) << "Set local sdp failed.";
+  if (multiplexed_) {
+    FailSubscriptionBatch("Failed to set local description.");
+    OnNegotiationCompleted();
+  }
   if (failure_callback_) {
     std::unique_ptr<Exception> e(new Exception(
         ExceptionType::kConferenceUnknown, "Failed to set local description."));
@@ -351,10 +493,28 @@ void ConferencePeerConnectionChannel::OnSetLocalSessionDescriptionFailure(
 }
 void ConferencePeerConnectionChannel::OnSetRemoteSessionDescriptionSuccess() {
   PeerConnectionChannel::OnSetRemoteSessionDescriptionSuccess();
+  if (multiplexed_) {
+    {
+      std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+      answering_session_ids_.clear();
+    }
+    OnNegotiationCompleted();
+  }
 }
 void ConferencePeerConnectionChannel::OnSetRemoteSessionDescriptionFailure(
     const std::string& error) {
   RTC_LOG(LS_INFO) << "Set remote sdp failed.";
+  if (multiplexed_) {
+    std::vector<std::string> session_ids;
+    {
+      std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+      session_ids.swap(answering_session_ids_);
+    }
+    FailPendingSubscriptions(session_ids, "Failed to set remote description.");
+    // Negotiation completes after the offer is rolled back.
+    RollbackLocalDescription();
+    return;
+  }
   if (failure_callback_) {
     std::unique_ptr<Exception> e(new Exception(
         ExceptionType::kConferenceUnknown, "Fail to set remote description."));
@@ -579,6 +739,75 @@ static bool SubOptionAllowed(
       keyframe_interval_supported && bitrate_multiplier_supported);
 }
 
+// Create options of the audio track in a subscription request.
+static sio::message::ptr CreateSubscribeAudioTrackOptions(
+    std::shared_ptr<RemoteStream> stream,
+    const std::string& mid) {
+  sio::message::ptr audio_options = sio::object_message::create();
+  audio_options->get_map()["type"] = sio::string_message::create("audio");
+  audio_options->get_map()["mid"] = sio::string_message::create(mid);
+  audio_options->get_map()["from"] = sio::string_message::create(stream->Id());
+  return audio_options;
+}
+// Create options of the video track in a subscription request.
+static sio::message::ptr CreateSubscribeVideoTrackOptions(
+    std::shared_ptr<RemoteStream> stream,
+    const SubscribeOptions& subscribe_options,
+    const std::string& mid) {
+  sio::message::ptr video_options = sio::object_message::create();
+  video_options->get_map()["type"] = sio::string_message::create("video");
+  video_options->get_map()["mid"] = sio::string_message::create(mid);
+  auto publication_settings = stream->Settings();
+  if (subscribe_options.video.rid != "") {
+    for (auto video_setting : publication_settings.video) {
+      if (video_setting.rid == subscribe_options.video.rid) {
+        std::string track_id = video_setting.track_id;
+        video_options->get_map()["from"] =
+            sio::string_message::create(track_id);
+        break;
+      }
+    }
+  } else {
+    video_options->get_map()["from"] =
+        sio::string_message::create(stream->Id());
+  }
+  sio::message::ptr video_spec = sio::object_message::create();
+  sio::message::ptr resolution_options = sio::object_message::create();
+  if (subscribe_options.video.resolution.width != 0 &&
+      subscribe_options.video.resolution.height != 0) {
+    resolution_options->get_map()["width"] =
+        sio::int_message::create(subscribe_options.video.resolution.width);
+    resolution_options->get_map()["height"] =
+        sio::int_message::create(subscribe_options.video.resolution.height);
+    video_spec->get_map()["resolution"] = resolution_options;
+  }
+  // If bitrateMultiplier is not specified, do not include it in video spec.
+  std::string quality_level("x1.0");
+  if (subscribe_options.video.bitrateMultiplier != 0) {
+    quality_level =
+        "x" +
+        std::to_string(subscribe_options.video.bitrateMultiplier).substr(0, 3);
+  }
+  if (quality_level != "x1.0") {
+    sio::message::ptr quality_options =
+        sio::string_message::create(quality_level);
+    video_spec->get_map()["bitrate"] = quality_options;
+  }
+  if (subscribe_options.video.keyFrameInterval != 0) {
+    video_spec->get_map()["keyFrameInterval"] =
+        sio::int_message::create(subscribe_options.video.keyFrameInterval);
+  }
+  if (subscribe_options.video.frameRate != 0) {
+    video_spec->get_map()["framerate"] =
+        sio::int_message::create(subscribe_options.video.frameRate);
+  }
+  video_options->get_map()["parameters"] = video_spec;
+  if (subscribe_options.video.rid != "") {
+    video_options->get_map()["simulcastRid"] =
+        sio::string_message::create(subscribe_options.video.rid);
+  }
+  return video_options;
+}
 void ConferencePeerConnectionChannel::Subscribe(
     std::shared_ptr<RemoteStream> stream,
     const SubscribeOptions& subscribe_options,
@@ -632,71 +861,12 @@ void ConferencePeerConnectionChannel::Subscribe(
   sio::message::ptr media_options = sio::object_message::create();
   sio::message::ptr tracks_options = sio::array_message::create();
   if (audio_track_count > 0) {
-    sio::message::ptr audio_options = sio::object_message::create();
-    audio_options->get_map()["type"] = sio::string_message::create("audio");
-    audio_options->get_map()["mid"] = sio::string_message::create("0");
-    audio_options->get_map()["from"] =
-        sio::string_message::create(stream->Id());
-    tracks_options->get_vector().push_back(audio_options);
+    tracks_options->get_vector().push_back(
+        CreateSubscribeAudioTrackOptions(stream, "0"));
   }
   if (video_track_count > 0) {
-    sio::message::ptr video_options = sio::object_message::create();
-    video_options->get_map()["type"] = sio::string_message::create("video");
-    if (audio_track_count == 0) {
-      video_options->get_map()["mid"] = sio::string_message::create("0");
-    } else {
-      video_options->get_map()["mid"] = sio::string_message::create("1");
-    }
-    auto publication_settings = stream->Settings();
-    if (subscribe_options.video.rid != "") {
-      for (auto video_setting : publication_settings.video) {
-        if (video_setting.rid == subscribe_options.video.rid) {
-          std::string track_id = video_setting.track_id;
-          video_options->get_map()["from"] =
-              sio::string_message::create(track_id);
-          break;
-        }
-      }
-    } else {
-      video_options->get_map()["from"] =
-          sio::string_message::create(stream->Id());
-    }
-    sio::message::ptr video_spec = sio::object_message::create();
-    sio::message::ptr resolution_options = sio::object_message::create();
-    if (subscribe_options.video.resolution.width != 0 &&
-        subscribe_options.video.resolution.height != 0) {
-      resolution_options->get_map()["width"] =
-          sio::int_message::create(subscribe_options.video.resolution.width);
-      resolution_options->get_map()["height"] =
-          sio::int_message::create(subscribe_options.video.resolution.height);
-      video_spec->get_map()["resolution"] = resolution_options;
-    }
-    // If bitrateMultiplier is not specified, do not include it in video spec.
-    std::string quality_level("x1.0");
-    if (subscribe_options.video.bitrateMultiplier != 0) {
-      quality_level =
-          "x" + std::to_string(subscribe_options.video.bitrateMultiplier)
-                    .substr(0, 3);
-    }
-    if (quality_level != "x1.0") {
-      sio::message::ptr quality_options =
-          sio::string_message::create(quality_level);
-      video_spec->get_map()["bitrate"] = quality_options;
-    }
-    if (subscribe_options.video.keyFrameInterval != 0) {
-      video_spec->get_map()["keyFrameInterval"] =
-          sio::int_message::create(subscribe_options.video.keyFrameInterval);
-    }
-    if (subscribe_options.video.frameRate != 0) {
-      video_spec->get_map()["framerate"] =
-          sio::int_message::create(subscribe_options.video.frameRate);
-    }
-    video_options->get_map()["parameters"] = video_spec;
-    if (subscribe_options.video.rid != "") {
-      video_options->get_map()["simulcastRid"] =
-          sio::string_message::create(subscribe_options.video.rid);
-    }
-    tracks_options->get_vector().push_back(video_options);
+    tracks_options->get_vector().push_back(CreateSubscribeVideoTrackOptions(
+        stream, subscribe_options, audio_track_count == 0 ? "0" : "1"));
   }
 
   media_options->get_map()["tracks"] = tracks_options;
@@ -715,6 +885,605 @@ void ConferencePeerConnectionChannel::Subscribe(
       on_failure);  // TODO: on_failure
   subscribed_stream_ = stream;
 }
+void ConferencePeerConnectionChannel::AddSubscription(
+    std::shared_ptr<RemoteStream> stream,
+    const SubscribeOptions& subscribe_options,
+    std::function<void(std::string)> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  SubscriptionRequest request;
+  request.stream = stream;
+  request.options = subscribe_options;
+  request.on_success = on_success;
+  request.on_failure = on_failure;
+  AddSubscriptions(std::vector<SubscriptionRequest>{request});
+}
+void ConferencePeerConnectionChannel::AddSubscriptions(
+    const std::vector<SubscriptionRequest>& requests) {
+  RTC_DCHECK(multiplexed_);
+  std::vector<SubscriptionRequest> allowed_requests;
+  for (auto& request : requests) {
+    if (!CheckNullPointer((uintptr_t)request.stream.get(),
+                          request.on_failure)) {
+      RTC_LOG(LS_ERROR) << "Remote stream cannot be nullptr.";
+      continue;
+    }
+    if (!SubOptionAllowed(request.options, request.stream->Settings(),
+                          request.stream->Capabilities())) {
+      RTC_LOG(LS_ERROR)
+          << "Subscribe option mismatch with stream subcription capabilities.";
+      auto on_failure = request.on_failure;
+      if (on_failure != nullptr) {
+        event_queue_->PostTask([on_failure]() {
+          std::unique_ptr<Exception> e(
+              new Exception(ExceptionType::kConferenceUnknown,
+                            "Unsupported subscribe option."));
+          on_failure(std::move(e));
+        });
+      }
+      continue;
+    }
+    allowed_requests.push_back(request);
+  }
+  if (allowed_requests.empty())
+    return;
+  std::weak_ptr<ConferencePeerConnectionChannel> weak_this = shared_from_this();
+  EnqueueNegotiation([weak_this, allowed_requests] {
+    auto that = weak_this.lock();
+    if (!that)
+      return;
+    that->DoAddSubscriptions(allowed_requests);
+  });
+}
+void ConferencePeerConnectionChannel::DoAddSubscriptions(
+    std::vector<SubscriptionRequest> requests) {
+  RTC_LOG(LS_INFO) << "Add " << requests.size()
+                   << " subscription(s) to multiplexed channel.";
+  auto batch = std::make_shared<SubscriptionBatch>();
+  for (auto& request : requests) {
+    auto& stream = request.stream;
+    std::vector<ReceiveTransceiver> transceivers;
+    if (stream->has_audio_ && !request.options.audio.disabled) {
+      auto audio_transceiver =
+          AcquireReceiveTransceiver(cricket::MediaType::MEDIA_TYPE_AUDIO);
+      if (audio_transceiver.transceiver)
+        transceivers.push_back(audio_transceiver);
+    }
+    if (stream->has_video_ && !request.options.video.disabled) {
+      auto video_transceiver =
+          AcquireReceiveTransceiver(cricket::MediaType::MEDIA_TYPE_VIDEO);
+      if (video_transceiver.transceiver)
+        transceivers.push_back(video_transceiver);
+    }
+    if (transceivers.empty()) {
+      auto on_failure = request.on_failure;
+      if (on_failure != nullptr) {
+        event_queue_->PostTask([on_failure]() {
+          std::unique_ptr<Exception> e(
+              new Exception(ExceptionType::kConferenceUnknown,
+                            "Failed to create transceivers for subscription."));
+          on_failure(std::move(e));
+        });
+      }
+      continue;
+    }
+    batch->requests.push_back(request);
+    batch->transceivers.push_back(transceivers);
+  }
+  if (batch->requests.empty()) {
+    OnNegotiationCompleted();
+    return;
+  }
+  batch->pending_count = batch->requests.size();
+  // Mids of new transceivers are assigned when local description is set.
+  // Requests are sent after that, see OnSetLocalSessionDescriptionSuccess.
+  {
+    std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+    negotiating_batch_ = batch;
+  }
+  CreateOffer();
+}
+void ConferencePeerConnectionChannel::OnSubscriptionOfferApplied(
+    std::shared_ptr<SubscriptionBatch> batch) {
+  for (size_t i = 0; i < batch->requests.size(); i++) {
+    auto& request = batch->requests[i];
+    sio::message::ptr tracks_options = sio::array_message::create();
+    for (auto& transceiver : batch->transceivers[i]) {
+      auto mid = transceiver.transceiver->mid();
+      RTC_DCHECK(mid);
+      transceiver.mid = mid.value_or("");
+      if (transceiver.transceiver->media_type() ==
+          cricket::MediaType::MEDIA_TYPE_AUDIO) {
+        tracks_options->get_vector().push_back(
+            CreateSubscribeAudioTrackOptions(request.stream, transceiver.mid));
+      } else {
+        tracks_options->get_vector().push_back(
+            CreateSubscribeVideoTrackOptions(request.stream, request.options,
+                                             transceiver.mid));
+      }
+    }
+    batch->tracks_options.push_back(tracks_options);
+  }
+  SendSubscriptionRequests(batch, 0);
+}
+void ConferencePeerConnectionChannel::SendSubscriptionRequests(
+    std::shared_ptr<SubscriptionBatch> batch,
+    size_t index) {
+  // Reuse the transport created by previous subscriptions.
+  std::string transport_id = GetSessionId();
+  size_t end = transport_id.empty() ? index + 1 : batch->requests.size();
+  {
+    std::lock_guard<std::mutex> lock(batch->mutex);
+    batch->sent_count = end;
+  }
+  std::weak_ptr<ConferencePeerConnectionChannel> weak_this = shared_from_this();
+  for (size_t i = index; i < end; i++) {
+    sio::message::ptr sio_options = sio::object_message::create();
+    sio::message::ptr media_options = sio::object_message::create();
+    media_options->get_map()["tracks"] = batch->tracks_options[i];
+    sio_options->get_map()["media"] = media_options;
+    sio::message::ptr transport_ptr = sio::object_message::create();
+    transport_ptr->get_map()["type"] = sio::string_message::create("webrtc");
+    if (!transport_id.empty()) {
+      transport_ptr->get_map()["id"] =
+          sio::string_message::create(transport_id);
+    }
+    sio_options->get_map()["transport"] = transport_ptr;
+    signaling_channel_->SendInitializationMessage(
+        sio_options, "", batch->requests[i].stream->Id(),
+        [weak_this, batch, i](std::string session_id,
+                              std::string transport_id) {
+          auto that = weak_this.lock();
+          if (!that)
+            return;
+          that->OnSubscriptionRequestCompleted(batch, i, session_id,
+                                               transport_id, nullptr);
+        },
+        [weak_this, batch, i](std::unique_ptr<Exception> e) {
+          auto that = weak_this.lock();
+          if (!that)
+            return;
+          that->OnSubscriptionRequestCompleted(batch, i, "", "", std::move(e));
+        });
+  }
+}
+void ConferencePeerConnectionChannel::OnSubscriptionRequestCompleted(
+    std::shared_ptr<SubscriptionBatch> batch,
+    size_t index,
+    const std::string& session_id,
+    const std::string& transport_id,
+    std::unique_ptr<Exception> error) {
+  auto& request = batch->requests[index];
+  if (session_id.empty()) {
+    ReleaseReceiveTransceivers(batch->transceivers[index]);
+    auto on_failure = request.on_failure;
+    if (on_failure != nullptr) {
+      ExceptionType type =
+          error ? error->Type() : ExceptionType::kConferenceUnknown;
+      std::string message =
+          error ? error->Message() : "Subscription is rejected.";
+      event_queue_->PostTask([on_failure, type, message] {
+        std::unique_ptr<Exception> e(new Exception(type, message));
+        on_failure(std::move(e));
+      });
+    }
+  } else {
+    OnSubscriptionAccepted(session_id, transport_id, request.stream,
+                           batch->transceivers[index], request.on_success,
+                           request.on_failure);
+  }
+  bool completed;
+  std::vector<std::string> accepted_session_ids;
+  size_t next_index;
+  {
+    std::lock_guard<std::mutex> lock(batch->mutex);
+    if (!session_id.empty())
+      batch->session_ids.push_back(session_id);
+    completed = --batch->pending_count == 0;
+    accepted_session_ids = batch->session_ids;
+    next_index = batch->sent_count;
+  }
+  bool accepted = !accepted_session_ids.empty();
+  bool rejected = accepted_session_ids.size() < batch->requests.size();
+  if (!completed) {
+    // Requests held until the transport is created.
+    if (next_index < batch->requests.size())
+      SendSubscriptionRequests(batch, next_index);
+    return;
+  }
+  if (!accepted) {
+    // Nothing to negotiate with MCU, discard the offer.
+    RollbackLocalDescription();
+    return;
+  }
+  // One offer for all subscriptions accepted in this batch. They fail if the
+  // answer cannot be applied.
+  {
+    std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+    answering_session_ids_ = accepted_session_ids;
+  }
+  SendLocalDescription();
+  if (rejected) {
+    // Transceivers of rejected requests have been set to inactive. Tell MCU
+    // in another negotiation.
+    std::weak_ptr<ConferencePeerConnectionChannel> weak_this =
+        shared_from_this();
+    EnqueueNegotiation([weak_this] {
+      auto that = weak_this.lock();
+      if (!that)
+        return;
+      that->CreateOffer();
+    });
+  }
+}
+void ConferencePeerConnectionChannel::RollbackLocalDescription() {
+  std::weak_ptr<ConferencePeerConnectionChannel> weak_this = shared_from_this();
+  scoped_refptr<FunctionalSetSessionDescriptionObserver> observer =
+      FunctionalSetSessionDescriptionObserver::Create(
+          [weak_this]() {
+            auto that = weak_this.lock();
+            if (that)
+              that->OnNegotiationCompleted();
+          },
+          [weak_this](const std::string& error) {
+            RTC_LOG(LS_ERROR) << "Failed to rollback local description: "
+                              << error;
+            auto that = weak_this.lock();
+            if (that)
+              that->OnNegotiationCompleted();
+          });
+  peer_connection_->SetLocalDescription(
+      observer.get(),
+      webrtc::CreateSessionDescription(webrtc::SdpType::kRollback, "")
+          .release());
+}
+void ConferencePeerConnectionChannel::OnSubscriptionAccepted(
+    const std::string& session_id,
+    const std::string& transport_id,
+    std::shared_ptr<RemoteStream> stream,
+    const std::vector<ReceiveTransceiver>& transceivers,
+    std::function<void(std::string)> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  {
+    std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+    if (GetSessionId().empty()) {
+      // SDP and candidates of a multiplexed channel are exchanged on the
+      // transport, instead of a specific subscription.
+      SetSessionId(transport_id.empty() ? session_id : transport_id);
+    }
+    MultiplexedSubscription& subscription =
+        multiplexed_subscriptions_[session_id];
+    subscription.stream = stream;
+    subscription.transceivers = transceivers;
+    subscription.on_success = on_success;
+    subscription.on_failure = on_failure;
+    for (auto& transceiver : transceivers) {
+      mid_session_map_[transceiver.mid] = session_id;
+    }
+  }
+}
+void ConferencePeerConnectionChannel::OnSubscriptionProgress(
+    const std::string& session_id,
+    bool ready) {
+  std::vector<std::string> failed_session_ids;
+  {
+    std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+    auto it = multiplexed_subscriptions_.find(session_id);
+    if (it != multiplexed_subscriptions_.end()) {
+      if (ready) {
+        it->second.server_ready = true;
+        MaybeCompleteSubscription(session_id, it->second);
+        return;
+      }
+      failed_session_ids.push_back(session_id);
+    } else if (!ready && session_id == GetSessionId()) {
+      // An error of the shared transport fails every subscription not
+      // established yet.
+      for (auto& subscription : multiplexed_subscriptions_) {
+        failed_session_ids.push_back(subscription.first);
+      }
+    } else {
+      RTC_LOG(LS_WARNING) << "Received progress of unknown subscription.";
+      return;
+    }
+  }
+  FailPendingSubscriptions(
+      failed_session_ids,
+      "Server internal error during connection establishment.");
+}
+void ConferencePeerConnectionChannel::MaybeCompleteSubscription(
+    const std::string& session_id,
+    MultiplexedSubscription& subscription) {
+  if (!subscription.server_ready || !subscription.on_success ||
+      subscription.received_track_count < subscription.transceivers.size()) {
+    return;
+  }
+  subscription.stream->MediaStream(subscription.media_stream.get());
+  auto on_success = subscription.on_success;
+  subscription.on_success = nullptr;
+  subscription.on_failure = nullptr;
+  event_queue_->PostTask(
+      [on_success, session_id] { on_success(session_id); });
+}
+void ConferencePeerConnectionChannel::RemoveSubscription(
+    const std::string& session_id,
+    std::function<void()> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  std::vector<ReceiveTransceiver> transceivers;
+  std::string failure_message;
+  {
+    std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+    auto it = multiplexed_subscriptions_.find(session_id);
+    if (it == multiplexed_subscriptions_.end()) {
+      failure_message = "Invalid stream to be unsubscribed.";
+    } else if (it->second.on_success != nullptr) {
+      failure_message = "Cannot unsubscribe a stream during subscribing.";
+    } else {
+      transceivers = it->second.transceivers;
+      for (auto& transceiver : transceivers) {
+        mid_session_map_.erase(transceiver.mid);
+      }
+      multiplexed_subscriptions_.erase(it);
+    }
+  }
+  if (!failure_message.empty()) {
+    if (on_failure != nullptr) {
+      event_queue_->PostTask([on_failure, failure_message]() {
+        std::unique_ptr<Exception> e(
+            new Exception(ExceptionType::kConferenceUnknown, failure_message));
+        on_failure(std::move(e));
+      });
+    }
+    return;
+  }
+  signaling_channel_->SendStreamEvent("unsubscribe", session_id,
+                                      RunInEventQueue(on_success), on_failure);
+  std::weak_ptr<ConferencePeerConnectionChannel> weak_this = shared_from_this();
+  EnqueueNegotiation([weak_this, transceivers] {
+    auto that = weak_this.lock();
+    if (!that)
+      return;
+    that->ReleaseReceiveTransceivers(transceivers);
+    that->CreateOffer();
+  });
+}
+void ConferencePeerConnectionChannel::FailSubscriptionBatch(
+    const std::string& message) {
+  std::shared_ptr<SubscriptionBatch> batch;
+  {
+    std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+    batch.swap(negotiating_batch_);
+  }
+  if (!batch)
+    return;
+  for (size_t i = 0; i < batch->requests.size(); i++) {
+    ReleaseReceiveTransceivers(batch->transceivers[i]);
+    auto on_failure = batch->requests[i].on_failure;
+    if (on_failure == nullptr)
+      continue;
+    event_queue_->PostTask([on_failure, message]() {
+      std::unique_ptr<Exception> e(
+          new Exception(ExceptionType::kConferenceUnknown, message));
+      on_failure(std::move(e));
+    });
+  }
+}
+void ConferencePeerConnectionChannel::FailPendingSubscriptions(
+    const std::vector<std::string>& session_ids,
+    const std::string& message) {
+  std::vector<std::string> failed_session_ids;
+  std::vector<ReceiveTransceiver> transceivers;
+  std::vector<std::function<void(std::unique_ptr<Exception>)>> failures;
+  {
+    std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+    for (auto& session_id : session_ids) {
+      auto it = multiplexed_subscriptions_.find(session_id);
+      // Established subscriptions are not affected.
+      if (it == multiplexed_subscriptions_.end() ||
+          it->second.on_success == nullptr)
+        continue;
+      for (auto& transceiver : it->second.transceivers) {
+        mid_session_map_.erase(transceiver.mid);
+        transceivers.push_back(transceiver);
+      }
+      failures.push_back(it->second.on_failure);
+      failed_session_ids.push_back(session_id);
+      multiplexed_subscriptions_.erase(it);
+    }
+  }
+  ReleaseReceiveTransceivers(transceivers);
+  // MCU has accepted these subscriptions.
+  for (auto& session_id : failed_session_ids) {
+    RTC_LOG(LS_WARNING) << "Subscription " << session_id
+                        << " failed: " << message;
+    signaling_channel_->SendStreamEvent("unsubscribe", session_id, nullptr,
+                                        nullptr);
+  }
+  for (auto& on_failure : failures) {
+    if (on_failure == nullptr)
+      continue;
+    event_queue_->PostTask([on_failure, message]() {
+      std::unique_ptr<Exception> e(
+          new Exception(ExceptionType::kConferenceUnknown, message));
+      on_failure(std::move(e));
+    });
+  }
+}
+ConferencePeerConnectionChannel::ReceiveTransceiver
+ConferencePeerConnectionChannel::AcquireReceiveTransceiver(
+    cricket::MediaType media_type) {
+  {
+    std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+    for (auto it = idle_transceivers_.begin(); it != idle_transceivers_.end();
+         ++it) {
+      if (it->transceiver->media_type() != media_type)
+        continue;
+      ReceiveTransceiver reused = *it;
+      idle_transceivers_.erase(it);
+      reused.transceiver->SetDirectionWithError(
+          webrtc::RtpTransceiverDirection::kRecvOnly);
+      return reused;
+    }
+  }
+  webrtc::RtpTransceiverInit transceiver_init;
+  transceiver_init.direction = webrtc::RtpTransceiverDirection::kRecvOnly;
+  auto result = peer_connection_->AddTransceiver(media_type, transceiver_init);
+  if (!result.ok()) {
+    RTC_LOG(LS_ERROR) << "Failed to add transceiver: "
+                      << result.error().message();
+    return ReceiveTransceiver();
+  }
+  // Mid is assigned when local description is set.
+  ReceiveTransceiver created;
+  created.transceiver = result.MoveValue();
+  return created;
+}
+void ConferencePeerConnectionChannel::ReleaseReceiveTransceivers(
+    const std::vector<ReceiveTransceiver>& transceivers) {
+  std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+  for (auto& transceiver : transceivers) {
+    transceiver.transceiver->SetDirectionWithError(
+        webrtc::RtpTransceiverDirection::kInactive);
+    idle_transceivers_.push_back(transceiver);
+  }
+}
+void ConferencePeerConnectionChannel::EnqueueNegotiation(
+    std::function<void()> negotiation) {
+  {
+    std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+    if (negotiating_) {
+      pending_negotiations_.push_back(negotiation);
+      return;
+    }
+    negotiating_ = true;
+  }
+  negotiation();
+}
+void ConferencePeerConnectionChannel::OnNegotiationCompleted() {
+  std::function<void()> negotiation;
+  {
+    std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+    if (pending_negotiations_.empty()) {
+      negotiating_ = false;
+      return;
+    }
+    negotiation = pending_negotiations_.front();
+    pending_negotiations_.pop_front();
+  }
+  // Not running next negotiation in PeerConnection's callback.
+  event_queue_->PostTask([negotiation] { negotiation(); });
+}
+void ConferencePeerConnectionChannel::PublishMessageChannel(
+    int batch_interval_ms,
+    std::function<void(const std::string&, const std::vector<uint8_t>&)>
+        on_message,
+    std::function<void(std::string)> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  RTC_LOG(LS_INFO) << "Publish message channel.";
+  // Set before the data channel is created, so it's not written while
+  // messages arrive.
+  message_callback_ = on_message;
+  webrtc::DataChannelInit init;
+  init.ordered = false;
+  init.maxRetransmits = 0;
+  message_data_channel_ =
+      peer_connection_->CreateDataChannel(kMessageDataChannelLabel, &init);
+  if (!message_data_channel_) {
+    if (on_failure != nullptr) {
+      event_queue_->PostTask([on_failure]() {
+        std::unique_ptr<Exception> e(
+            new Exception(ExceptionType::kConferenceUnknown,
+                          "Failed to create message channel."));
+        on_failure(std::move(e));
+      });
+    }
+    return;
+  }
+  message_data_channel_->RegisterObserver(this);
+  message_batch_interval_ms_ = batch_interval_ms;
+  publish_success_callback_ = on_success;
+  failure_callback_ = on_failure;
+  sio::message::ptr options = sio::object_message::create();
+  options->get_map()["media"] = sio::null_message::create();
+  options->get_map()["data"] = sio::bool_message::create(true);
+  sio::message::ptr transport_ptr = sio::object_message::create();
+  transport_ptr->get_map()["type"] = sio::string_message::create("webrtc");
+  options->get_map()["transport"] = transport_ptr;
+  std::weak_ptr<ConferencePeerConnectionChannel> weak_this =
+      shared_from_this();
+  signaling_channel_->SendInitializationMessage(
+      options, kMessageDataChannelLabel, "",
+      [weak_this](std::string session_id, std::string transport_id) {
+        auto that = weak_this.lock();
+        if (!that)
+          return;
+        that->SetSessionId(session_id);
+        that->CreateOffer();
+      },
+      on_failure);
+}
+bool ConferencePeerConnectionChannel::SendMessageData(
+    const std::string& receiver,
+    const uint8_t* data,
+    size_t size) {
+  if (!message_data_channel_ ||
+      message_data_channel_->state() !=
+          webrtc::DataChannelInterface::DataState::kOpen ||
+      message_data_channel_->buffered_amount() > kMaxMessageBufferedAmount)
+    return false;
+  std::vector<uint8_t> full_batch;
+  {
+    std::lock_guard<std::mutex> lock(message_batchers_mutex_);
+    auto it = message_batchers_.find(receiver);
+    if (it == message_batchers_.end()) {
+      it = message_batchers_
+               .emplace(receiver,
+                        MessageBatcher(receiver, kMaxMessageBatchSize))
+               .first;
+    }
+    if (!it->second.Add(data, size, full_batch))
+      return false;
+    if (message_batch_interval_ms_ <= 0) {
+      full_batch = it->second.Flush();
+    } else if (message_flush_timer_ == TimerService::kInvalidTimerId) {
+      // Timer tasks run without TimerService's lock, so it's safe to schedule
+      // with |message_batchers_mutex_| held. DataChannel::Send blocks on
+      // signaling thread, so it's not called on TimerService's thread.
+      std::weak_ptr<ConferencePeerConnectionChannel> weak_this =
+          shared_from_this();
+      std::shared_ptr<rtc::TaskQueue> event_queue = event_queue_;
+      message_flush_timer_ = TimerService::Get().Schedule(
+          message_batch_interval_ms_, [weak_this, event_queue] {
+            event_queue->PostTask([weak_this] {
+              auto that = weak_this.lock();
+              if (that)
+                that->FlushMessageBatches();
+            });
+          });
+    }
+  }
+  if (!full_batch.empty())
+    SendMessageBatch(full_batch);
+  return true;
+}
+void ConferencePeerConnectionChannel::SendMessageBatch(
+    const std::vector<uint8_t>& batch) {
+  rtc::CopyOnWriteBuffer buffer(batch.data(), batch.size());
+  message_data_channel_->Send(webrtc::DataBuffer(buffer, true));
+}
+void ConferencePeerConnectionChannel::FlushMessageBatches() {
+  std::vector<std::vector<uint8_t>> batches;
+  {
+    std::lock_guard<std::mutex> lock(message_batchers_mutex_);
+    message_flush_timer_ = TimerService::kInvalidTimerId;
+    for (auto& batcher : message_batchers_) {
+      if (!batcher.second.Empty())
+        batches.push_back(batcher.second.Flush());
+    }
+  }
+  for (const auto& batch : batches) {
+    SendMessageBatch(batch);
+  }
+}
 void ConferencePeerConnectionChannel::Unpublish(
     const std::string& session_id,
     std::function<void()> on_success,
@@ -740,6 +1509,10 @@ void ConferencePeerConnectionChannel::Unsubscribe(
     const std::string& session_id,
     std::function<void()> on_success,
     std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  if (multiplexed_) {
+    RemoveSubscription(session_id, on_success, on_failure);
+    return;
+  }
   if (session_id != GetSessionId()) {
     RTC_LOG(LS_ERROR) << "Subscription ID mismatch.";
     if (on_failure != nullptr) {
@@ -866,6 +1639,124 @@ void ConferencePeerConnectionChannel::GetConnectionStats(
   }
 }
 
+void ConferencePeerConnectionChannel::UpdateEncodingParameters(
+    const std::vector<RtpEncodingParameters>& parameters,
+    std::function<void()> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  if (!published_stream_) {
+    if (on_failure != nullptr) {
+      event_queue_->PostTask([on_failure]() {
+        std::unique_ptr<Exception> e(
+            new Exception(ExceptionType::kConferenceUnknown,
+                          "No stream is published in the session."));
+        on_failure(std::move(e));
+      });
+    }
+    return;
+  }
+  webrtc::RTCError error = SetVideoEncodingParameters("", parameters);
+  if (!error.ok()) {
+    if (on_failure != nullptr) {
+      std::string message(error.message());
+      event_queue_->PostTask([on_failure, message]() {
+        std::unique_ptr<Exception> e(
+            new Exception(ExceptionType::kConferenceInvalidParam, message));
+        on_failure(std::move(e));
+      });
+    }
+    return;
+  }
+  if (on_success != nullptr)
+    event_queue_->PostTask([on_success]() { on_success(); });
+}
+
+void ConferencePeerConnectionChannel::OnSubscribedLayersChanged(
+    const std::vector<std::string>& rids) {
+  static const int kLayerDeactivationDelayMs = 3000;
+  {
+    std::lock_guard<std::mutex> lock(subscribed_layers_mutex_);
+    subscribed_layers_known_ = true;
+    subscribed_layers_ = rids;
+  }
+  // Sender parameters are updated on |event_queue_|, since getting and setting
+  // them block on the signaling thread, which neither the signaling channel
+  // nor the timer thread should wait for.
+  std::weak_ptr<ConferencePeerConnectionChannel> weak_this =
+      shared_from_this();
+  // Newly subscribed layers are activated immediately. Enabling a simulcast
+  // stream makes the encoder start it with a key frame.
+  event_queue_->PostTask([weak_this] {
+    auto that = weak_this.lock();
+    if (that)
+      that->ApplySubscribedLayers(false);
+  });
+  TimerService::Get().Cancel(layer_deactivation_timer_);
+  std::shared_ptr<rtc::TaskQueue> event_queue = event_queue_;
+  layer_deactivation_timer_ = TimerService::Get().Schedule(
+      kLayerDeactivationDelayMs, [weak_this, event_queue] {
+        event_queue->PostTask([weak_this] {
+          auto that = weak_this.lock();
+          if (that)
+            that->ApplySubscribedLayers(true);
+        });
+      });
+}
+bool ConferencePeerConnectionChannel::IsEncodingDemanded(
+    const std::string& rid) {
+  std::lock_guard<std::mutex> lock(subscribed_layers_mutex_);
+  if (!subscribed_layers_known_ || rid.empty())
+    return true;
+  return std::find(subscribed_layers_.begin(), subscribed_layers_.end(),
+                   rid) != subscribed_layers_.end();
+}
+void ConferencePeerConnectionChannel::ApplySubscribedLayers(bool deactivate) {
+  // Only a publishing channel has senders with video tracks, so
+  // |published_stream_|, which is set on another thread, is not checked.
+  if (!peer_connection_)
+    return;
+  std::vector<RtpEncodingParameters> encoding_parameters =
+      GetVideoEncodingParameters();
+  for (auto sender : peer_connection_->GetSenders()) {
+    auto sender_track = sender->track();
+    if (sender_track == nullptr ||
+        sender_track->kind() != webrtc::MediaStreamTrackInterface::kVideoKind)
+      continue;
+    webrtc::RtpParameters rtp_parameters = sender->GetParameters();
+    // Only simulcast layers are managed. A single encoding is never
+    // deactivated.
+    if (rtp_parameters.encodings.size() < 2)
+      continue;
+    bool changed = false;
+    for (auto& encoding : rtp_parameters.encodings) {
+      if (encoding.rid.empty())
+        continue;
+      // Layers deactivated by application stay inactive.
+      bool enabled = true;
+      for (const auto& parameters : encoding_parameters) {
+        if (parameters.rid == encoding.rid)
+          enabled = parameters.active;
+      }
+      bool active = enabled && IsEncodingDemanded(encoding.rid);
+      if (active && !encoding.active) {
+        RTC_LOG(LS_INFO) << "Activate simulcast layer " << encoding.rid;
+        encoding.active = true;
+        changed = true;
+      } else if (!active && encoding.active && deactivate) {
+        RTC_LOG(LS_INFO) << "Deactivate simulcast layer " << encoding.rid
+                         << " since it's not subscribed.";
+        encoding.active = false;
+        changed = true;
+      }
+    }
+    if (!changed)
+      continue;
+    webrtc::RTCError error = sender->SetParameters(rtp_parameters);
+    if (!error.ok()) {
+      RTC_LOG(LS_WARNING) << "Failed to update simulcast layers: "
+                          << error.message();
+    }
+  }
+}
 void ConferencePeerConnectionChannel::GetStats(
     std::function<void(const webrtc::StatsReports& reports)> on_success,
     std::function<void(std::unique_ptr<Exception>)> on_failure) {
@@ -977,6 +1868,24 @@ std::string ConferencePeerConnectionChannel::GetSubStreamId() {
     return "";
   }
 }
+std::string ConferencePeerConnectionChannel::GetSubStreamId(
+    const std::string& session_id) {
+  if (!multiplexed_)
+    return GetSubStreamId();
+  std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+  auto it = multiplexed_subscriptions_.find(session_id);
+  if (it == multiplexed_subscriptions_.end())
+    return "";
+  return it->second.stream->Id();
+}
+bool ConferencePeerConnectionChannel::HasSubscription(
+    const std::string& session_id) {
+  if (!multiplexed_)
+    return false;
+  std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+  return multiplexed_subscriptions_.find(session_id) !=
+         multiplexed_subscriptions_.end();
+}
 void ConferencePeerConnectionChannel::SetSessionId(const std::string& id) {
   RTC_LOG(LS_INFO) << "Setting session ID for current channel";
   session_id_ = id;
@@ -1003,45 +1912,17 @@ void ConferencePeerConnectionChannel::SendPublishMessage(
           transceiver_init.stream_ids.push_back(stream->MediaStream()->id());
           transceiver_init.direction =
               webrtc::RtpTransceiverDirection::kSendOnly;
-          if (configuration_.video.size() > 0 &&
-              configuration_.video[0].rtp_encoding_parameters.size() != 0) {
-            for (auto encoding :
-                 configuration_.video[0].rtp_encoding_parameters) {
-              webrtc::RtpEncodingParameters param;
-              if (encoding.rid != "")
-                param.rid = encoding.rid;
-              if (encoding.max_bitrate_bps != 0)
-                param.max_bitrate_bps = encoding.max_bitrate_bps;
-              if (encoding.max_framerate != 0)
-                param.max_framerate = encoding.max_framerate;
-              if (encoding.scale_resolution_down_by > 0)
-                param.scale_resolution_down_by =
-                    encoding.scale_resolution_down_by;
-              if (encoding.num_temporal_layers > 0 &&
-                  encoding.num_temporal_layers <= 4) {
-                param.num_temporal_layers = encoding.num_temporal_layers;
-              }
-              if (encoding.priority != owt::base::NetworkPriority::kDefault) {
-                switch (encoding.priority) {
-                  case owt::base::NetworkPriority::kVeryLow:
-                    param.network_priority = webrtc::Priority::kVeryLow;
-                    break;
-                  case owt::base::NetworkPriority::kLow:
-                    param.network_priority = webrtc::Priority::kLow;
-                    break;
-                  case owt::base::NetworkPriority::kMedium:
-                    param.network_priority = webrtc::Priority::kMedium;
-                    break;
-                  case owt::base::NetworkPriority::kHigh:
-                    param.network_priority = webrtc::Priority::kHigh;
-                    break;
-                  default:
-                    break;
-                }
-              }
-              param.active = encoding.active;
-              transceiver_init.send_encodings.push_back(param);
+          for (const auto& encoding : GetVideoEncodingParameters()) {
+            webrtc::RtpEncodingParameters param;
+            if (encoding.rid != "")
+              param.rid = encoding.rid;
+            // Stream level max bitrate is applied by ApplyBitrateSettings.
+            MediaUtils::ApplyRtpEncodingParameters(encoding, 0, param);
+            if (encoding.num_temporal_layers > 0 &&
+                encoding.num_temporal_layers <= 4) {
+              param.num_temporal_layers = encoding.num_temporal_layers;
             }
+            transceiver_init.send_encodings.push_back(param);
           }
           AddTransceiver(track, transceiver_init);
         }
@@ -1051,11 +1932,42 @@ void ConferencePeerConnectionChannel::SendPublishMessage(
 }
 void ConferencePeerConnectionChannel::OnNetworksChanged() {
   RTC_LOG(LS_INFO) << "ConferencePeerConnectionChannel::OnNetworksChanged";
+  PeerConnectionChannel::OnNetworksChanged();
+}
+void ConferencePeerConnectionChannel::RestartIce() {
+  IceRestart();
+}
+std::weak_ptr<PeerConnectionChannel>
+ConferencePeerConnectionChannel::GetWeakPtr() {
+  return weak_from_this();
+}
+void ConferencePeerConnectionChannel::OnIceConnectionRecovered(
+    int64_t freeze_duration_ms) {
+  std::lock_guard<std::mutex> lock(observers_mutex_);
+  for (auto its = observers_.begin(); its != observers_.end(); ++its) {
+    (*its).get().OnConnectionRecovered(session_id_, freeze_duration_ms);
+  }
 }
 void ConferencePeerConnectionChannel::OnStreamError(
     const std::string& error_message) {
   std::shared_ptr<const Exception> e(
       new Exception(ExceptionType::kConferenceUnknown, error_message));
+  if (multiplexed_) {
+    // The shared PeerConnection fails all subscriptions carried by it.
+    std::vector<std::shared_ptr<Stream>> error_streams;
+    {
+      std::lock_guard<std::mutex> lock(multiplexed_mutex_);
+      for (auto& subscription : multiplexed_subscriptions_) {
+        error_streams.push_back(subscription.second.stream);
+      }
+    }
+    for (auto& error_stream : error_streams) {
+      for (auto its = observers_.begin(); its != observers_.end(); ++its) {
+        (*its).get().OnStreamError(error_stream, e);
+      }
+    }
+    return;
+  }
   std::shared_ptr<Stream> error_stream;
   for (auto its = observers_.begin(); its != observers_.end(); ++its) {
     RTC_LOG(LS_INFO) << "On stream error.";
@@ -1091,6 +2003,11 @@ void ConferencePeerConnectionChannel::ResetCallbacks() {
   subscribe_success_callback_ = nullptr;
   failure_callback_ = nullptr;
 }
+void ConferencePeerConnectionChannel::Close() {
+  closed_ = true;
+  connected_ = false;
+  ClosePeerConnection();
+}
 void ConferencePeerConnectionChannel::ClosePeerConnection() {
   RTC_LOG(LS_INFO) << "Close peer connection.";
   std::lock_guard<std::mutex> locker(release_mutex_);
@@ -3,11 +3,15 @@
 // SPDX-License-Identifier: Apache-2.0
 #ifndef OWT_CONFERENCE_CONFERENCEPEERCONNECTIONCHANNEL_H_
 #define OWT_CONFERENCE_CONFERENCEPEERCONNECTIONCHANNEL_H_
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <chrono>
+#include <deque>
 #include <random>
+#include <vector>
+#include "talk/owt/sdk/base/messagebatcher.h"
 #include "talk/owt/sdk/base/peerconnectionchannel.h"
 #include "talk/owt/sdk/conference/conferencesocketsignalingchannel.h"
 #include "talk/owt/sdk/include/cpp/owt/base/stream.h"
@@ -18,6 +22,10 @@ namespace conference {
 using namespace owt::base;
 // An instance of ConferencePeerConnectionChannel manages a PeerConnection with
 // MCU as well as it's signaling through Socket.IO.
+// A channel carries a single publication or subscription by default. A
+// multiplexed channel carries multiple subscriptions on one bundled
+// PeerConnection, they are added and removed by AddSubscription and
+// Unsubscribe.
 class ConferencePeerConnectionChannel
     : public PeerConnectionChannel,
       public std::enable_shared_from_this<ConferencePeerConnectionChannel> {
@@ -25,8 +33,14 @@ class ConferencePeerConnectionChannel
   explicit ConferencePeerConnectionChannel(
       PeerConnectionChannelConfiguration& configuration,
       std::shared_ptr<ConferenceSocketSignalingChannel> signaling_channel,
-      std::shared_ptr<rtc::TaskQueue> event_queue);
+      std::shared_ptr<rtc::TaskQueue> event_queue,
+      bool multiplexed = false);
   ~ConferencePeerConnectionChannel();
+  // Replace codec preferences of the channel. It's used when a channel is
+  // created before knowing the stream to be published or subscribed, and should
+  // be called before Publish or Subscribe.
+  void SetCodecPreferences(const std::vector<AudioEncodingParameters>& audio,
+                           const std::vector<VideoEncodingParameters>& video);
   // Add a ConferencePeerConnectionChannel observer so it will be notified when
   // this object have some events.
   void AddObserver(ConferencePeerConnectionChannelObserver& observer);
@@ -38,6 +52,24 @@ class ConferencePeerConnectionChannel
       std::shared_ptr<LocalStream> stream,
       std::function<void(std::string)> on_success,
       std::function<void(std::unique_ptr<Exception>)> on_failure);
+  // Open a data channel with MCU for binary messages. It's unordered and
+  // unreliable, so a lost message doesn't block later ones. Messages sent
+  // within |batch_interval_ms| are sent in one batch. Received messages are
+  // passed to |on_message| on event queue.
+  // No released MCU accepts data only publications or routes message
+  // batches, so ConferenceClient doesn't expose it yet.
+  void PublishMessageChannel(
+      int batch_interval_ms,
+      std::function<void(const std::string&, const std::vector<uint8_t>&)>
+          on_message,
+      std::function<void(std::string)> on_success,
+      std::function<void(std::unique_ptr<Exception>)> on_failure);
+  // Send a binary message to |receiver| through the message channel. Empty
+  // |receiver| for all participants. Returns false if the message channel is
+  // not open, it's congested, or the message is too large.
+  bool SendMessageData(const std::string& receiver,
+                       const uint8_t* data,
+                       size_t size);
   // Unpublish a local stream to the conference.
   void Unpublish(
       const std::string& session_id,
@@ -49,7 +81,29 @@ class ConferencePeerConnectionChannel
       const SubscribeOptions& options,
       std::function<void(std::string)> on_success,
       std::function<void(std::unique_ptr<Exception>)> on_failure);
-  // Unsubscribe a remote stream from the conference.
+  // A stream to be subscribed over a multiplexed channel. |on_success| is
+  // triggered with the subscription ID.
+  struct SubscriptionRequest {
+    std::shared_ptr<RemoteStream> stream;
+    SubscribeOptions options;
+    std::function<void(std::string)> on_success;
+    std::function<void(std::unique_ptr<Exception>)> on_failure;
+  };
+  // Subscribe a stream over a multiplexed channel. Negotiations on a
+  // multiplexed channel are serialized, so subscriptions requested during
+  // another negotiation are queued. |on_success| is triggered with the
+  // subscription ID.
+  void AddSubscription(
+      std::shared_ptr<RemoteStream> stream,
+      const SubscribeOptions& options,
+      std::function<void(std::string)> on_success,
+      std::function<void(std::unique_ptr<Exception>)> on_failure);
+  // Subscribe |requests| over a multiplexed channel with one renegotiation.
+  // Each request succeeds or fails on its own.
+  void AddSubscriptions(const std::vector<SubscriptionRequest>& requests);
+  // Unsubscribe a remote stream from the conference. For a multiplexed channel,
+  // transceivers of the subscription are set to inactive and reused by later
+  // subscriptions.
   void Unsubscribe(
       const std::string& session_id,
       std::function<void()> on_success,
@@ -90,10 +144,26 @@ class ConferencePeerConnectionChannel
   void Stop(
       std::function<void()> on_success,
       std::function<void(std::unique_ptr<Exception>)> on_failure);
+  // Close PeerConnection without sending unpublish or unsubscribe to MCU,
+  // which releases all sessions of a participant when it leaves.
+  void Close();
+  // Queue for callbacks and events of this channel.
+  std::shared_ptr<rtc::TaskQueue> EventQueue() const { return event_queue_; }
   // Initialize an ICE restarat.
   void IceRestart();
   // Get the associated stream id if it is a subscription channel.
   std::string GetSubStreamId();
+  // Get the stream id of subscription |session_id|. It's the same as
+  // GetSubStreamId() if the channel is not multiplexed.
+  std::string GetSubStreamId(const std::string& session_id);
+  // Return true if this channel carries multiple subscriptions.
+  bool IsMultiplexed() const { return multiplexed_; }
+  // Return true if subscription |session_id| is carried by this multiplexed
+  // channel.
+  bool HasSubscription(const std::string& session_id);
+  // Called when MCU reports a subscription on multiplexed channel is ready, or
+  // failed if |ready| is false.
+  void OnSubscriptionProgress(const std::string& session_id, bool ready);
   // Set stream's session ID. This ID is returned by MCU per publish/subscribe.
   void SetSessionId(const std::string& id);
   // Get published or subscribed stream's publicationID or subcriptionID.
@@ -110,6 +180,16 @@ class ConferencePeerConnectionChannel
   void GetStats(
       std::function<void(const webrtc::StatsReports& reports)> on_success,
       std::function<void(std::unique_ptr<Exception>)> on_failure);
+  // Update encoding parameters of published video. No renegotiation is
+  // needed.
+  void UpdateEncodingParameters(
+      const std::vector<RtpEncodingParameters>& parameters,
+      std::function<void()> on_success,
+      std::function<void(std::unique_ptr<Exception>)> on_failure);
+  // Called when MCU reports simulcast layers of published video which are
+  // subscribed by someone. Other layers are deactivated, and they are
+  // activated again once subscribed.
+  void OnSubscribedLayersChanged(const std::vector<std::string>& rids);
   // Called when MCU reports stream/connection is failed or ICE failed.
   void OnStreamError(const std::string& error_message);
  protected:
@@ -122,9 +202,13 @@ class ConferencePeerConnectionChannel
       rtc::scoped_refptr<MediaStreamInterface> stream) override;
   virtual void OnRemoveStream(
       rtc::scoped_refptr<MediaStreamInterface> stream) override;
+  virtual void OnTrack(
+      rtc::scoped_refptr<webrtc::RtpTransceiverInterface> transceiver) override;
   virtual void OnDataChannel(
       rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel) override;
+  virtual void OnDataChannelMessage(const webrtc::DataBuffer& buffer) override;
   virtual void OnRenegotiationNeeded() override;
+  bool IsEncodingDemanded(const std::string& rid) override;
   virtual void OnIceConnectionChange(
       webrtc::PeerConnectionInterface::IceConnectionState new_state) override;
   virtual void OnIceGatheringChange(
@@ -142,9 +226,95 @@ class ConferencePeerConnectionChannel
   virtual void OnSetRemoteSessionDescriptionSuccess() override;
   virtual void OnSetRemoteSessionDescriptionFailure(const std::string& error) override;
   virtual void OnNetworksChanged() override;
+  virtual void RestartIce() override;
+  virtual void OnIceConnectionRecovered(int64_t freeze_duration_ms) override;
+  virtual std::weak_ptr<PeerConnectionChannel> GetWeakPtr() override;
   enum SessionState : int;
   enum NegotiationState : int;
  private:
+  // A receive only transceiver on a multiplexed channel, and the mid of its
+  // m-line. |mid| is empty until the transceiver is negotiated.
+  struct ReceiveTransceiver {
+    std::string mid;
+    rtc::scoped_refptr<webrtc::RtpTransceiverInterface> transceiver;
+  };
+  // A subscription carried by a multiplexed channel.
+  struct MultiplexedSubscription {
+    std::shared_ptr<RemoteStream> stream;
+    std::vector<ReceiveTransceiver> transceivers;
+    rtc::scoped_refptr<MediaStreamInterface> media_stream;
+    size_t received_track_count = 0;
+    bool server_ready = false;
+    // Reset once the subscription succeeded or failed.
+    std::function<void(std::string)> on_success;
+    std::function<void(std::unique_ptr<Exception>)> on_failure;
+  };
+  // Subscriptions added in one negotiation. Requests are answered on
+  // signaling channel's queue, so following members are guarded by |mutex|.
+  struct SubscriptionBatch {
+    std::vector<SubscriptionRequest> requests;
+    // Transceivers and track options of each request.
+    std::vector<std::vector<ReceiveTransceiver>> transceivers;
+    std::vector<sio::message::ptr> tracks_options;
+    std::mutex mutex;
+    size_t sent_count = 0;
+    // Number of requests not answered yet.
+    size_t pending_count = 0;
+    // Subscription IDs of accepted requests.
+    std::vector<std::string> session_ids;
+  };
+  // Add transceivers of |requests| and create an offer for them.
+  void DoAddSubscriptions(std::vector<SubscriptionRequest> requests);
+  // Called when the offer of |batch| is set as local description, so mids of
+  // its transceivers are known. Send requests of |batch| to MCU.
+  void OnSubscriptionOfferApplied(std::shared_ptr<SubscriptionBatch> batch);
+  // Fail all requests of the batch in negotiation with |message|.
+  void FailSubscriptionBatch(const std::string& message);
+  // Fail subscriptions in |session_ids| which are not established yet with
+  // |message|. They're unsubscribed on MCU, and their transceivers are
+  // released.
+  void FailPendingSubscriptions(const std::vector<std::string>& session_ids,
+                                const std::string& message);
+  // Send requests in |batch| from |index|. Until the shared transport is
+  // created by the first accepted request, requests are sent one by one.
+  void SendSubscriptionRequests(std::shared_ptr<SubscriptionBatch> batch,
+                                size_t index);
+  // Called when the request at |index| of |batch| is answered. |session_id|
+  // is empty if it's rejected. Send the offer once every request is answered,
+  // or roll it back if all of them are rejected.
+  void OnSubscriptionRequestCompleted(std::shared_ptr<SubscriptionBatch> batch,
+                                      size_t index,
+                                      const std::string& session_id,
+                                      const std::string& transport_id,
+                                      std::unique_ptr<Exception> error);
+  void OnSubscriptionAccepted(
+      const std::string& session_id,
+      const std::string& transport_id,
+      std::shared_ptr<RemoteStream> stream,
+      const std::vector<ReceiveTransceiver>& transceivers,
+      std::function<void(std::string)> on_success,
+      std::function<void(std::unique_ptr<Exception>)> on_failure);
+  void RemoveSubscription(
+      const std::string& session_id,
+      std::function<void()> on_success,
+      std::function<void(std::unique_ptr<Exception>)> on_failure);
+  // Trigger success callback of |subscription| if server is ready and all its
+  // tracks are received. Caller should hold |multiplexed_mutex_|.
+  void MaybeCompleteSubscription(const std::string& session_id,
+                                 MultiplexedSubscription& subscription);
+  // Reuse an idle transceiver of |media_type|, or create a new one.
+  ReceiveTransceiver AcquireReceiveTransceiver(cricket::MediaType media_type);
+  // Set |transceivers| to inactive and put them back to idle list.
+  void ReleaseReceiveTransceivers(
+      const std::vector<ReceiveTransceiver>& transceivers);
+  // Run |negotiation| if there is no negotiation in progress, otherwise queue
+  // it. A negotiation should call OnNegotiationCompleted when it's done.
+  void EnqueueNegotiation(std::function<void()> negotiation);
+  void OnNegotiationCompleted();
+  // Send local description to MCU.
+  void SendLocalDescription();
+  // Discard local offer not sent to MCU.
+  void RollbackLocalDescription();
   // Publish and/or unpublish all streams in pending stream list.
   void ClosePeerConnection();  // Stop session and clean up.
   // Returns true if |pointer| is not nullptr. Otherwise, return false and
@@ -171,6 +341,13 @@ class ConferencePeerConnectionChannel
   // failure_callback_ to nullptr.
   void ResetCallbacks();
   bool IsMediaStreamEnded(MediaStreamInterface* stream) const;
+  // Activate subscribed simulcast layers of published video. Layers not
+  // subscribed are deactivated if |deactivate| is true. Runs on
+  // |event_queue_|.
+  void ApplySubscribedLayers(bool deactivate);
+  void SendMessageBatch(const std::vector<uint8_t>& batch);
+  // Send all pending message batches.
+  void FlushMessageBatches();
   std::shared_ptr<ConferenceSocketSignalingChannel> signaling_channel_;
   std::string session_id_;   //session ID is 1:1 mapping to the subscribed/published stream.
   webrtc::PeerConnectionInterface::SignalingState signaling_state_;
@@ -190,10 +367,14 @@ class ConferencePeerConnectionChannel
   std::vector<sio::message::ptr> ice_candidates_;
   std::mutex candidates_mutex_;
   bool ice_restart_needed_;
+  // Next offer restarts ICE.
+  bool ice_restart_offer_;
   std::mutex observers_mutex_;
   std::vector<std::reference_wrapper<ConferencePeerConnectionChannelObserver>>
       observers_;
   bool connected_;
+  // Set by Close(). MCU is not notified when the channel is destroyed.
+  std::atomic<bool> closed_;
   // Mutex for firing subscription succeed callback.
   std::mutex sub_stream_added_mutex_;
   bool sub_stream_added_;
@@ -201,6 +382,40 @@ class ConferencePeerConnectionChannel
   // Queue for callbacks and events.
   std::shared_ptr<rtc::TaskQueue> event_queue_;
   std::mutex release_mutex_;
+  // Following members are only used by multiplexed channel. |session_id_| of a
+  // multiplexed channel is the ID of transport shared by all subscriptions.
+  const bool multiplexed_;
+  std::mutex multiplexed_mutex_;
+  // Key is subscription ID.
+  std::unordered_map<std::string, MultiplexedSubscription>
+      multiplexed_subscriptions_;
+  // Key is mid, value is subscription ID.
+  std::unordered_map<std::string, std::string> mid_session_map_;
+  // Inactive transceivers which can be reused by new subscriptions.
+  std::vector<ReceiveTransceiver> idle_transceivers_;
+  std::deque<std::function<void()>> pending_negotiations_;
+  bool negotiating_;
+  // Subscriptions waiting for local description of current negotiation.
+  std::shared_ptr<SubscriptionBatch> negotiating_batch_;
+  // Subscriptions accepted in current negotiation, waiting for MCU's answer.
+  std::vector<std::string> answering_session_ids_;
+  // Simulcast layers of published video subscribed by someone. All layers are
+  // considered subscribed until MCU reports.
+  std::mutex subscribed_layers_mutex_;
+  bool subscribed_layers_known_;
+  std::vector<std::string> subscribed_layers_;
+  // Layers are deactivated after a delay, so they don't flap when
+  // subscribers switch between layers.
+  owt::base::TimerService::TimerId layer_deactivation_timer_;
+  // Following members are only used by message channel.
+  rtc::scoped_refptr<webrtc::DataChannelInterface> message_data_channel_;
+  int message_batch_interval_ms_;
+  std::function<void(const std::string&, const std::vector<uint8_t>&)>
+      message_callback_;
+  std::mutex message_batchers_mutex_;
+  // Key is receiver ID.
+  std::unordered_map<std::string, MessageBatcher> message_batchers_;
+  owt::base::TimerService::TimerId message_flush_timer_;
 };
 }
 }
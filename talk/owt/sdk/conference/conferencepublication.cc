@@ -123,6 +123,24 @@ void ConferencePublication::GetNativeStats(
      that->GetStats(id_, on_success, on_failure);
    }
 }
+void ConferencePublication::UpdateEncodingParameters(
+    const std::vector<RtpEncodingParameters>& parameters,
+    std::function<void()> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  auto that = conference_client_.lock();
+  if (that == nullptr || ended_) {
+    std::string failure_message("Session ended.");
+    if (on_failure != nullptr && event_queue_.get()) {
+      event_queue_->PostTask([on_failure, failure_message]() {
+        std::unique_ptr<Exception> e(
+            new Exception(ExceptionType::kConferenceUnknown, failure_message));
+        on_failure(std::move(e));
+      });
+    }
+  } else {
+    that->UpdateEncodingParameters(id_, parameters, on_success, on_failure);
+  }
+}
 void ConferencePublication::Stop() {
   auto that = conference_client_.lock();
   if (that == nullptr || ended_) {
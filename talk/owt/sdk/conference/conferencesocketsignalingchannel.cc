@@ -2,7 +2,6 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 #include <iostream>
-#include <thread>
 #include <algorithm>
 #include <ctime>
 #if defined(WEBRTC_IOS)
@@ -12,6 +11,7 @@
 #include "talk/owt/sdk/base/stringutils.h"
 #include "talk/owt/sdk/base/sysinfo.h"
 #include "talk/owt/sdk/conference/conferencesocketsignalingchannel.h"
+#include "webrtc/api/task_queue/default_task_queue_factory.h"
 #include "webrtc/rtc_base/third_party/base64/base64.h"
 #include "webrtc/rtc_base/checks.h"
 #include "webrtc/rtc_base/logging.h"
@@ -63,16 +63,101 @@ const std::string kEventNameConnectionFailed = "connection_failed";
 // 00:00:00.
 const uint64_t kMachLinuxTimeDelta = 978307200;
 #endif
+// Coalescing key for stream control and subscription control messages.
+// Pause and play on the same track set its state, so they share a key.
+static std::string ControlCoalescingKey(const std::string& event,
+                                        const std::string& id,
+                                        const std::string& action,
+                                        const std::string& operation) {
+  std::string category = operation;
+  if (operation == "pause" || operation == "play") {
+    category = "state";
+  } else if (operation == "mix" || operation == "unmix") {
+    category = "mix";
+  }
+  return event + ":" + id + ":" + category + ":" + action;
+}
+// Messages with smaller priority are re-emitted first after reconnection.
+static int MessagePriority(const std::string& name) {
+  if (name == kEventNameSignalingMessage || name == kEventNamePublish ||
+      name == kEventNameSubscribe || name == kEventNameUnpublish ||
+      name == kEventNameUnsubscribe) {
+    return 0;
+  }
+  if (name == kEventNameStreamControl ||
+      name == kEventNameSubscriptionControl) {
+    return 1;
+  }
+  return 2;
+}
+// ID of the session a message operates on, or empty if it doesn't operate on
+// an existing session.
+static std::string MessageSessionId(const sio::message::list& message) {
+  if (message.size() == 0)
+    return "";
+  sio::message::ptr payload = message.at(0);
+  if (!payload || payload->get_flag() != sio::message::flag_object)
+    return "";
+  auto& payload_map = payload->get_map();
+  auto id_it = payload_map.find("id");
+  if (id_it == payload_map.end() || !id_it->second ||
+      id_it->second->get_flag() != sio::message::flag_string)
+    return "";
+  return id_it->second->get_string();
+}
+// Object field |key| of |message|, or nullptr if it's not an object.
+static sio::message::ptr ObjectField(const sio::message::ptr& message,
+                                     const std::string& key) {
+  if (!message || message->get_flag() != sio::message::flag_object)
+    return nullptr;
+  auto& map = message->get_map();
+  auto it = map.find(key);
+  if (it == map.end() || !it->second ||
+      it->second->get_flag() != sio::message::flag_object)
+    return nullptr;
+  return it->second;
+}
+// Copy of object |message|'s own fields. Values are shared.
+static sio::message::ptr CopyObject(const sio::message::ptr& message) {
+  sio::message::ptr copy = sio::object_message::create();
+  copy->get_map() = message->get_map();
+  return copy;
+}
 const int kReconnectionAttempts = 10;
-const int kReconnectionDelay = 2000;
+// The first reconnection attempt is made immediately. Following attempts are
+// delayed exponentially from |kReconnectionBaseDelay| to
+// |kReconnectionMaxDelay|, with random jitter. Unit: ms.
+const int kReconnectionBaseDelay = 500;
+const int kReconnectionMaxDelay = 8000;
+// Log a warning if an ack callback waits longer than this in queue.
+const int64_t kAckCallbackDelayWarningUs = 100000;
+// Upper bounds of request round trip time histogram buckets, in milliseconds.
+const std::vector<int> kRequestRttBucketBoundsMs = {25,  50,  100,  200,
+                                                    400, 800, 1600, 3200};
 ConferenceSocketSignalingChannel::ConferenceSocketSignalingChannel()
     : socket_client_(new sio::client()),
       reconnection_ticket_(""),
+      refresh_ticket_timer_(owt::base::TimerService::kInvalidTimerId),
+      reconnection_timer_(owt::base::TimerService::kInvalidTimerId),
+      random_engine_(std::random_device()()),
       participant_id_(""),
       reconnection_attempted_(0),
       is_reconnection_(false),
-      outgoing_message_id_(1) {}
+      holding_messages_(false),
+      outgoing_message_id_(1),
+      default_request_timeout_(0),
+      timed_out_request_count_(0),
+      request_rtt_histogram_(kRequestRttBucketBoundsMs.size() + 1, 0),
+      ack_metrics_(std::make_shared<AckCallbackMetrics>()) {
+  auto task_queue_factory = webrtc::CreateDefaultTaskQueueFactory();
+  ack_queue_ =
+      std::make_unique<rtc::TaskQueue>(task_queue_factory->CreateTaskQueue(
+          "ConferenceSignalingAckQueue",
+          webrtc::TaskQueueFactory::Priority::NORMAL));
+}
 ConferenceSocketSignalingChannel::~ConferenceSocketSignalingChannel() {
+  owt::base::TimerService::Get().Cancel(refresh_ticket_timer_);
+  owt::base::TimerService::Get().Cancel(reconnection_timer_);
   delete socket_client_;
 }
 void ConferenceSocketSignalingChannel::AddObserver(
@@ -116,6 +201,11 @@ void ConferenceSocketSignalingChannel::Connect(
   }
   reconnection_ticket_ = "";
   is_reconnection_ = false;
+  {
+    // Login is sent without waiting for a relogin of previous connection.
+    std::lock_guard<std::mutex> lock(outgoing_message_mutex_);
+    holding_messages_ = false;
+  }
   Json::Value json_token;
   Json::Reader reader;
   if (!reader.parse(token_decoded, json_token)) {
@@ -133,37 +223,25 @@ void ConferenceSocketSignalingChannel::Connect(
   std::weak_ptr<ConferenceSocketSignalingChannel> weak_this =
       shared_from_this();
   socket_client_->socket();
-  socket_client_->set_reconnect_attempts(kReconnectionAttempts);
-  socket_client_->set_reconnect_delay(kReconnectionDelay);
+  // Reconnection is scheduled by this class, so the delay of each attempt is
+  // under control.
+  socket_client_->set_reconnect_attempts(0);
   socket_client_->set_socket_close_listener(
       [weak_this](std::string const& nsp) {
         RTC_LOG(LS_INFO) << "Socket.IO disconnected.";
         auto that = weak_this.lock();
-        if (that && (that->reconnection_attempted_ >= kReconnectionAttempts ||
-                     that->disconnect_complete_)) {
+        if (that && !that->ScheduleReconnection()) {
+          // Messages held for relogin will never be sent.
+          that->DropQueuedMessages();
           that->TriggerOnServerDisconnected();
         }
       });
   socket_client_->set_fail_listener([weak_this]() {
     RTC_LOG(LS_ERROR) << "Socket.IO connection failed.";
     auto that = weak_this.lock();
-    if (that) {
+    if (that && !that->ScheduleReconnection()) {
       that->DropQueuedMessages();
-      if (that->reconnection_attempted_ >= kReconnectionAttempts) {
-        that->TriggerOnServerDisconnected();
-      }
-    }
-  });
-  socket_client_->set_reconnecting_listener([weak_this]() {
-    RTC_LOG(LS_INFO) << "Socket.IO reconnecting.";
-    auto that = weak_this.lock();
-    if (that) {
-      if (that->reconnection_ticket_ != "") {
-        // It will be reset when a reconnection is success (open listener) or
-        // fail (fail listener).
-        that->is_reconnection_ = true;
-        that->reconnection_attempted_++;
-      }
+      that->TriggerOnServerDisconnected();
     }
   });
   socket_client_->set_open_listener([=](void) {
@@ -276,6 +354,7 @@ void ConferenceSocketSignalingChannel::Connect(
               OnReconnectionTicket(message->get_string());
             }
             RTC_LOG(LS_VERBOSE) << "Reconnection success";
+            reconnection_attempted_ = 0;
             DrainQueuedMessages();
           });
     }
@@ -302,7 +381,9 @@ void ConferenceSocketSignalingChannel::Connect(
           }));
   // Store |on_failure| so it can be invoked if connect failed.
   connect_failure_callback_ = on_failure;
-  socket_client_->connect(scheme.append(host));
+  server_host_ = host;
+  server_url_ = scheme.append(host);
+  socket_client_->connect(server_url_);
 }
 void ConferenceSocketSignalingChannel::Disconnect(
     std::function<void()> on_success,
@@ -316,6 +397,8 @@ void ConferenceSocketSignalingChannel::Disconnect(
     // attempt. So we don't return, still try to close socket.
   }
   reconnection_attempted_ = kReconnectionAttempts;
+  owt::base::TimerService::Get().Cancel(refresh_ticket_timer_);
+  owt::base::TimerService::Get().Cancel(reconnection_timer_);
   disconnect_complete_ = on_success;
   if (socket_client_->opened()) {
     // Clear all pending failure callbacks after successful disconnect, don't check resp.
@@ -324,6 +407,9 @@ void ConferenceSocketSignalingChannel::Disconnect(
                                      DropQueuedMessages();
                                      socket_client_->close();
                                    });
+  } else {
+    // Messages held for a reconnection which is canceled.
+    DropQueuedMessages();
   }
 }
 
@@ -425,11 +511,9 @@ void ConferenceSocketSignalingChannel::OnNotificationFromServer(
     }
   } else if (name == kEventNameOnDrop) {
     RTC_LOG(LS_INFO) << "Received drop message.";
-    socket_client_->set_reconnect_attempts(0);
-    std::lock_guard<std::mutex> lock(observer_mutex_);
-    for (auto it = observers_.begin(); it != observers_.end(); ++it) {
-      (*it)->OnServerDisconnected();
-    }
+    // Observers are notified by socket close listener. Don't reconnect.
+    reconnection_attempted_ = kReconnectionAttempts;
+    socket_client_->close();
   }
 }
 
@@ -439,12 +523,19 @@ void ConferenceSocketSignalingChannel::SendSubscriptionUpdateMessage(
   std::function<void(std::unique_ptr<Exception>)> on_failure) {
   std::weak_ptr<ConferenceSocketSignalingChannel> weak_this =
     shared_from_this();
+  std::string coalescing_key;
+  auto id_message = options->get_map()["id"];
+  if (id_message && id_message->get_flag() == sio::message::flag_string) {
+    coalescing_key =
+        kEventNameSubscriptionControl + ":" + id_message->get_string() +
+        ":update";
+  }
   Emit(kEventNameSubscriptionControl, options,
     [weak_this, on_success, on_failure](sio::message::list const& msg) {
     if (auto that = weak_this.lock()) {
       that->OnEmitAck(msg, on_success, on_failure);
     }
-  }, on_failure);
+  }, on_failure, coalescing_key);
 }
 void ConferenceSocketSignalingChannel::SendInitializationMessage(
     sio::message::ptr options,
@@ -552,7 +643,7 @@ void ConferenceSocketSignalingChannel::SendStreamEvent(
            that->OnEmitAck(msg, on_success, on_failure);
          }
        },
-       on_failure);
+       on_failure, event + ":" + stream_id);
 }
 void ConferenceSocketSignalingChannel::SendCustomMessage(
     const std::string& message,
@@ -599,7 +690,9 @@ void ConferenceSocketSignalingChannel::SendStreamControlMessage(
            that->OnEmitAck(msg, on_success, on_failure);
          }
        },
-       on_failure);
+       on_failure,
+       ControlCoalescingKey(kEventNameStreamControl, stream_id, action,
+                            operation));
 }
 void ConferenceSocketSignalingChannel::SendSubscriptionControlMessage(
     const std::string& stream_id,
@@ -622,7 +715,9 @@ void ConferenceSocketSignalingChannel::SendSubscriptionControlMessage(
             that->OnEmitAck(msg, on_success, on_failure);
         }
     },
-        on_failure);
+        on_failure,
+        ControlCoalescingKey(kEventNameSubscriptionControl, stream_id, action,
+                             operation));
 }
 void ConferenceSocketSignalingChannel::Unsubscribe(
     const std::string& id,
@@ -657,8 +752,23 @@ void ConferenceSocketSignalingChannel::OnEmitAck(
   }
   if (ack->get_string() == "success" || ack->get_string() == "ok") {
     if (on_success != nullptr) {
-      std::thread t(on_success);
-      t.detach();
+      std::shared_ptr<AckCallbackMetrics> metrics = ack_metrics_;
+      int64_t queued_time = rtc::TimeMicros();
+      ack_queue_->PostTask([on_success, metrics, queued_time] {
+        int64_t start_time = rtc::TimeMicros();
+        on_success();
+        int64_t queue_delay = start_time - queued_time;
+        if (queue_delay > kAckCallbackDelayWarningUs) {
+          RTC_LOG(LS_WARNING) << "Ack callback waited " << queue_delay / 1000
+                              << "ms in queue.";
+        }
+        std::lock_guard<std::mutex> lock(metrics->mutex);
+        metrics->stats.count++;
+        metrics->stats.total_queue_delay_us += queue_delay;
+        metrics->stats.max_queue_delay_us =
+            std::max(metrics->stats.max_queue_delay_us, queue_delay);
+        metrics->stats.total_run_time_us += rtc::TimeMicros() - start_time;
+      });
     }
   } else {
     RTC_LOG(LS_WARNING) << "Send message to server received negative ack.";
@@ -677,6 +787,11 @@ void ConferenceSocketSignalingChannel::OnEmitAck(
     }
   }
 }
+SignalingAckCallbackStats
+ConferenceSocketSignalingChannel::GetAckCallbackStats() const {
+  std::lock_guard<std::mutex> lock(ack_metrics_->mutex);
+  return ack_metrics_->stats;
+}
 void ConferenceSocketSignalingChannel::OnReconnectionTicket(
     const std::string& ticket) {
   RTC_LOG(LS_VERBOSE) << "On reconnection ticket: " << ticket;
@@ -715,16 +830,56 @@ void ConferenceSocketSignalingChannel::OnReconnectionTicket(
                     << "seconds";
     std::weak_ptr<ConferenceSocketSignalingChannel> weak_this =
         shared_from_this();
-    std::thread([weak_this, delay]() {
-      std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+    owt::base::TimerService& timer_service = owt::base::TimerService::Get();
+    timer_service.Cancel(refresh_ticket_timer_);
+    refresh_ticket_timer_ = timer_service.Schedule(delay, [weak_this]() {
       auto that = weak_this.lock();
       if (!that) {
         return;
       }
       that->RefreshReconnectionTicket();
-    }).detach();
+    });
   }
 }
+bool ConferenceSocketSignalingChannel::ScheduleReconnection() {
+  if (disconnect_complete_ || reconnection_attempted_ >= kReconnectionAttempts)
+    return false;
+  reconnection_attempted_++;
+  if (reconnection_ticket_ != "") {
+    // Relogin instead of login when the new connection is opened, so media
+    // sessions are kept by server.
+    is_reconnection_ = true;
+    // Messages will be sent after relogin.
+    std::lock_guard<std::mutex> lock(outgoing_message_mutex_);
+    holding_messages_ = true;
+  }
+  int delay = ReconnectionDelay(reconnection_attempted_);
+  RTC_LOG(LS_INFO) << "Reconnection attempt " << reconnection_attempted_
+                   << " in " << delay << "ms.";
+  std::weak_ptr<ConferenceSocketSignalingChannel> weak_this =
+      shared_from_this();
+  reconnection_timer_ =
+      owt::base::TimerService::Get().Schedule(delay, [weak_this]() {
+        auto that = weak_this.lock();
+        if (that) {
+          that->socket_client_->connect(that->server_url_);
+        }
+      });
+  return true;
+}
+int ConferenceSocketSignalingChannel::ReconnectionDelay(int attempt) {
+  if (attempt <= 1)
+    return 0;
+  int delay = kReconnectionMaxDelay;
+  if (attempt - 2 < 5) {
+    delay = std::min(kReconnectionMaxDelay,
+                     kReconnectionBaseDelay << (attempt - 2));
+  }
+  // Randomize delay in [delay/2, delay] so clients dropped at the same time
+  // don't reconnect at the same time.
+  std::uniform_int_distribution<int> jitter(0, delay / 2);
+  return delay - jitter(random_engine_);
+}
 void ConferenceSocketSignalingChannel::RefreshReconnectionTicket() {
   socket_client_->socket()->emit(
       kEventNameRefreshReconnectionTicket, nullptr,
@@ -759,23 +914,35 @@ void ConferenceSocketSignalingChannel::Emit(
     const sio::message::list& message,
     const std::function<void(sio::message::list const&)> ack,
     const std::function<void(std::unique_ptr<Exception>)>
-        on_failure) {
+        on_failure,
+    const std::string& coalescing_key) {
+  std::weak_ptr<ConferenceSocketSignalingChannel> weak_this =
+      shared_from_this();
   int message_id(0);
   {
     std::lock_guard<std::mutex> lock(outgoing_message_mutex_);
     message_id = outgoing_message_id_++;
+    SioMessage sio_message(message_id, name, message, ack, on_failure,
+                           coalescing_key);
+    sio_message.sent_time_ms = rtc::TimeMillis();
+    auto timeout_it = request_timeouts_.find(name);
+    int timeout = timeout_it == request_timeouts_.end()
+                      ? default_request_timeout_
+                      : timeout_it->second;
+    if (timeout > 0) {
+      sio_message.timeout_timer = owt::base::TimerService::Get().Schedule(
+          timeout, [weak_this, message_id]() {
+            auto that = weak_this.lock();
+            if (that) {
+              that->OnRequestTimeout(message_id);
+            }
+          });
+    }
+    outgoing_messages_.emplace(message_id, sio_message);
+    if (holding_messages_) {
+      return;
+    }
   }
-#if 0
-  std::string sio_name = "signaling";
-  sio::message::ptr request_name = sio::string_message::create(name);
-  sio::message::list new_message(message);
-  new_message.insert(0, request_name);
-#endif
-  // SioMessage sio_message(message_id, sio_name, new_message, ack, on_failure);
-  SioMessage sio_message(message_id, name, message, ack, on_failure);
-  outgoing_messages_.push(sio_message);
-  std::weak_ptr<ConferenceSocketSignalingChannel> weak_this =
-      shared_from_this();
   socket_client_->socket()->emit(
       name, message, [weak_this, message_id](sio::message::list const& msg) {
         RTC_LOG(LS_INFO) << "Received ack for message ID: " << message_id;
@@ -787,59 +954,206 @@ void ConferenceSocketSignalingChannel::Emit(
         std::function<void(sio::message::list const&)> callback(nullptr);
         {
           std::lock_guard<std::mutex> lock(that->outgoing_message_mutex_);
-          if (that->outgoing_messages_.empty()) {
-            //RTC_NOTREACHED();
+          auto it = that->outgoing_messages_.find(message_id);
+          if (it == that->outgoing_messages_.end()) {
+            RTC_LOG(LS_WARNING) << "Original message for " << message_id
+                                << " is not found. It may have timed out.";
             return;
           }
-          /*RTC_DCHECK_EQ(message_id, that->outgoing_messages_.front().id)
-              << "Unordered Socket.IO message.";*/
-          while (that->outgoing_messages_.front().id < message_id) {
-            RTC_LOG(LS_WARNING) << "Potential unordered Socket.IO message.";
-            that->outgoing_messages_.pop();
-          }
-          if (that->outgoing_messages_.front().id > message_id) {
-            RTC_LOG(LS_ERROR) << "Original message for " << message_id
-                          << " is not found.";
-          }
-          callback = that->outgoing_messages_.front().ack;
-          that->outgoing_messages_.pop();
+          owt::base::TimerService::Get().Cancel(it->second.timeout_timer);
+          int64_t rtt = rtc::TimeMillis() - it->second.sent_time_ms;
+          size_t bucket =
+              std::upper_bound(kRequestRttBucketBoundsMs.begin(),
+                               kRequestRttBucketBoundsMs.end(), rtt) -
+              kRequestRttBucketBoundsMs.begin();
+          that->request_rtt_histogram_[bucket]++;
+          callback = it->second.ack;
+          that->outgoing_messages_.erase(it);
         }
         if (callback) {
           callback(msg);
         }
       });
 }
+void ConferenceSocketSignalingChannel::OnRequestTimeout(int message_id) {
+  std::function<void(std::unique_ptr<Exception>)> on_failure;
+  {
+    std::lock_guard<std::mutex> lock(outgoing_message_mutex_);
+    auto it = outgoing_messages_.find(message_id);
+    if (it == outgoing_messages_.end()) {
+      return;
+    }
+    RTC_LOG(LS_WARNING) << "Request " << it->second.name << " (" << message_id
+                        << ") timed out.";
+    on_failure = it->second.on_failure;
+    outgoing_messages_.erase(it);
+    timed_out_request_count_++;
+  }
+  // Not running application code on TimerService's thread. The failure is
+  // ordered with success callbacks of acks.
+  if (on_failure) {
+    ack_queue_->PostTask([on_failure] {
+      std::unique_ptr<Exception> e(
+          new Exception(ExceptionType::kConferenceTimeout,
+                        "Timeout while waiting for server's response."));
+      on_failure(std::move(e));
+    });
+  }
+}
 void ConferenceSocketSignalingChannel::DropQueuedMessages() {
-  // TODO(jianjunz): Trigger on_failure in another thread. In current
-  // implementation, failure callback MUST NOT acquire
-  // |outgoing_message_mutex_|. Otherwise, deadlock may happen.
-  std::lock_guard<std::mutex> lock(outgoing_message_mutex_);
-  while (!outgoing_messages_.empty()) {
-    if (outgoing_messages_.front().on_failure != nullptr) {
+  // Failure callbacks are triggered after releasing |outgoing_message_mutex_|,
+  // so they're able to send new messages.
+  std::map<int, SioMessage> dropped_messages;
+  {
+    std::lock_guard<std::mutex> lock(outgoing_message_mutex_);
+    std::swap(dropped_messages, outgoing_messages_);
+    holding_messages_ = false;
+  }
+  for (auto& message : dropped_messages) {
+    owt::base::TimerService::Get().Cancel(message.second.timeout_timer);
+    if (message.second.on_failure != nullptr) {
       std::unique_ptr<Exception> e(new Exception(
           ExceptionType::kConferenceInvalidSession,
           "Failed to delivery message."));
-      outgoing_messages_.front().on_failure(std::move(e));
+      message.second.on_failure(std::move(e));
     }
-    outgoing_messages_.pop();
   }
 }
 void ConferenceSocketSignalingChannel::DrainQueuedMessages() {
-  std::queue<SioMessage> temp_queue;
+  std::map<int, SioMessage> temp_queue;
   {
     std::lock_guard<std::mutex> lock(outgoing_message_mutex_);
     std::swap(temp_queue, outgoing_messages_);
+    holding_messages_ = false;
+  }
+  // Merge messages with the same coalescing key into the latest one. Callbacks
+  // of merged messages are triggered with the result of the merged message.
+  struct PendingMessage {
+    const SioMessage* message;
+    // Payload to emit, which differs from |message|'s for merged updates.
+    sio::message::list payload;
+    std::vector<std::function<void(sio::message::list const&)>> acks;
+    std::vector<std::function<void(std::unique_ptr<Exception>)>> failures;
+    int priority;
+  };
+  std::vector<PendingMessage> pending_messages;
+  std::unordered_map<std::string, size_t> coalesced_index;
+  for (auto& message : temp_queue) {
+    auto& sio_message = message.second;
+    // Timer is restarted when message is re-emitted.
+    owt::base::TimerService::Get().Cancel(sio_message.timeout_timer);
+    if (!sio_message.coalescing_key.empty()) {
+      auto index_it = coalesced_index.find(sio_message.coalescing_key);
+      if (index_it != coalesced_index.end()) {
+        PendingMessage& merged = pending_messages[index_it->second];
+        merged.message = &sio_message;
+        // Subscription updates only carry changed parameters.
+        merged.payload =
+            sio_message.name == kEventNameSubscriptionControl
+                ? MergeSubscriptionUpdates(merged.payload, sio_message.message)
+                : sio_message.message;
+        merged.acks.push_back(sio_message.ack);
+        merged.failures.push_back(sio_message.on_failure);
+        continue;
+      }
+      coalesced_index[sio_message.coalescing_key] = pending_messages.size();
+    }
+    pending_messages.push_back({&sio_message,
+                                sio_message.message,
+                                {sio_message.ack},
+                                {sio_message.on_failure},
+                                0});
+  }
+  // Messages are reordered across sessions only. A message never goes before
+  // an earlier one of the same session, e.g. unsubscribe is not sent before
+  // subscription-control of the same subscription.
+  std::unordered_map<std::string, int> session_priorities;
+  for (auto& pending : pending_messages) {
+    pending.priority = MessagePriority(pending.message->name);
+    std::string session_id = MessageSessionId(pending.payload);
+    if (session_id.empty())
+      continue;
+    auto priority_it = session_priorities.find(session_id);
+    if (priority_it != session_priorities.end())
+      pending.priority = std::max(pending.priority, priority_it->second);
+    session_priorities[session_id] = pending.priority;
   }
-  RTC_LOG(LS_INFO) << "outgoing_messages_ number after swap: "
-               << outgoing_messages_.size();
-  while (!temp_queue.empty()) {
-    auto sio_message = temp_queue.front();
+  std::stable_sort(pending_messages.begin(), pending_messages.end(),
+                   [](const PendingMessage& a, const PendingMessage& b) {
+                     return a.priority < b.priority;
+                   });
+  RTC_LOG(LS_INFO) << "Re-emitting " << pending_messages.size() << " of "
+                   << temp_queue.size() << " queued messages.";
+  for (auto& pending : pending_messages) {
+    auto acks = pending.acks;
+    auto failures = pending.failures;
+    std::function<void(sio::message::list const&)> ack = pending.acks.back();
+    std::function<void(std::unique_ptr<Exception>)> on_failure =
+        pending.failures.back();
+    if (acks.size() > 1) {
+      ack = [acks](sio::message::list const& msg) {
+        for (auto& callback : acks) {
+          if (callback) {
+            callback(msg);
+          }
+        }
+      };
+      on_failure = [failures](std::unique_ptr<Exception> e) {
+        for (auto& callback : failures) {
+          if (callback) {
+            callback(std::unique_ptr<Exception>(
+                new Exception(e->Type(), e->Message())));
+          }
+        }
+      };
+    }
     // MUST release |outgoing_message_mutex_| before Emit because Emit acquires
     // mutex.
-    Emit(sio_message.name, sio_message.message, sio_message.ack,
-         sio_message.on_failure);
-    temp_queue.pop();
+    Emit(pending.message->name, pending.payload, ack, on_failure,
+         pending.message->coalescing_key);
+  }
+}
+sio::message::list ConferenceSocketSignalingChannel::MergeSubscriptionUpdates(
+    const sio::message::list& older,
+    const sio::message::list& newer) {
+  if (older.size() == 0 || newer.size() == 0)
+    return newer;
+  sio::message::ptr older_data = ObjectField(older.at(0), "data");
+  sio::message::ptr older_video = ObjectField(older_data, "video");
+  sio::message::ptr older_parameters = ObjectField(older_video, "parameters");
+  sio::message::ptr newer_data = ObjectField(newer.at(0), "data");
+  sio::message::ptr newer_video = ObjectField(newer_data, "video");
+  sio::message::ptr newer_parameters = ObjectField(newer_video, "parameters");
+  if (!older_parameters || !newer_parameters)
+    return newer;
+  // Objects on the path are copied, so queued messages are not modified.
+  sio::message::ptr parameters = CopyObject(older_parameters);
+  for (auto& field : newer_parameters->get_map()) {
+    parameters->get_map()[field.first] = field.second;
   }
+  sio::message::ptr video = CopyObject(newer_video);
+  video->get_map()["parameters"] = parameters;
+  sio::message::ptr data = CopyObject(newer_data);
+  data->get_map()["video"] = video;
+  sio::message::ptr payload = CopyObject(newer.at(0));
+  payload->get_map()["data"] = data;
+  return sio::message::list(payload);
+}
+void ConferenceSocketSignalingChannel::SetRequestTimeouts(
+    int default_timeout,
+    const std::unordered_map<std::string, int>& timeouts) {
+  std::lock_guard<std::mutex> lock(outgoing_message_mutex_);
+  default_request_timeout_ = default_timeout;
+  request_timeouts_ = timeouts;
+}
+SignalingRequestStats ConferenceSocketSignalingChannel::GetRequestStats() {
+  SignalingRequestStats stats;
+  std::lock_guard<std::mutex> lock(outgoing_message_mutex_);
+  stats.in_flight = outgoing_messages_.size();
+  stats.timed_out = timed_out_request_count_;
+  stats.rtt_bucket_bounds = kRequestRttBucketBoundsMs;
+  stats.rtt_histogram = request_rtt_histogram_;
+  return stats;
 }
 sio::message::ptr ConferenceSocketSignalingChannel::ResolutionMessage(
     const owt::base::Resolution& resolution) {
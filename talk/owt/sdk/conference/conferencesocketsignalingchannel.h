@@ -3,9 +3,9 @@
 // SPDX-License-Identifier: Apache-2.0
 #ifndef conference_ConferenceSocketSignalingChannel_h
 #define conference_ConferenceSocketSignalingChannel_h
+#include <map>
 #include <memory>
 #include <future>
-#include <queue>
 #include <random>
 #include <unordered_map>
 #ifdef __clang__
@@ -18,8 +18,10 @@
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
+#include "talk/owt/sdk/base/timerservice.h"
 #include "talk/owt/sdk/include/cpp/owt/conference/conferenceclient.h"
 #include "talk/owt/sdk/include/cpp/owt/conference/user.h"
+#include "webrtc/rtc_base/task_queue.h"
 namespace owt {
 namespace conference {
 // TODO: Signaling... should be moved to a signaling message definition file.
@@ -87,6 +89,23 @@ class ConferenceSocketSignalingChannel
   virtual void Disconnect(
       std::function<void()> on_success,
       std::function<void(std::unique_ptr<Exception>)> on_failure);
+  /// Get latency statistics of ack callbacks.
+  SignalingAckCallbackStats GetAckCallbackStats() const;
+  /// Set timeouts in milliseconds for requests. |timeouts| are for specific
+  /// events, and |default_timeout| is for other events. 0 means no timeout.
+  void SetRequestTimeouts(int default_timeout,
+                          const std::unordered_map<std::string, int>& timeouts);
+  /// Get statistics of requests in flight and their round trip time.
+  SignalingRequestStats GetRequestStats();
+  /// Host of conference server. It's available after Connect is called.
+  std::string ServerHost() const { return server_host_; }
+  /// Merge two queued subscription updates of the same subscription. Video
+  /// parameters of |newer| override those of |older| field by field, since
+  /// an update only carries changed parameters. Returns |newer| if either is
+  /// not an update.
+  static sio::message::list MergeSubscriptionUpdates(
+      const sio::message::list& older,
+      const sio::message::list& newer);
  protected:
   virtual void OnEmitAck(
       sio::message::list const& msg,
@@ -101,17 +120,27 @@ class ConferenceSocketSignalingChannel
         const sio::message::list& message,
         const std::function<void(sio::message::list const&)> ack,
         const std::function<void(std::unique_ptr<Exception>)>
-            on_failure)
+            on_failure,
+        const std::string& coalescing_key)
         : id(id),
           name(name),
           message(message),
           ack(ack),
-          on_failure(on_failure){}
+          on_failure(on_failure),
+          coalescing_key(coalescing_key),
+          sent_time_ms(0),
+          timeout_timer(owt::base::TimerService::kInvalidTimerId) {}
     const int id;
     const std::string name;
     const sio::message::list message;
     const std::function<void(sio::message::list const&)> ack;
     const std::function<void(std::unique_ptr<Exception>)> on_failure;
+    // Messages with the same non-empty key set the same state on server, so
+    // only the latest one needs to be re-emitted after reconnection. Partial
+    // subscription updates are merged instead.
+    const std::string coalescing_key;
+    int64_t sent_time_ms;
+    owt::base::TimerService::TimerId timeout_timer;
   };
   /// Fires upon a new ticket is received.
   void OnReconnectionTicket(const std::string& ticket);
@@ -119,15 +148,24 @@ class ConferenceSocketSignalingChannel
   void OnNotificationFromServer(const std::string& name,
                                 sio::message::ptr const& data);
   void RefreshReconnectionTicket();
+  // Schedule a reconnection attempt with backoff. Returns false if no more
+  // attempt should be made.
+  bool ScheduleReconnection();
+  // Delay before the |attempt|th reconnection attempt, in milliseconds.
+  int ReconnectionDelay(int attempt);
   void TriggerOnServerDisconnected();
   void Emit(const std::string& name,
             const sio::message::list& message,
             const std::function<void(sio::message::list const&)> ack,
             const std::function<void(std::unique_ptr<Exception>)>
-                on_failure);
+                on_failure,
+            const std::string& coalescing_key = "");
   // Clean message queue and triggered failure callback for all queued messages.
   void DropQueuedMessages();
-  // Re-emit queued message.
+  // Fail the request with |message_id| if it's still waiting for ack.
+  void OnRequestTimeout(int message_id);
+  // Re-emit queued messages. Messages with the same coalescing key are merged,
+  // and critical messages are emitted first.
   void DrainQueuedMessages();
   // Convert an resolution object to a sio message.
   sio::message::ptr ResolutionMessage(
@@ -139,15 +177,38 @@ class ConferenceSocketSignalingChannel
       connect_failure_callback_;
   std::function<void()> disconnect_complete_;
   std::string reconnection_ticket_;
+  owt::base::TimerService::TimerId refresh_ticket_timer_;
+  owt::base::TimerService::TimerId reconnection_timer_;
+  std::string server_url_;
+  std::string server_host_;
+  std::mt19937 random_engine_;
   std::string participant_id_;
   int reconnection_attempted_;
   bool is_reconnection_;
-  // Messages may be lost if during Socket.IO reconnection. We maintain a
-  // message queue here so we can emit un-acked messages after connected.
-  std::queue<SioMessage> outgoing_messages_;
+  // Messages may be lost if during Socket.IO reconnection. We maintain
+  // un-acked messages here, ordered by ID, so we can emit them after
+  // connected, and fail them when timeout.
+  std::map<int, SioMessage> outgoing_messages_;
+  // True if new messages are held in |outgoing_messages_| until relogin.
+  bool holding_messages_;
   int outgoing_message_id_;
+  int default_request_timeout_;
+  std::unordered_map<std::string, int> request_timeouts_;
+  uint64_t timed_out_request_count_;
+  std::vector<uint64_t> request_rtt_histogram_;
   std::mutex outgoing_message_mutex_;
   std::string quic_transport_id_;
+  // Statistics are shared with tasks in |ack_queue_|, so tasks don't keep this
+  // object alive.
+  struct AckCallbackMetrics {
+    std::mutex mutex;
+    SignalingAckCallbackStats stats;
+  };
+  std::shared_ptr<AckCallbackMetrics> ack_metrics_;
+  // Success callbacks of acks run on this queue in the order acks received,
+  // so socket.io thread is not blocked by them. Failures of timed out requests
+  // run on it as well.
+  std::unique_ptr<rtc::TaskQueue> ack_queue_;
 };
 }
 }
@@ -0,0 +1,62 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/conference/conferencesocketsignalingchannel.h"
+#include "testing/gtest/include/gtest/gtest.h"
+namespace owt {
+namespace conference {
+static sio::message::list CreateUpdate(const sio::message::ptr& parameters) {
+  sio::message::ptr video = sio::object_message::create();
+  video->get_map()["parameters"] = parameters;
+  video->get_map()["from"] = sio::string_message::create("stream");
+  sio::message::ptr data = sio::object_message::create();
+  data->get_map()["video"] = video;
+  sio::message::ptr payload = sio::object_message::create();
+  payload->get_map()["id"] = sio::string_message::create("subscription");
+  payload->get_map()["operation"] = sio::string_message::create("update");
+  payload->get_map()["data"] = data;
+  return sio::message::list(payload);
+}
+static sio::message::ptr Parameters(const sio::message::list& update) {
+  return update.at(0)
+      ->get_map()["data"]
+      ->get_map()["video"]
+      ->get_map()["parameters"];
+}
+TEST(ConferenceSocketSignalingChannelTest, MergesSubscriptionUpdates) {
+  sio::message::ptr resolution = sio::object_message::create();
+  resolution->get_map()["width"] = sio::int_message::create(640);
+  resolution->get_map()["height"] = sio::int_message::create(360);
+  sio::message::ptr older_parameters = sio::object_message::create();
+  older_parameters->get_map()["resolution"] = resolution;
+  older_parameters->get_map()["framerate"] = sio::int_message::create(30);
+  sio::message::ptr newer_parameters = sio::object_message::create();
+  newer_parameters->get_map()["framerate"] = sio::int_message::create(15);
+  sio::message::list older = CreateUpdate(older_parameters);
+  sio::message::list newer = CreateUpdate(newer_parameters);
+  sio::message::list merged =
+      ConferenceSocketSignalingChannel::MergeSubscriptionUpdates(older, newer);
+  auto& parameters = Parameters(merged)->get_map();
+  ASSERT_EQ(parameters.size(), 2u);
+  EXPECT_EQ(parameters["resolution"], resolution);
+  EXPECT_EQ(parameters["framerate"]->get_int(), 15);
+  EXPECT_EQ(merged.at(0)->get_map()["id"]->get_string(), "subscription");
+  // Queued messages are not modified.
+  EXPECT_EQ(Parameters(older)->get_map()["framerate"]->get_int(), 30);
+  EXPECT_EQ(Parameters(newer)->get_map().size(), 1u);
+}
+TEST(ConferenceSocketSignalingChannelTest, KeepsNewerMessageIfNotUpdate) {
+  sio::message::ptr parameters = sio::object_message::create();
+  parameters->get_map()["framerate"] = sio::int_message::create(15);
+  sio::message::list update = CreateUpdate(parameters);
+  sio::message::ptr pause = sio::object_message::create();
+  pause->get_map()["id"] = sio::string_message::create("subscription");
+  pause->get_map()["operation"] = sio::string_message::create("pause");
+  pause->get_map()["data"] = sio::string_message::create("video");
+  sio::message::list merged =
+      ConferenceSocketSignalingChannel::MergeSubscriptionUpdates(
+          update, sio::message::list(pause));
+  EXPECT_EQ(merged.at(0), pause);
+}
+}  // namespace conference
+}  // namespace owt
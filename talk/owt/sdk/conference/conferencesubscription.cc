@@ -176,6 +176,10 @@ void ConferenceSubscription::Stop() {
   } else {
     that->UnSubscribe(id_, nullptr, nullptr);
     ended_ = true;
+#ifdef OWT_ENABLE_QUIC
+    if (quic_stream_)
+      quic_stream_->OnReset();
+#endif
     const std::lock_guard<std::mutex> lock(observer_mutex_);
     for (auto its = observers_.begin(); its != observers_.end(); ++its) {
       (*its).get().OnEnded();
@@ -214,7 +218,10 @@ void ConferenceSubscription::OnIncomingStream(const std::string& session_id,
     owt::quic::WebTransportStreamInterface* stream) {
   if (ended_ || stream_id_ != session_id)
     return;
-  quic_stream_ = std::make_shared<owt::base::QuicStream>(stream, session_id);
+  quic_stream_ = std::make_shared<owt::base::QuicStream>(stream, session_id,
+                                                         event_queue_);
+  // Take over stream events so they can be delivered to QuicStreamObserver.
+  quic_stream_->SetVisitor(quic_stream_.get());
 #if 0
   for (auto its = observers_.begin(); its != observers_.end(); ++its) {
     (*its).get().OnReady();
@@ -2,6 +2,7 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 #include "talk/owt/sdk/conference/conferencewebtransportchannel.h"
+#include <algorithm>
 #include <chrono>
 #include <future>
 #include <memory>
@@ -13,6 +14,7 @@
 #include "talk/owt/sdk/base/mediautils.h"
 #include "talk/owt/sdk/include/cpp/owt/base/stream.h"
 #include "talk/owt/sdk/include/cpp/owt/base/globalconfiguration.h"
+#include "webrtc/api/task_queue/default_task_queue_factory.h"
 #include "webrtc/rtc_base/checks.h"
 #include "webrtc/rtc_base/logging.h"
 #include "webrtc/rtc_base/string_utils.h"
@@ -56,9 +58,28 @@ ConferenceWebTransportChannel::ConferenceWebTransportChannel(
   RTC_CHECK(signaling_channel_);
   quic_transport_factory_.reset(owt::quic::WebTransportFactory::Create());
   quic_client_connected_ = false;
+  auto task_queue_factory = webrtc::CreateDefaultTaskQueueFactory();
+  transport_queue_ =
+      std::make_shared<rtc::TaskQueue>(task_queue_factory->CreateTaskQueue(
+          "WebTransportSendQueue",
+          webrtc::TaskQueueFactory::Priority::HIGH));
 }
 
 ConferenceWebTransportChannel::~ConferenceWebTransportChannel() {
+  // Wait for the running task, and drop pending ones. A stream may keep the
+  // queue for a moment, so tasks don't rely on |this| being valid.
+  transport_queue_.reset();
+  // Streams are owned by |quic_transport_client_|, which is destroyed with
+  // this object.
+  {
+    const std::lock_guard<std::mutex> lock(send_streams_mutex_);
+    for (auto& weak_stream : send_streams_) {
+      auto stream = weak_stream.lock();
+      if (stream)
+        stream->OnTransportClosed();
+    }
+    send_streams_.clear();
+  }
   // We will rely on conference client to stop all publications/subscriptions.
   if (quic_client_connected_ && quic_transport_client_) {
     quic_transport_client_->Close();
@@ -390,6 +411,14 @@ void ConferenceWebTransportChannel::OnConnectionFailed() {
     fingerprint_ = nullptr;
   }
   quic_client_connected_ = false;
+  {
+    const std::lock_guard<std::mutex> lock(send_streams_mutex_);
+    for (auto& weak_stream : send_streams_) {
+      auto stream = weak_stream.lock();
+      if (stream)
+        stream->OnReset();
+    }
+  }
   if (observer_) {
     observer_->OnConnectionFailed();
   }
@@ -480,8 +509,20 @@ void ConferenceWebTransportChannel::CreateSendStream(
       quic_transport_client_->CreateBidirectionalStream();
   // For local stream session id is not specified at stream creation time.
   std::shared_ptr<owt::base::QuicStream> writable_stream =
-      std::make_shared<owt::base::QuicStream>(quic_stream, "0");
+      std::make_shared<owt::base::QuicStream>(quic_stream, "0", event_queue_,
+                                              transport_queue_);
   writable_stream->SetVisitor(writable_stream.get());
+  {
+    const std::lock_guard<std::mutex> lock(send_streams_mutex_);
+    // Drop streams already released.
+    send_streams_.erase(
+        std::remove_if(send_streams_.begin(), send_streams_.end(),
+                       [](const std::weak_ptr<owt::base::QuicStream>& stream) {
+                         return stream.expired();
+                       }),
+        send_streams_.end());
+    send_streams_.push_back(writable_stream);
+  }
   int error_code = 0;
   on_success(owt::base::LocalStream::Create(writable_stream, error_code));
 }
@@ -4,6 +4,7 @@
 #ifndef OWT_CONFERENCE_CONFERENCEWEBTRANSPORTCHANNEL_H_
 #define OWT_CONFERENCE_CONFERENCEWEBTRANSPORTCHANNEL_H_
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <memory>
@@ -172,6 +173,13 @@ class ConferenceWebTransportChannel: public owt::quic::WebTransportClientInterfa
   mutable std::mutex published_session_ids_mutex_;
   std::vector<std::string> subscribed_session_ids_;
   mutable std::mutex subscribed_session_ids_mutex_;
+  // Streams created by CreateSendStream. They may be kept by the application
+  // after WebTransport is closed.
+  std::vector<std::weak_ptr<owt::base::QuicStream>> send_streams_;
+  std::mutex send_streams_mutex_;
+  // Writing data queued on streams may wait for WebTransport's thread, so it's
+  // not done on |event_queue_|. Released first in destructor.
+  std::shared_ptr<rtc::TaskQueue> transport_queue_;
 };
 }
 }
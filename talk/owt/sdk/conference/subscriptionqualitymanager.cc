@@ -0,0 +1,206 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/include/cpp/owt/conference/subscriptionqualitymanager.h"
+#include "talk/owt/sdk/conference/subscriptionqualityselector.h"
+#include "webrtc/rtc_base/logging.h"
+namespace owt {
+namespace conference {
+SubscriptionQualityManager::SubscriptionQualityManager()
+    : state_(std::make_shared<State>()) {}
+SubscriptionQualityManager::~SubscriptionQualityManager() {}
+void SubscriptionQualityManager::AddSubscription(
+    std::shared_ptr<ConferenceSubscription> subscription,
+    std::shared_ptr<owt::base::RemoteStream> stream,
+    const SubscriptionQualityHint& hint) {
+  if (!subscription || !stream) {
+    RTC_LOG(LS_WARNING) << "Invalid subscription or stream.";
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    ManagedSubscription& managed = state_->subscriptions[subscription->Id()];
+    managed.subscription = subscription;
+    managed.stream = stream;
+    managed.hint = hint;
+    managed.levels = SubscriptionQualitySelector::BuildLevels(
+        stream->Settings(), stream->Capabilities().video, hint);
+    managed.applied =
+        SubscriptionQualitySelector::BaseQuality(stream->Settings());
+    managed.current_level = managed.levels.size();
+    managed.upgrade_count = 0;
+    managed.request_id = 0;
+    managed.reevaluate = false;
+  }
+  Evaluate(state_);
+}
+void SubscriptionQualityManager::UpdateHint(
+    const std::string& subscription_id,
+    const SubscriptionQualityHint& hint) {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    auto it = state_->subscriptions.find(subscription_id);
+    if (it == state_->subscriptions.end())
+      return;
+    ManagedSubscription& managed = it->second;
+    managed.hint = hint;
+    managed.levels = SubscriptionQualitySelector::BuildLevels(
+        managed.stream->Settings(), managed.stream->Capabilities().video,
+        hint);
+    // Locate the applied quality in new levels, so it's not considered as a
+    // downgrade or upgrade. An update in progress still updates |applied|,
+    // and it is located again when the update completes.
+    managed.current_level =
+        SubscriptionQualitySelector::LevelOf(managed.levels, managed.applied);
+    managed.upgrade_count = 0;
+    if (managed.request_id != 0)
+      managed.reevaluate = true;
+  }
+  Evaluate(state_);
+}
+void SubscriptionQualityManager::RemoveSubscription(
+    const std::string& subscription_id) {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->subscriptions.erase(subscription_id);
+  }
+  // Released bandwidth may be used by other subscriptions.
+  Evaluate(state_);
+}
+void SubscriptionQualityManager::SetAvailableBandwidth(uint32_t kbps) {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->available_bandwidth = kbps;
+  }
+  Evaluate(state_);
+}
+bool SubscriptionQualityManager::GetQuality(const std::string& subscription_id,
+                                            SubscriptionQuality& quality) {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  auto it = state_->subscriptions.find(subscription_id);
+  if (it == state_->subscriptions.end())
+    return false;
+  quality = it->second.applied;
+  return true;
+}
+void SubscriptionQualityManager::Evaluate(
+    const std::shared_ptr<State>& state) {
+  struct Update {
+    std::shared_ptr<ConferenceSubscription> subscription;
+    SubscriptionUpdateOptions options;
+    SubscriptionQuality quality;
+    uint64_t request_id;
+  };
+  std::vector<Update> updates;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->available_bandwidth == 0)
+      return;
+    std::vector<ManagedSubscription*> managed_subscriptions;
+    std::vector<SubscriptionQualitySelector::Entry> entries;
+    for (auto it = state->subscriptions.begin();
+         it != state->subscriptions.end();) {
+      if (it->second.subscription.expired()) {
+        it = state->subscriptions.erase(it);
+        continue;
+      }
+      ManagedSubscription& managed = it->second;
+      ++it;
+      if (managed.levels.empty())
+        continue;
+      SubscriptionQualitySelector::Entry entry;
+      entry.levels = managed.levels;
+      entry.priority = managed.hint.priority;
+      entry.current_level = managed.current_level;
+      entry.upgrade_count = managed.upgrade_count;
+      managed_subscriptions.push_back(&managed);
+      entries.push_back(entry);
+    }
+    std::vector<size_t> targets = SubscriptionQualitySelector::Select(
+        entries, state->available_bandwidth);
+    for (size_t i = 0; i < managed_subscriptions.size(); i++) {
+      ManagedSubscription* managed = managed_subscriptions[i];
+      managed->upgrade_count = entries[i].upgrade_count;
+      size_t target = targets[i];
+      if (target == managed->current_level)
+        continue;
+      if (managed->request_id != 0) {
+        managed->reevaluate = true;
+        continue;
+      }
+      const SubscriptionQuality& quality = managed->levels[target];
+      // Only parameters changed from the applied quality are sent to server.
+      Update update;
+      if (!(quality.resolution == managed->applied.resolution))
+        update.options.video.resolution = quality.resolution;
+      if (quality.frame_rate != managed->applied.frame_rate)
+        update.options.video.frameRate = quality.frame_rate;
+      if (quality.bitrate_multiplier != managed->applied.bitrate_multiplier)
+        update.options.video.bitrateMultiplier = quality.bitrate_multiplier;
+      // |applied| is updated after the server accepts the update.
+      managed->current_level = target;
+      managed->request_id = state->next_request_id++;
+      update.subscription = managed->subscription.lock();
+      update.quality = quality;
+      update.request_id = managed->request_id;
+      updates.push_back(update);
+    }
+  }
+  std::weak_ptr<State> weak_state = state;
+  for (auto& update : updates) {
+    if (!update.subscription)
+      continue;
+    std::string id = update.subscription->Id();
+    uint64_t request_id = update.request_id;
+    SubscriptionQuality quality = update.quality;
+    RTC_LOG(LS_INFO) << "Update quality of subscription " << id << ".";
+    update.subscription->ApplyOptions(
+        update.options,
+        [weak_state, id, request_id, quality] {
+          OnQualityUpdated(weak_state, id, request_id, quality, true);
+        },
+        [weak_state, id, request_id,
+         quality](std::unique_ptr<Exception> e) {
+          RTC_LOG(LS_WARNING) << "Failed to update quality of subscription "
+                              << id << ": " << e->Message();
+          OnQualityUpdated(weak_state, id, request_id, quality, false);
+        });
+  }
+}
+void SubscriptionQualityManager::OnQualityUpdated(
+    std::weak_ptr<State> weak_state,
+    const std::string& subscription_id,
+    uint64_t request_id,
+    const SubscriptionQuality& quality,
+    bool succeeded) {
+  auto state = weak_state.lock();
+  if (!state)
+    return;
+  bool reevaluate = false;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    auto it = state->subscriptions.find(subscription_id);
+    if (it == state->subscriptions.end() ||
+        it->second.request_id != request_id)
+      return;
+    ManagedSubscription& managed = it->second;
+    managed.request_id = 0;
+    reevaluate = managed.reevaluate;
+    managed.reevaluate = false;
+    if (succeeded)
+      managed.applied = quality;
+    if (!succeeded || reevaluate) {
+      // Go back to the applied quality, so the same update is requested
+      // again at next evaluation if it failed. Levels may also have been
+      // rebuilt since the update was requested.
+      managed.current_level = SubscriptionQualitySelector::LevelOf(
+          managed.levels, managed.applied);
+      if (!succeeded)
+        managed.upgrade_count = 0;
+    }
+  }
+  if (reevaluate)
+    Evaluate(state);
+}
+}  // namespace conference
+}  // namespace owt
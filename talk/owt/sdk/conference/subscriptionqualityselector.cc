@@ -0,0 +1,209 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/conference/subscriptionqualityselector.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+namespace owt {
+namespace conference {
+// Frame rate assumed if publication settings don't have one.
+static const double kDefaultFrameRate = 30;
+// Bits per pixel used for estimating bitrate if publication settings don't
+// have a bitrate.
+static const double kDefaultBitsPerPixel = 0.08;
+// An upgrade must fit in this share of available bandwidth.
+static const double kUpgradeBandwidthRatio = 0.85;
+// Number of consecutive evaluations an upgrade must be possible before it's
+// applied.
+static const int kUpgradeHoldCount = 3;
+static uint64_t Pixels(const owt::base::Resolution& resolution) {
+  return static_cast<uint64_t>(resolution.width) * resolution.height;
+}
+// Estimate bitrate of |quality| from |base|. Bitrate grows slower than pixel
+// count and frame rate.
+static uint32_t EstimateBitrate(const SubscriptionQuality& base,
+                                const SubscriptionQuality& quality) {
+  double bitrate = base.bitrate;
+  if (Pixels(base.resolution) > 0) {
+    bitrate *= std::pow(static_cast<double>(Pixels(quality.resolution)) /
+                            Pixels(base.resolution),
+                        0.75);
+  }
+  if (base.frame_rate > 0) {
+    bitrate *= std::sqrt(quality.frame_rate / base.frame_rate);
+  }
+  bitrate *= quality.bitrate_multiplier;
+  return static_cast<uint32_t>(bitrate);
+}
+SubscriptionQuality SubscriptionQualitySelector::BaseQuality(
+    const owt::base::PublicationSettings& settings) {
+  SubscriptionQuality base;
+  base.frame_rate = kDefaultFrameRate;
+  // For simulcast streams, the largest layer is the stream's full quality.
+  for (const auto& video : settings.video) {
+    if (Pixels(video.resolution) < Pixels(base.resolution))
+      continue;
+    base.resolution = video.resolution;
+    if (video.frame_rate > 0)
+      base.frame_rate = video.frame_rate;
+    base.bitrate = video.bitrate;
+  }
+  if (Pixels(base.resolution) == 0) {
+    base.resolution = owt::base::Resolution(640, 480);
+  }
+  if (base.bitrate == 0) {
+    base.bitrate = static_cast<uint32_t>(Pixels(base.resolution) *
+                                         base.frame_rate *
+                                         kDefaultBitsPerPixel / 1000);
+  }
+  return base;
+}
+std::vector<SubscriptionQuality> SubscriptionQualitySelector::BuildLevels(
+    const owt::base::PublicationSettings& settings,
+    const owt::base::VideoSubscriptionCapabilities& capabilities,
+    const SubscriptionQualityHint& hint) {
+  SubscriptionQuality base = BaseQuality(settings);
+  // Resolutions ordered by pixel count.
+  std::map<uint64_t, owt::base::Resolution> resolutions;
+  resolutions[Pixels(base.resolution)] = base.resolution;
+  for (const auto& resolution : capabilities.resolutions) {
+    resolutions[Pixels(resolution)] = resolution;
+  }
+  // Resolutions larger than the renderer don't improve quality, except the
+  // smallest one covering the renderer.
+  if (Pixels(hint.renderer_size) > 0) {
+    auto covering = resolutions.lower_bound(Pixels(hint.renderer_size));
+    if (covering != resolutions.end())
+      resolutions.erase(std::next(covering), resolutions.end());
+  }
+  std::vector<double> frame_rates;
+  for (double frame_rate : capabilities.frame_rates) {
+    if (frame_rate > 0 && frame_rate < base.frame_rate)
+      frame_rates.push_back(frame_rate);
+  }
+  std::sort(frame_rates.begin(), frame_rates.end());
+  std::vector<double> multipliers(capabilities.bitrate_multipliers);
+  std::sort(multipliers.begin(), multipliers.end());
+  std::vector<SubscriptionQuality> candidates;
+  auto add_candidate = [&](const owt::base::Resolution& resolution,
+                           double frame_rate, double multiplier) {
+    SubscriptionQuality quality;
+    quality.resolution = resolution;
+    quality.frame_rate = frame_rate;
+    quality.bitrate_multiplier = multiplier;
+    quality.bitrate = EstimateBitrate(base, quality);
+    candidates.push_back(quality);
+  };
+  const owt::base::Resolution& smallest = resolutions.begin()->second;
+  const owt::base::Resolution& largest = resolutions.rbegin()->second;
+  // From the lowest quality: lower bitrate and frame rate at the smallest
+  // resolution, then each resolution, then higher bitrate at the largest
+  // resolution.
+  double lowest_frame_rate =
+      frame_rates.empty() ? base.frame_rate : frame_rates.front();
+  for (double multiplier : multipliers) {
+    if (multiplier > 0 && multiplier < 1)
+      add_candidate(smallest, lowest_frame_rate, multiplier);
+  }
+  for (double frame_rate : frame_rates) {
+    add_candidate(smallest, frame_rate, 1);
+  }
+  for (const auto& resolution : resolutions) {
+    add_candidate(resolution.second, base.frame_rate, 1);
+  }
+  for (double multiplier : multipliers) {
+    if (multiplier > 1)
+      add_candidate(largest, base.frame_rate, multiplier);
+  }
+  // Keep levels whose bitrate strictly increases.
+  std::vector<SubscriptionQuality> levels;
+  for (const auto& candidate : candidates) {
+    if (levels.empty() || candidate.bitrate > levels.back().bitrate)
+      levels.push_back(candidate);
+  }
+  return levels;
+}
+size_t SubscriptionQualitySelector::LevelOf(
+    const std::vector<SubscriptionQuality>& levels,
+    const SubscriptionQuality& quality) {
+  size_t level = 0;
+  for (size_t i = 0; i < levels.size(); i++) {
+    if (levels[i].bitrate <= quality.bitrate)
+      level = i;
+  }
+  return level;
+}
+std::vector<size_t> SubscriptionQualitySelector::Select(
+    std::vector<Entry>& entries,
+    uint32_t bandwidth) {
+  std::vector<const Entry*> order;
+  for (const auto& entry : entries) {
+    order.push_back(&entry);
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [](const Entry* a, const Entry* b) {
+                     return a->priority > b->priority;
+                   });
+  std::vector<size_t> full = Allocate(order, bandwidth);
+  std::vector<size_t> cautious =
+      Allocate(order, static_cast<uint32_t>(bandwidth * kUpgradeBandwidthRatio));
+  std::vector<size_t> targets(entries.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    size_t index = order[i] - entries.data();
+    Entry& entry = entries[index];
+    size_t target = entry.current_level;
+    if (full[i] < entry.current_level) {
+      target = full[i];
+      entry.upgrade_count = 0;
+    } else if (cautious[i] > entry.current_level) {
+      if (++entry.upgrade_count >= kUpgradeHoldCount) {
+        target = cautious[i];
+        entry.upgrade_count = 0;
+      }
+    } else {
+      entry.upgrade_count = 0;
+    }
+    targets[index] = target;
+  }
+  return targets;
+}
+std::vector<size_t> SubscriptionQualitySelector::Allocate(
+    const std::vector<const Entry*>& order,
+    uint32_t budget) {
+  std::vector<size_t> allocation(order.size(), 0);
+  uint64_t used = 0;
+  for (auto* entry : order) {
+    used += entry->levels.front().bitrate;
+  }
+  // Subscriptions with the same priority are upgraded in turn, and a lower
+  // priority group is upgraded only after the higher priority group can't be
+  // upgraded anymore.
+  size_t group_begin = 0;
+  while (group_begin < order.size()) {
+    size_t group_end = group_begin;
+    while (group_end < order.size() &&
+           order[group_end]->priority == order[group_begin]->priority)
+      group_end++;
+    bool upgraded = true;
+    while (upgraded) {
+      upgraded = false;
+      for (size_t i = group_begin; i < group_end; i++) {
+        const auto& levels = order[i]->levels;
+        if (allocation[i] + 1 >= levels.size())
+          continue;
+        uint64_t next_used = used - levels[allocation[i]].bitrate +
+                             levels[allocation[i] + 1].bitrate;
+        if (next_used > budget)
+          continue;
+        used = next_used;
+        allocation[i]++;
+        upgraded = true;
+      }
+    }
+    group_begin = group_end;
+  }
+  return allocation;
+}
+}  // namespace conference
+}  // namespace owt
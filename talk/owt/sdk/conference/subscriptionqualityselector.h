@@ -0,0 +1,54 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OWT_CONFERENCE_SUBSCRIPTIONQUALITYSELECTOR_H_
+#define OWT_CONFERENCE_SUBSCRIPTIONQUALITYSELECTOR_H_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "talk/owt/sdk/include/cpp/owt/base/options.h"
+#include "talk/owt/sdk/include/cpp/owt/conference/subscriptionqualitymanager.h"
+namespace owt {
+namespace conference {
+// Quality level selection of SubscriptionQualityManager. It doesn't keep any
+// state, so SubscriptionQualityManager owns the subscriptions and this class
+// only decides which level each of them should use.
+class SubscriptionQualitySelector {
+ public:
+  struct Entry {
+    Entry() : priority(1), current_level(0), upgrade_count(0) {}
+    // Candidate qualities in ascending order of bitrate. Must not be empty.
+    std::vector<SubscriptionQuality> levels;
+    int priority;
+    // Index of the quality requested last time. It's the size of |levels|
+    // before any quality is requested.
+    size_t current_level;
+    // Consecutive evaluations an upgrade has been possible.
+    int upgrade_count;
+  };
+  // Quality of a stream as published.
+  static SubscriptionQuality BaseQuality(
+      const owt::base::PublicationSettings& settings);
+  // Candidate qualities of a stream in ascending order of bitrate.
+  static std::vector<SubscriptionQuality> BuildLevels(
+      const owt::base::PublicationSettings& settings,
+      const owt::base::VideoSubscriptionCapabilities& capabilities,
+      const SubscriptionQualityHint& hint);
+  // Index of the highest level whose bitrate doesn't exceed |quality|'s.
+  static size_t LevelOf(const std::vector<SubscriptionQuality>& levels,
+                        const SubscriptionQuality& quality);
+  // Returns the level each entry should use with |bandwidth| kbps. Downgrades
+  // take effect immediately, while an upgrade must be possible within a
+  // safety margin for several calls in a row. |upgrade_count| of entries are
+  // updated, but |current_level| is left to the caller.
+  static std::vector<size_t> Select(std::vector<Entry>& entries,
+                                    uint32_t bandwidth);
+ private:
+  // Choose a level for each entry in |order| within |budget|. |order| is
+  // sorted by priority.
+  static std::vector<size_t> Allocate(const std::vector<const Entry*>& order,
+                                      uint32_t budget);
+};
+}  // namespace conference
+}  // namespace owt
+#endif  // OWT_CONFERENCE_SUBSCRIPTIONQUALITYSELECTOR_H_
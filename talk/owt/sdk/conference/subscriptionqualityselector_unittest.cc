@@ -0,0 +1,128 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "talk/owt/sdk/conference/subscriptionqualityselector.h"
+#include "testing/gtest/include/gtest/gtest.h"
+namespace owt {
+namespace conference {
+static SubscriptionQualitySelector::Entry CreateEntry(
+    const std::vector<uint32_t>& bitrates,
+    int priority,
+    size_t current_level) {
+  SubscriptionQualitySelector::Entry entry;
+  for (uint32_t bitrate : bitrates) {
+    SubscriptionQuality quality;
+    quality.bitrate = bitrate;
+    entry.levels.push_back(quality);
+  }
+  entry.priority = priority;
+  entry.current_level = current_level;
+  return entry;
+}
+static std::vector<size_t> SelectAndApply(
+    std::vector<SubscriptionQualitySelector::Entry>& entries,
+    uint32_t bandwidth) {
+  std::vector<size_t> targets =
+      SubscriptionQualitySelector::Select(entries, bandwidth);
+  for (size_t i = 0; i < entries.size(); i++) {
+    entries[i].current_level = targets[i];
+  }
+  return targets;
+}
+TEST(SubscriptionQualitySelectorTest, BuildsLevelsInAscendingBitrate) {
+  owt::base::PublicationSettings settings;
+  owt::base::VideoPublicationSettings video;
+  video.resolution = owt::base::Resolution(1280, 720);
+  video.frame_rate = 30;
+  video.bitrate = 2000;
+  settings.video.push_back(video);
+  owt::base::VideoSubscriptionCapabilities capabilities;
+  capabilities.resolutions.push_back(owt::base::Resolution(640, 360));
+  capabilities.resolutions.push_back(owt::base::Resolution(320, 180));
+  capabilities.frame_rates = {30, 15};
+  capabilities.bitrate_multipliers = {1.5, 0.5};
+  std::vector<SubscriptionQuality> levels =
+      SubscriptionQualitySelector::BuildLevels(settings, capabilities,
+                                               SubscriptionQualityHint());
+  // Lower bitrate and frame rate at the smallest resolution, each resolution,
+  // then higher bitrate at the largest resolution.
+  ASSERT_EQ(levels.size(), 6u);
+  EXPECT_EQ(levels[0].resolution, owt::base::Resolution(320, 180));
+  EXPECT_EQ(levels[0].frame_rate, 15);
+  EXPECT_EQ(levels[0].bitrate_multiplier, 0.5);
+  EXPECT_EQ(levels[1].frame_rate, 15);
+  EXPECT_EQ(levels[2].resolution, owt::base::Resolution(320, 180));
+  EXPECT_EQ(levels[2].frame_rate, 30);
+  EXPECT_EQ(levels[3].resolution, owt::base::Resolution(640, 360));
+  EXPECT_EQ(levels[4].resolution, owt::base::Resolution(1280, 720));
+  EXPECT_EQ(levels[4].bitrate, 2000u);
+  EXPECT_EQ(levels[5].bitrate_multiplier, 1.5);
+  EXPECT_NEAR(levels[5].bitrate, 3000, 1);
+  for (size_t i = 1; i < levels.size(); i++) {
+    EXPECT_GT(levels[i].bitrate, levels[i - 1].bitrate);
+  }
+  // Resolutions larger than the renderer are not chosen.
+  SubscriptionQualityHint hint;
+  hint.renderer_size = owt::base::Resolution(480, 270);
+  levels =
+      SubscriptionQualitySelector::BuildLevels(settings, capabilities, hint);
+  ASSERT_EQ(levels.size(), 5u);
+  EXPECT_EQ(levels.back().resolution, owt::base::Resolution(640, 360));
+  EXPECT_EQ(levels.back().bitrate_multiplier, 1.5);
+}
+TEST(SubscriptionQualitySelectorTest, EstimatesBaseQuality) {
+  owt::base::PublicationSettings settings;
+  SubscriptionQuality base = SubscriptionQualitySelector::BaseQuality(settings);
+  EXPECT_EQ(base.resolution, owt::base::Resolution(640, 480));
+  EXPECT_EQ(base.frame_rate, 30);
+  EXPECT_GT(base.bitrate, 0u);
+  EXPECT_EQ(SubscriptionQualitySelector::LevelOf(
+                SubscriptionQualitySelector::BuildLevels(
+                    settings, owt::base::VideoSubscriptionCapabilities(),
+                    SubscriptionQualityHint()),
+                base),
+            0u);
+}
+TEST(SubscriptionQualitySelectorTest, DowngradesImmediately) {
+  std::vector<SubscriptionQualitySelector::Entry> entries;
+  // No quality is requested yet.
+  entries.push_back(CreateEntry({100, 200, 400}, 1, 3));
+  EXPECT_EQ(SelectAndApply(entries, 1000)[0], 2u);
+  EXPECT_EQ(SelectAndApply(entries, 300)[0], 1u);
+  EXPECT_EQ(SelectAndApply(entries, 50)[0], 0u);
+}
+TEST(SubscriptionQualitySelectorTest, HoldsUpgrades) {
+  std::vector<SubscriptionQualitySelector::Entry> entries;
+  entries.push_back(CreateEntry({100, 200, 400}, 1, 0));
+  EXPECT_EQ(SelectAndApply(entries, 1000)[0], 0u);
+  EXPECT_EQ(SelectAndApply(entries, 1000)[0], 0u);
+  EXPECT_EQ(SelectAndApply(entries, 1000)[0], 2u);
+  // Level 1 fits in 220 kbps, but not with the safety margin.
+  entries[0].current_level = 0;
+  for (int i = 0; i < 5; i++) {
+    EXPECT_EQ(SelectAndApply(entries, 220)[0], 0u);
+  }
+  // A dip in bandwidth restarts the hold.
+  EXPECT_EQ(SelectAndApply(entries, 1000)[0], 0u);
+  EXPECT_EQ(SelectAndApply(entries, 1000)[0], 0u);
+  EXPECT_EQ(SelectAndApply(entries, 100)[0], 0u);
+  EXPECT_EQ(SelectAndApply(entries, 1000)[0], 0u);
+  EXPECT_EQ(SelectAndApply(entries, 1000)[0], 0u);
+  EXPECT_EQ(SelectAndApply(entries, 1000)[0], 2u);
+}
+TEST(SubscriptionQualitySelectorTest, AllocatesByPriority) {
+  std::vector<SubscriptionQualitySelector::Entry> entries;
+  entries.push_back(CreateEntry({100, 200, 400}, 1, 3));
+  entries.push_back(CreateEntry({100, 200, 400}, 2, 3));
+  std::vector<size_t> targets = SelectAndApply(entries, 600);
+  EXPECT_EQ(targets[0], 1u);
+  EXPECT_EQ(targets[1], 2u);
+  // Subscriptions with the same priority share bandwidth.
+  entries.push_back(CreateEntry({100, 200, 400}, 2, 3));
+  targets = SelectAndApply(entries, 550);
+  EXPECT_EQ(targets[0], 0u);
+  EXPECT_EQ(targets[1], 1u);
+  EXPECT_EQ(targets[2], 1u);
+}
+}  // namespace conference
+}  // namespace owt
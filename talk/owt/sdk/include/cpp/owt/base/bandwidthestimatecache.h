@@ -0,0 +1,75 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OWT_BASE_BANDWIDTHESTIMATECACHE_H_
+#define OWT_BASE_BANDWIDTHESTIMATECACHE_H_
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include "owt/base/export.h"
+namespace owt {
+namespace base {
+/**
+ @brief Bandwidth estimates of previous sessions.
+ @details When it's enabled by
+ GlobalConfiguration::SetBandwidthEstimateCacheEnabled, the converged send
+ and receive estimate of a session is recorded when the session ends, keyed by
+ the remote endpoint and the local network. The next session to the same
+ endpoint on the same network starts from the recorded send estimate instead
+ of the static start bitrate. The cache lives in memory. Applications persist
+ it across launches with Export and Import.
+*/
+class OWT_EXPORT BandwidthEstimateCache {
+ public:
+  /// Cache shared by all clients.
+  static BandwidthEstimateCache& Get();
+  BandwidthEstimateCache();
+  virtual ~BandwidthEstimateCache();
+  BandwidthEstimateCache(const BandwidthEstimateCache&) = delete;
+  BandwidthEstimateCache& operator=(const BandwidthEstimateCache&) = delete;
+  /**
+   @brief Record the estimate of a session.
+   @param endpoint Server host for conference, remote user ID for P2P.
+   @param network Fingerprint of the local network.
+   @param send_kbps Send side estimate. 0 if unknown.
+   @param receive_kbps Receive side estimate. 0 if unknown.
+  */
+  void Record(const std::string& endpoint,
+              const std::string& network,
+              int send_kbps,
+              int receive_kbps);
+  /// Get the estimate recorded for |endpoint| on |network|. Returns false if
+  /// there is no estimate, or it's too old.
+  bool Lookup(const std::string& endpoint,
+              const std::string& network,
+              int& send_kbps,
+              int& receive_kbps);
+  /// Serialize all estimates, so they can be persisted by application.
+  std::string Export();
+  /// Add estimates serialized by Export. Existing estimates for the same
+  /// endpoint and network are replaced. Returns false if |data| is malformed,
+  /// in which case nothing is added.
+  bool Import(const std::string& data);
+  /// Remove all estimates.
+  void Clear();
+  /// Number of estimates cached.
+  size_t Size();
+ private:
+  struct Entry {
+    int send_kbps;
+    int receive_kbps;
+    // Seconds since epoch. Wall clock is used because it's persisted across
+    // launches.
+    int64_t updated_time;
+  };
+  static std::string Key(const std::string& endpoint,
+                         const std::string& network);
+  // Remove the least recently updated entries when there are too many.
+  void Evict();
+  std::mutex mutex_;
+  std::map<std::string, Entry> entries_;
+};
+}  // namespace base
+}  // namespace owt
+#endif  // OWT_BASE_BANDWIDTHESTIMATECACHE_H_
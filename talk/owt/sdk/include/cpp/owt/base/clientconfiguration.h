@@ -4,6 +4,7 @@
 #ifndef OWT_BASE_CLIENTCONFIGURATION_H_
 #define OWT_BASE_CLIENTCONFIGURATION_H_
 
+#include <functional>
 #include <vector>
 #include <string>
 #include "owt/base/commontypes.h"
@@ -26,6 +27,16 @@ struct OWT_EXPORT ClientConfiguration {
    network experience. Default policy is collecting all candidates.
    */
   CandidateNetworkPolicy candidate_network_policy;
+  /**
+   @brief Executor for callbacks and observer events.
+   @details If set, callbacks and events are given to this function, which
+   usually runs them on an application owned thread pool. Tasks of the same
+   client or the same session still run one at a time in order, while tasks of
+   different sessions may run concurrently, so a slow callback of one session
+   does not delay others. If not set, all callbacks and events of a client run
+   on one internal thread.
+   */
+  std::function<void(std::function<void()>)> callback_executor;
 };
 }
 }
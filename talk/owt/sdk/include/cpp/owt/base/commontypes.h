@@ -102,12 +102,12 @@ struct OWT_EXPORT RtpEncodingParameters {
   // number of temporal layers requested to encoder, if supported.
   int num_temporal_layers = 1;
 
-  //  Currently this is implemented for the entire rtp sender by using
-  // the value of the first encoding parameter..
+  // Max bitrate of this encoding in bps. 0 means unset, and max bitrate of the
+  // stream applies. A negative value removes the limit.
   int max_bitrate_bps = 0;
 
   // Specifies the maximum framerate in fps for video. ignored by audio
-  // Not supported for screencast.
+  // Not supported for screencast. 0 or a negative value means no limit.
   int max_framerate = 0;
 
   // For video, scale the resolution down by this factor. ignored by audio
@@ -127,6 +127,10 @@ struct OWT_EXPORT RtpEncodingParameters {
 
   // The RTPSender/RTPReceiver's priority. Will impact the DSCP flag on Linux.
   NetworkPriority priority = NetworkPriority::kDefault;
+
+  // Scalability mode as defined in WebRTC-SVC, e.g. "L1T3". Empty to let
+  // encoder decide. Ignored by audio.
+  std::string scalability_mode = "";
 };
 
 /// Audio encoding parameters.
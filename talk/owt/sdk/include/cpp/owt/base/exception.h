@@ -32,7 +32,8 @@ enum class ExceptionType : int {
   kConferenceInvalidParam,
   kConferenceNotSupported,
   kConferenceInvalidToken,
-  kConferenceInvalidSession
+  kConferenceInvalidSession,
+  kConferenceTimeout
 };
 /// Class for exceptions
 class OWT_EXPORT Exception {
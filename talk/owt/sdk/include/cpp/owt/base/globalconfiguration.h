@@ -63,6 +63,7 @@ struct OWT_EXPORT IcePortRange {
 */
 class OWT_EXPORT GlobalConfiguration {
   friend class PeerConnectionDependencyFactory;
+  friend class PeerConnectionChannel;
 
  public:
 #if defined(WEBRTC_WIN) || defined(WEBRTC_LINUX)
@@ -110,6 +111,17 @@ class OWT_EXPORT GlobalConfiguration {
     min_bitrate_kbps_ = min_bitrate_kbps;
     max_bitrate_kbps_ = max_bitrate_kbps;
   }
+  /**
+   @brief Enable or disable the bandwidth estimate cache. When it's enabled, a
+   session starts from the estimate of the previous session to the same
+   endpoint on the same network, clamped to the limits set by
+   SetBweRateLimits. It's disabled by default.
+   @param enabled Bandwidth estimate cache is enabled or not.
+   @see BandwidthEstimateCache
+  */
+  static void SetBandwidthEstimateCacheEnabled(bool enabled) {
+    bandwidth_estimate_cache_enabled_ = enabled;
+  }
   /**
    @brief This sets the link MTU
    @param mtu_size The link mtu
@@ -321,6 +333,10 @@ class OWT_EXPORT GlobalConfiguration {
   static int start_bitrate_kbps_;
   static int min_bitrate_kbps_;
   static int max_bitrate_kbps_;
+  static bool GetBandwidthEstimateCacheEnabled() {
+    return bandwidth_estimate_cache_enabled_;
+  }
+  static bool bandwidth_estimate_cache_enabled_;
   static int GetLinkMTU() {
     return link_mtu_;
   }
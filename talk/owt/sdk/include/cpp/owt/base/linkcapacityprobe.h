@@ -0,0 +1,92 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OWT_BASE_LINKCAPACITYPROBE_H_
+#define OWT_BASE_LINKCAPACITYPROBE_H_
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "owt/base/exception.h"
+#include "owt/base/export.h"
+#include "owt/base/network.h"
+#include "owt/base/options.h"
+namespace owt {
+namespace base {
+class LinkCapacityProbeImpl;
+/// Result of a link capacity probe.
+struct OWT_EXPORT LinkCapacityProbeResult {
+  explicit LinkCapacityProbeResult()
+      : upload_kbps(0),
+        download_kbps(0),
+        rtt_ms(0),
+        jitter_ms(0),
+        packet_loss(0) {}
+  /// Throughput of probe data sent to the relay, in kbps.
+  uint32_t upload_kbps;
+  /// Throughput of probe data received from the relay, in kbps.
+  uint32_t download_kbps;
+  /// Round trip time to the relay, in milliseconds.
+  double rtt_ms;
+  /// Interarrival jitter of probe packets, in milliseconds.
+  double jitter_ms;
+  /// Ratio of probe packets lost, from 0 to 1.
+  double packet_loss;
+  /**
+   @brief Bitrate suggested for sending media, in kbps.
+   @details It leaves headroom for overhead and cross traffic. It can be used
+   as the start bitrate in GlobalConfiguration::SetBweRateLimits.
+  */
+  uint32_t SuggestedSendBitrate() const;
+  /// Bitrate suggested for receiving media, in kbps. It can be used as the
+  /// available bandwidth of SubscriptionQualityManager.
+  uint32_t SuggestedReceiveBitrate() const;
+  /// Limit max bitrate of encodings in |options| to SuggestedSendBitrate.
+  /// Audio is kept and video gets the rest, but no less than 100 kbps.
+  void ApplyTo(PublishOptions& options) const;
+};
+/// Configuration of a link capacity probe.
+struct OWT_EXPORT LinkCapacityProbeConfiguration {
+  explicit LinkCapacityProbeConfiguration()
+      : duration_ms(5000), max_bitrate_kbps(10000) {}
+  /// ICE servers. At least one TURN server is required.
+  std::vector<IceServer> ice_servers;
+  /// How long probe data is sent, in milliseconds. Must be positive.
+  int duration_ms;
+  /// Upper bound of probe bitrate, in kbps. Must be positive.
+  uint32_t max_bitrate_kbps;
+};
+/**
+ @brief Measures link capacity before joining a conference or calling a
+ remote user.
+ @details Probe data is sent from one local peer connection to another, both
+ forced to use a TURN server, so it loops through the relay: it is uploaded
+ to the relay and downloaded back. Probe data is sent on an unreliable,
+ unordered data channel as fast as its congestion control allows, up to
+ |max_bitrate_kbps|. Because both directions carry the same flow, upload and
+ download throughput are both bounded by the slower direction.
+*/
+class OWT_EXPORT LinkCapacityProbe {
+ public:
+  static std::shared_ptr<LinkCapacityProbe> Create(
+      const LinkCapacityProbeConfiguration& configuration);
+  virtual ~LinkCapacityProbe();
+  /**
+   @brief Start probing.
+   @param on_success Invoked with the result after probing for
+   |duration_ms|.
+   @param on_failure Invoked if the configuration is invalid, the relay
+   cannot be reached, or probing is stopped.
+  */
+  void Start(std::function<void(LinkCapacityProbeResult)> on_success,
+             std::function<void(std::unique_ptr<Exception>)> on_failure);
+  /// Stop probing and release connections.
+  void Stop();
+ private:
+  explicit LinkCapacityProbe(
+      const LinkCapacityProbeConfiguration& configuration);
+  std::shared_ptr<LinkCapacityProbeImpl> impl_;
+};
+}  // namespace base
+}  // namespace owt
+#endif  // OWT_BASE_LINKCAPACITYPROBE_H_
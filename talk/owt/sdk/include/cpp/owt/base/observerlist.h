@@ -0,0 +1,141 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OWT_BASE_OBSERVERLIST_H_
+#define OWT_BASE_OBSERVERLIST_H_
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+namespace owt {
+namespace base {
+/**
+  @brief A thread-safe list of observers.
+  @details Adding or removing an observer replaces the whole list, so a
+  snapshot never changes once it's taken. Events are dispatched on a snapshot
+  without holding any lock, and observers may add or remove observers in their
+  callbacks.
+
+  An observer is not called by ForEach after Remove returns, so it can be
+  destroyed right after it's removed. Remove blocks until ForEach calls on
+  other threads that may still reach the observer are finished. Therefore
+  Remove must not be called with a lock held that observers take in their
+  callbacks. When Remove is called in a callback of the same list, it doesn't
+  wait, to avoid deadlocks between threads dispatching at the same time.
+  Snapshots returned by Get are not covered, and must not be kept or posted to
+  other threads.
+*/
+template <typename T>
+class ObserverList final {
+ public:
+  typedef std::vector<std::reference_wrapper<T>> Snapshot;
+  ObserverList()
+      : observers_(std::make_shared<const Snapshot>()), removal_count_(0) {}
+  ObserverList(const ObserverList&) = delete;
+  ObserverList& operator=(const ObserverList&) = delete;
+  /// Add |observer|. Return false if it has already been added.
+  bool Add(T& observer) {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (Find(*observers_, observer) != observers_->end())
+      return false;
+    auto observers = std::make_shared<Snapshot>(*observers_);
+    observers->push_back(observer);
+    observers_ = std::move(observers);
+    return true;
+  }
+  /// Remove |observer|. Return false if it has not been added.
+  bool Remove(T& observer) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = Find(*observers_, observer);
+    if (it == observers_->end())
+      return false;
+    auto observers = std::make_shared<Snapshot>(observers_->begin(), it);
+    observers->insert(observers->end(), it + 1, observers_->end());
+    observers_ = std::move(observers);
+    removal_count_++;
+    const std::thread::id current_thread = std::this_thread::get_id();
+    for (const Dispatch* dispatch : dispatches_) {
+      if (dispatch->thread == current_thread)
+        return true;
+    }
+    dispatch_finished_.wait(lock, [&] {
+      for (const Dispatch* dispatch : dispatches_) {
+        const Snapshot& snapshot = *dispatch->observers;
+        if (Find(snapshot, observer) != snapshot.end())
+          return false;
+      }
+      return true;
+    });
+    return true;
+  }
+  /// Current observers. Observers added or removed later are not reflected in
+  /// the returned snapshot.
+  std::shared_ptr<const Snapshot> Get() const {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return observers_;
+  }
+  /// Call |func| with each observer in a snapshot. Observers removed during
+  /// the dispatch are skipped.
+  template <typename F>
+  void ForEach(F func) const {
+    Dispatch dispatch(*this);
+    for (auto& observer : *dispatch.observers) {
+      if (removal_count_ != dispatch.removal_count && !Contains(observer.get()))
+        continue;
+      func(observer.get());
+    }
+  }
+
+ private:
+  // Registers a ForEach call in progress, so Remove can wait for it.
+  struct Dispatch final {
+    explicit Dispatch(const ObserverList& list)
+        : list(list), thread(std::this_thread::get_id()) {
+      const std::lock_guard<std::mutex> lock(list.mutex_);
+      observers = list.observers_;
+      removal_count = list.removal_count_;
+      list.dispatches_.push_back(this);
+    }
+    Dispatch(const Dispatch&) = delete;
+    Dispatch& operator=(const Dispatch&) = delete;
+    ~Dispatch() {
+      {
+        const std::lock_guard<std::mutex> lock(list.mutex_);
+        list.dispatches_.erase(std::find(list.dispatches_.begin(),
+                                         list.dispatches_.end(), this));
+      }
+      list.dispatch_finished_.notify_all();
+    }
+    const ObserverList& list;
+    const std::thread::id thread;
+    std::shared_ptr<const Snapshot> observers;
+    uint64_t removal_count;
+  };
+  static typename Snapshot::const_iterator Find(const Snapshot& observers,
+                                                const T& observer) {
+    return std::find_if(observers.begin(), observers.end(),
+                        [&observer](std::reference_wrapper<T> o) {
+                          return &observer == &o.get();
+                        });
+  }
+  bool Contains(const T& observer) const {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return Find(*observers_, observer) != observers_->end();
+  }
+  mutable std::mutex mutex_;
+  mutable std::condition_variable dispatch_finished_;
+  std::shared_ptr<const Snapshot> observers_;
+  // Increased each time an observer is removed, so a dispatch only looks up
+  // the current list if its snapshot may be stale.
+  std::atomic<uint64_t> removal_count_;
+  // ForEach calls in progress.
+  mutable std::vector<Dispatch*> dispatches_;
+};
+}  // namespace base
+}  // namespace owt
+#endif  // OWT_BASE_OBSERVERLIST_H_
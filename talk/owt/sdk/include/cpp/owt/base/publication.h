@@ -43,6 +43,27 @@ class OWT_EXPORT Publication {
   virtual void GetStats(
       std::function<void(std::shared_ptr<RTCStatsReport>)> on_success,
       std::function<void(std::unique_ptr<Exception>)> on_failure) = 0;
+  /**
+   @brief Update encoding parameters of current publication's video.
+   @details Bitrate, framerate, resolution scale, scalability mode and whether
+   an encoding is active are updated without renegotiation. Each item of
+   |parameters| is applied to the simulcast layer with the same rid, or to the
+   layer at the same index if rid is empty. Layers not listed keep their
+   current parameters. For a listed layer, max bitrate of 0 falls back to the
+   stream's max bitrate and a negative one removes the limit, while max
+   framerate of 0 removes the limit. The default implementation fails.
+  */
+  virtual void UpdateEncodingParameters(
+      const std::vector<RtpEncodingParameters>& parameters,
+      std::function<void()> on_success,
+      std::function<void(std::unique_ptr<Exception>)> on_failure) {
+    if (on_failure) {
+      std::unique_ptr<Exception> e(
+          new Exception(ExceptionType::kUnknown,
+                        "Updating encoding parameters is not supported."));
+      on_failure(std::move(e));
+    }
+  }
   /// Stop current publication.
   virtual void Stop() = 0;
   /// Register an observer onto this publication.
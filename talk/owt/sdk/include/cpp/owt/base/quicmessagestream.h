@@ -0,0 +1,114 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OWT_BASE_QUICMESSAGESTREAM_H_
+#define OWT_BASE_QUICMESSAGESTREAM_H_
+#ifdef OWT_ENABLE_QUIC
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "owt/base/export.h"
+#include "owt/base/observerlist.h"
+#include "owt/base/stream.h"
+namespace owt {
+namespace base {
+class MessageFramer;
+/// Observer for QuicMessageStream.
+class OWT_EXPORT QuicMessageStreamObserver {
+ public:
+  virtual ~QuicMessageStreamObserver() = default;
+  /// Triggered when a whole message is received. |data| is only valid in this
+  /// callback. Events are triggered on the same thread as QuicStreamObserver
+  /// events of the underlying stream.
+  virtual void OnMessage(const uint8_t* data, size_t length) = 0;
+  /// Triggered when a message received exceeds max message size. No more
+  /// messages are delivered after this event.
+  virtual void OnMessageTooLarge() {}
+};
+/// Configuration for QuicMessageStream.
+struct OWT_EXPORT QuicMessageStreamConfiguration {
+  /// Largest message can be sent or received.
+  size_t max_message_size = 1024 * 1024;
+  /// Messages sent in this interval are written to the stream together. 0
+  /// means writing each message once it's sent.
+  int flush_interval_ms = 0;
+  /// Messages are written without waiting for flush interval when this many
+  /// bytes are pending.
+  size_t max_batch_size = 16 * 1024;
+};
+/**
+  @brief Sends and receives messages on a QuicStream.
+  @details A QuicStream is a byte stream. Each message is prefixed by its
+  length as a variable-length integer defined in RFC 9000 section 16, so
+  messages are delivered whole even when they are split across reads. Both
+  sides of a stream must use QuicMessageStream.
+*/
+class OWT_EXPORT QuicMessageStream final
+    : public std::enable_shared_from_this<QuicMessageStream> {
+ public:
+  /// Result of Send and Flush.
+  enum class SendStatus : int {
+    kSuccess = 0,  ///< The message is accepted.
+    kWouldBlock,   ///< Too much data is buffered. Nothing is written.
+    kClosed,       ///< The stream cannot be written anymore.
+    kTooLarge,     ///< The message exceeds max message size. Nothing is
+                   ///< written.
+  };
+  /// Create a message stream on |stream|. Don't read from or write to
+  /// |stream| directly afterwards.
+  static std::shared_ptr<QuicMessageStream> Create(
+      std::shared_ptr<QuicStream> stream,
+      const QuicMessageStreamConfiguration& configuration =
+          QuicMessageStreamConfiguration());
+  ~QuicMessageStream();
+  /**
+   @brief Send a message.
+   @return SendStatus::kWouldBlock if the message is not accepted because too
+   much data is buffered. Try again after QuicStreamObserver::OnBufferedDataLow
+   on the underlying stream.
+  */
+  SendStatus Send(const uint8_t* data, size_t length);
+  /// Write messages waiting for flush interval now.
+  SendStatus Flush();
+  /**
+   @brief Register an observer on the stream.
+   @details Messages already received are delivered asynchronously, on the
+   thread of QuicStreamObserver events.
+  */
+  void AddObserver(QuicMessageStreamObserver& observer);
+  /// De-register an observer on the stream.
+  void RemoveObserver(QuicMessageStreamObserver& observer);
+
+ private:
+  // Observes the underlying stream on behalf of a QuicMessageStream, which
+  // may be destroyed while an event is being dispatched.
+  class StreamObserver;
+  QuicMessageStream(std::shared_ptr<QuicStream> stream,
+                    const QuicMessageStreamConfiguration& configuration);
+  // Events of the underlying stream.
+  void OnCanRead();
+  void OnBufferedDataLow();
+  // Write |batch_|. |mutex_| must be held.
+  SendStatus FlushBatch();
+  // Flush after |delay_ms|. |mutex_| must be held.
+  void ScheduleFlush(int delay_ms);
+  std::shared_ptr<QuicStream> stream_;
+  std::unique_ptr<StreamObserver> stream_observer_;
+  QuicMessageStreamConfiguration configuration_;
+  std::unique_ptr<MessageFramer> framer_;
+  ObserverList<QuicMessageStreamObserver> observers_;
+  // Set when a message is too large, and the stream cannot be parsed anymore.
+  bool receive_failed_;
+  // Following members are guarded by |mutex_|.
+  std::mutex mutex_;
+  // Framed messages not written yet. Reused for each batch.
+  std::vector<uint8_t> batch_;
+  bool flush_scheduled_;
+  // Set when |batch_| is not accepted by the stream.
+  bool blocked_;
+};
+}  // namespace base
+}  // namespace owt
+#endif  // OWT_ENABLE_QUIC
+#endif  // OWT_BASE_QUICMESSAGESTREAM_H_
@@ -4,6 +4,9 @@
 #ifndef OWT_BASE_STREAM_H_
 #define OWT_BASE_STREAM_H_
 #include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -12,6 +15,7 @@
 #include "owt/base/exception.h"
 #include "owt/base/localcamerastreamparameters.h"
 #include "owt/base/macros.h"
+#include "owt/base/observerlist.h"
 #include "owt/base/options.h"
 #include "owt/base/videoencoderinterface.h"
 #include "owt/base/audioplayerinterface.h"
@@ -19,6 +23,9 @@
 #include "owt/quic/web_transport_stream_interface.h"
 #endif
 
+namespace rtc {
+class TaskQueue;
+}  // namespace rtc
 namespace webrtc {
 class MediaStreamInterface;
 class VideoTrackSourceInterface;
@@ -172,18 +179,59 @@ class OWT_EXPORT Stream {
   void SetVideoTracksEnabled(bool enabled);
   bool ended_;
   std::string id_;
-  mutable std::mutex observer_mutex_;
-  std::vector<std::reference_wrapper<StreamObserver>> observers_;
+  ObserverList<StreamObserver> observers_;
 };
 
 #ifdef OWT_ENABLE_QUIC
+/**
+  @brief Observer for QuicStream.
+  @details Events are triggered on the client's callback queue, see
+  ClientConfiguration::callback_executor, unless an event executor is set on
+  the stream. Don't block in these callbacks without an event executor.
+*/
+class OWT_EXPORT QuicStreamObserver {
+ public:
+  virtual ~QuicStreamObserver() = default;
+  /// Triggered when new data can be read from the stream.
+  virtual void OnCanRead() {}
+  /// Triggered when more data can be written to the stream.
+  virtual void OnCanWrite() {}
+  /// Triggered when all data from remote side has been received. The stream
+  /// is no longer readable after this event.
+  virtual void OnFinRead() {}
+  /// Triggered when the stream is closed by SDK, e.g. the subscription it
+  /// belongs to is stopped. The stream cannot be used anymore.
+  virtual void OnReset() {}
+  /// Triggered when data buffered for sending drops to the low watermark after
+  /// reaching the high watermark. See QuicStream::SetBufferWatermarks.
+  virtual void OnBufferedDataLow() {}
+};
+/// A contiguous range of bytes, used by QuicStream::WriteV and
+/// QuicStream::PeekRead.
+struct OWT_EXPORT QuicStreamBuffer {
+  const uint8_t* data;
+  size_t length;
+};
 /// A QuicStream can be fetched from a published LocalStream for data,
 /// on which you can write to server;
 /// Or from a subscription from server for data, on which you can read.
-class OWT_EXPORT QuicStream : public owt::quic::WebTransportStreamInterface::Visitor {
+class OWT_EXPORT QuicStream
+    : public owt::quic::WebTransportStreamInterface::Visitor,
+      public std::enable_shared_from_this<QuicStream> {
  public:
+  /// Result of WriteMessage.
+  enum class WriteStatus : int {
+    kSuccess = 0,  ///< The whole message is accepted.
+    kWouldBlock,   ///< Too much data is buffered. Nothing is written.
+    kClosed,       ///< The stream cannot be written anymore.
+  };
+  /// |event_queue| is where events are triggered if no event executor is set.
+  /// Data queued by WriteMessage is written on |transport_queue| if it's set.
   QuicStream(owt::quic::WebTransportStreamInterface* quic_stream,
-             const std::string& session_id);
+             const std::string& session_id,
+             std::shared_ptr<rtc::TaskQueue> event_queue,
+             std::weak_ptr<rtc::TaskQueue> transport_queue =
+                 std::weak_ptr<rtc::TaskQueue>());
   ~QuicStream();
 
   /**
@@ -195,6 +243,16 @@ class OWT_EXPORT QuicStream : public owt::quic::WebTransportStreamInterface::Vis
    @param Actual bytes written to server.
   */
   size_t Write(uint8_t* data, size_t length);
+  /**
+   @brief Write data in multiple buffers to server.
+   @details Buffers are written in order as if they were concatenated, without
+   copying them into a temporary buffer. It stops at the first buffer not
+   fully accepted by WebTransport.
+   @param buffers Buffers to be written.
+   @param count Number of buffers.
+   @return Actual bytes written to server.
+  */
+  size_t WriteV(const QuicStreamBuffer* buffers, size_t count);
   /**
    @brief Read data from server.
    @details Read data from server with WebTransport. Should only
@@ -214,32 +272,131 @@ class OWT_EXPORT QuicStream : public owt::quic::WebTransportStreamInterface::Vis
    @return Bytes of data pending to be sent.
   */
   uint64_t BufferedDataBytes() const;
+  /**
+   @brief Read all data currently available on the stream without blocking.
+   @details It's usually called in QuicStreamObserver::OnCanRead instead of
+   polling ReadableBytes().
+   @param buffer Data read is appended to it.
+   @return Size of data read.
+  */
+  size_t ReadAll(std::vector<uint8_t>& buffer);
+  /**
+   @brief Get data available on the stream without copying it out.
+   @details The returned buffer is owned by the stream. It's valid until the
+   next call to PeekRead, ConsumeRead, Read or ReadAll. Data is kept until it's
+   consumed by ConsumeRead, so a partial message can be left for the next
+   PeekRead. Reading methods should not be called concurrently.
+   @return Data available, or an empty buffer if there is none.
+  */
+  QuicStreamBuffer PeekRead();
+  /**
+   @brief Drop data returned by PeekRead.
+   @param length Bytes to drop from the beginning of data returned by
+   PeekRead. It must not exceed the length returned.
+  */
+  void ConsumeRead(size_t length);
+  /**
+   @brief Set watermarks of data buffered for sending.
+   @details Data buffered includes data buffered by WebTransport and data
+   queued by WriteMessage. Once it reaches |high_watermark| bytes,
+   WriteMessage returns WriteStatus::kWouldBlock until it drops to
+   |low_watermark| bytes, and QuicStreamObserver::OnBufferedDataLow is
+   triggered then. Defaults are 1 MB and 256 KB.
+  */
+  void SetBufferWatermarks(uint64_t high_watermark, uint64_t low_watermark);
+  /**
+   @brief Write a whole message to server.
+   @details Unlike Write, the part of the message not accepted by WebTransport
+   is queued and written when the stream becomes writable, so a message is
+   never truncated. Don't mix it with Write on the same stream, otherwise data
+   may be reordered.
+   @return WriteStatus::kWouldBlock if buffered data has reached the high
+   watermark, and nothing is written. Try again after
+   QuicStreamObserver::OnBufferedDataLow.
+  */
+  WriteStatus WriteMessage(const uint8_t* data, size_t length);
+  /// Register an observer on the stream. If data is already readable, an
+  /// OnCanRead event is triggered asynchronously.
+  void AddObserver(QuicStreamObserver& observer);
+  /// De-register an observer on the stream.
+  void RemoveObserver(QuicStreamObserver& observer);
+  /**
+   @brief Set the executor for events of this stream.
+   @details Events are given to |executor| in order and one at a time, so
+   observers may block without stalling other callbacks of the client. If not
+   set, events are triggered on the client's callback queue.
+  */
+  void SetEventExecutor(std::function<void(std::function<void()>)> executor);
   void SetVisitor(owt::quic::WebTransportStreamInterface::Visitor* visitor) {
-    if (quic_stream_ && visitor) {
-      quic_stream_->SetVisitor(visitor);
+    auto quic_stream = quic_stream_.load();
+    if (quic_stream && visitor) {
+      quic_stream->SetVisitor(visitor);
     }
   }
   /** @cond */
   // Implemnents QuicTransportStreamInterface::Visitor
-  void OnCanRead() {
-    can_read_ = true;
-  }
-  void OnCanWrite() {
-    can_write_ = true;
-  }
-  void OnFinRead() {
-    // OnFinRead the stream is no longer readable/writable
-    fin_read_ = true;
-    can_read_ = false;
-  }
+  void OnCanRead();
+  void OnCanWrite();
+  void OnFinRead();
+  // Called by SDK when the underlying stream is no longer usable.
+  void OnReset();
+  // Called by SDK before WebTransport is destroyed. The underlying stream is
+  // not accessed afterwards.
+  void OnTransportClosed();
+  // Trigger OnCanRead on the event queue, e.g. for data left by PeekRead when
+  // a reader starts observing the stream.
+  void TriggerCanRead();
+  // Run |task| where data queued by WriteMessage is written, so it doesn't
+  // block the thread calling this method.
+  void PostSendTask(std::function<void()> task);
   /** @endcond */
  private:
-  // Owned by WebTransportClientImpl.
-  owt::quic::WebTransportStreamInterface* quic_stream_;
+  // Trigger |event| on all observers.
+  void TriggerEvent(std::function<void(QuicStreamObserver&)> event);
+  // Write data queued by WriteMessage as much as WebTransport accepts.
+  // |send_mutex_| must be held.
+  void FlushSendQueue();
+  // Write queued data and update watermark state. Runs on |transport_queue_|
+  // if it exists.
+  void Drain();
+  // Update watermark state after data is written or sent.
+  void CheckWatermarks();
+  // Same as CheckWatermarks, with |send_mutex_| held by |lock|. |lock| is
+  // released before triggering events.
+  void UpdateWatermarks(std::unique_lock<std::mutex>& lock);
+  // Owned by WebTransportClientImpl. Reset by OnTransportClosed with
+  // |send_mutex_| held.
+  std::atomic<owt::quic::WebTransportStreamInterface*> quic_stream_;
   std::string session_id_;
   std::atomic<bool> can_read_;
   std::atomic<bool> can_write_;
   std::atomic<bool> fin_read_;
+  std::atomic<bool> reset_;
+  // Data read from WebTransport by PeekRead. The first |read_buffer_offset_|
+  // bytes have been consumed.
+  std::vector<uint8_t> read_buffer_;
+  size_t read_buffer_offset_;
+  ObserverList<QuicStreamObserver> observers_;
+  // Queue given at construction, used if no event executor is set.
+  const std::shared_ptr<rtc::TaskQueue> default_event_queue_;
+  // Owned by the WebTransport channel.
+  const std::weak_ptr<rtc::TaskQueue> transport_queue_;
+  std::mutex event_queue_mutex_;
+  std::shared_ptr<rtc::TaskQueue> event_queue_;
+  // Following members are guarded by |send_mutex_|.
+  std::mutex send_mutex_;
+  uint64_t high_watermark_;
+  uint64_t low_watermark_;
+  // Set after reaching the high watermark until dropping to the low one.
+  bool above_high_watermark_;
+  // Messages not accepted by WebTransport yet. The first
+  // |send_queue_offset_| bytes of the front one have been written.
+  std::deque<std::vector<uint8_t>> send_queue_;
+  size_t send_queue_offset_;
+  uint64_t queued_bytes_;
+  // WebTransport doesn't notify when buffered data is sent, so it's checked
+  // periodically while above the high watermark.
+  bool drain_check_scheduled_;
 };
 #endif // OWT_ENABLE_QUIC
 
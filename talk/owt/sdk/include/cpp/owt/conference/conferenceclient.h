@@ -4,16 +4,23 @@
 #ifndef OWT_CONFERENCE_CONFERENCECLIENT_H_
 #define OWT_CONFERENCE_CONFERENCECLIENT_H_
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 #include <set>
+#include <thread>
 #include "owt/base/commontypes.h"
 #include "owt/base/clientconfiguration.h"
 #include "owt/base/connectionstats.h"
 #include "owt/base/macros.h"
+#include "owt/base/observerlist.h"
 #include "owt/base/options.h"
 #include "owt/base/stream.h"
 #include "owt/base/exception.h"
@@ -52,6 +59,41 @@ typedef std::string cert_fingerprint_t;
   created.
 */
 struct OWT_EXPORT ConferenceClientConfiguration : public ClientConfiguration {
+  /**
+   @brief Share one PeerConnection among all subscriptions.
+   @details If true, subscriptions are carried by one bundled PeerConnection
+   with MCU, so they share ICE, DTLS and congestion control. Otherwise, a
+   PeerConnection is created for each subscription. MCU must support reusing
+   WebRTC transport for this mode. Publications are not affected. Default is
+   false.
+  */
+  bool multiplex_subscriptions = false;
+  /**
+   @brief Number of PeerConnections created in advance.
+   @details Pre-created PeerConnections have their certificates generated and
+   ICE candidates gathered, so Publish and Subscribe don't wait for them. The
+   pool is filled after joining a conference, and refilled in background after
+   a PeerConnection is taken. 0 disables the pool. Default is 0.
+  */
+  int peer_connection_pool_size = 0;
+  /**
+   @brief Time in seconds a pre-created PeerConnection stays in the pool.
+   @details Expired PeerConnections are replaced by new ones, so candidates
+   gathered are not too old to use. It must be positive, otherwise the pool is
+   disabled. Default is 60.
+  */
+  int peer_connection_pool_ttl = 60;
+  /**
+   @brief Time in milliseconds to wait for the ack of a signaling request.
+   @details A request not acknowledged in time fails with kConferenceTimeout.
+   0 disables the timeout. Default is 30000.
+  */
+  int signaling_request_timeout = 30000;
+  /**
+   @brief Timeouts in milliseconds for specific signaling events, e.g.
+   "publish". They override |signaling_request_timeout|.
+  */
+  std::unordered_map<std::string, int> signaling_request_timeouts;
 #ifdef OWT_ENABLE_QUIC
  public:
   // This function sets trusted server certificate fingerprints for
@@ -63,6 +105,37 @@ struct OWT_EXPORT ConferenceClientConfiguration : public ClientConfiguration {
 #endif
 };
 
+/// Statistics of signaling requests sent to conference server.
+struct OWT_EXPORT SignalingRequestStats {
+  /// Number of requests sent but not acknowledged yet.
+  size_t in_flight = 0;
+  /// Number of requests failed because of timeout.
+  uint64_t timed_out = 0;
+  /// Upper bounds in milliseconds of buckets in |rtt_histogram|. The last
+  /// bucket of |rtt_histogram| has no upper bound.
+  std::vector<int> rtt_bucket_bounds;
+  /// Number of acks received whose round trip time falls in each bucket.
+  std::vector<uint64_t> rtt_histogram;
+};
+/// Latency of running success callbacks after acks are received.
+struct OWT_EXPORT SignalingAckCallbackStats {
+  /// Number of callbacks executed.
+  uint64_t count = 0;
+  /// Sum of the time callbacks waited in queue, in microseconds.
+  int64_t total_queue_delay_us = 0;
+  /// Maximum time a callback waited in queue, in microseconds.
+  int64_t max_queue_delay_us = 0;
+  /// Sum of the time callbacks took to run, in microseconds.
+  int64_t total_run_time_us = 0;
+};
+/// Result of subscribing a stream in a batch.
+struct OWT_EXPORT SubscribeResult {
+  /// The subscription, or nullptr if the stream failed to be subscribed.
+  std::shared_ptr<ConferenceSubscription> subscription;
+  /// Reason of the failure, or nullptr if the stream is subscribed.
+  std::shared_ptr<Exception> error;
+};
+
 class RemoteMixedStream;
 class ConferencePeerConnectionChannel;
 #ifdef OWT_ENABLE_QUIC
@@ -114,8 +187,7 @@ class OWT_EXPORT Participant {
     std::string id_;        /// Unique id assigned by MCU portal
     std::string role_;      /// Role of the participant
     std::string user_id_;   /// User account system assigned user id.
-    mutable std::mutex observer_mutex_;
-    std::vector<std::reference_wrapper<ParticipantObserver>> observers_;
+    ObserverList<ParticipantObserver> observers_;
 };
 /**
   @brief Information about the conference.
@@ -128,10 +200,14 @@ class OWT_EXPORT ConferenceInfo {
     virtual ~ConferenceInfo() {}
     /// Current remote streams in the conference.
     std::vector<std::shared_ptr<RemoteStream>> RemoteStreams() const {
+      FlushPendingEntries();
+      const std::lock_guard<std::mutex> lock(remote_streams_mutex_);
       return remote_streams_;
     }
     /// Current participant list in the conference.
     std::vector<std::shared_ptr<Participant>> Participants() const {
+      FlushPendingEntries();
+      const std::lock_guard<std::mutex> lock(participants_mutex_);
       return participants_;
     }
     /// Conference ID.
@@ -158,14 +234,53 @@ class OWT_EXPORT ConferenceInfo {
     // Trigger stream mute/unmute events
     void TriggerOnStreamMuteOrUnmute(const std::string& stream_id, owt::base::TrackKind track_kind, bool muted);
   private:
+    // Participants and streams in the room snapshot received on joining, as
+    // well as room events received before the snapshot is fully parsed, are
+    // queued as pending entries. They are parsed in batches on event queue,
+    // or all at once when remote streams or participants are accessed.
+    // Entries run in order and one at a time, without holding
+    // |pending_entries_mutex_|, so observers triggered by them may access
+    // this object.
+    //
+    // Append |entry| to pending entries.
+    void EnqueueEntry(std::function<void()> entry);
+    // Run |entry| immediately if there is no pending entry, otherwise append
+    // it to pending entries to keep events in order.
+    void RunOrEnqueueEntry(std::function<void()> entry);
+    // Run at most |max_entries| pending entries. Return true if there are
+    // still pending entries left for the caller to run. It returns false
+    // immediately if entries are being run on another thread, which runs all
+    // of them.
+    bool ProcessPendingEntries(size_t max_entries) const;
+    // Run all pending entries. It waits for entries being run on another
+    // thread. When called by an entry, it returns immediately, and entries
+    // after the calling one are not run yet.
+    void FlushPendingEntries() const;
+    bool RunPendingEntries(size_t max_entries, bool wait) const;
+    // Drop pending entries, e.g. when leaving the conference. The entry being
+    // run, if any, is not affected.
+    void ClearPendingEntries();
     bool ParticipantPresent(const std::string& participant_id);
     bool RemoteStreamPresent(const std::string& stream_id);
+    // Return the participant/stream with specific ID, or nullptr if not found.
+    std::shared_ptr<Participant> FindParticipant(const std::string& participant_id) const;
+    std::shared_ptr<RemoteStream> FindRemoteStream(const std::string& stream_id) const;
     std::string id_;                           // Unique id that identifies the conference.
     mutable std::mutex participants_mutex_;
-    std::vector<std::shared_ptr<Participant>> participants_;    // Participants in the conference
+    std::vector<std::shared_ptr<Participant>> participants_;    // Participants in the conference, in joining order.
+    // Index of |participants_| keyed by participant ID.
+    std::unordered_map<std::string, std::shared_ptr<Participant>> participants_by_id_;
     mutable std::mutex remote_streams_mutex_;
-    std::vector<std::shared_ptr<RemoteStream>> remote_streams_; // Remote streams in the conference.
+    std::vector<std::shared_ptr<RemoteStream>> remote_streams_; // Remote streams in the conference, in adding order.
+    // Index of |remote_streams_| keyed by stream ID.
+    std::unordered_map<std::string, std::shared_ptr<RemoteStream>> remote_streams_by_id_;
     std::shared_ptr<Participant> self_;                           // Self participant in the conference.
+    mutable std::mutex pending_entries_mutex_;
+    mutable std::condition_variable pending_entries_cv_;
+    mutable std::deque<std::function<void()>> pending_entries_;
+    // Thread running pending entries, or default ID if no one is running them.
+    // Guarded by |pending_entries_mutex_|.
+    mutable std::thread::id draining_thread_;
 };
 /** @cond */
 class OWT_EXPORT ConferenceSocketSignalingChannelObserver {
@@ -196,6 +311,9 @@ class OWT_EXPORT ConferencePeerConnectionChannelObserver {
   virtual void OnStreamError(
       std::shared_ptr<Stream> stream,
       std::shared_ptr<const Exception> exception) = 0;
+  // Triggered when ICE connection recovers from disconnected.
+  virtual void OnConnectionRecovered(const std::string& session_id,
+                                     int64_t freeze_duration_ms) {}
 };
 #ifdef OWT_ENABLE_QUIC
 // The visitor interface for QuicTransportClientInterface
@@ -247,6 +365,15 @@ class OWT_EXPORT ConferenceClientObserver {
     @brief Triggers when server is disconnected.
   */
   virtual void OnServerDisconnected(){}
+  /**
+    @brief Triggers when the ICE connection of a publication or subscription
+    recovers from disconnected, either by itself or after an automatic ICE
+    restart.
+    @param session_id ID of the publication or subscription.
+    @param freeze_duration_ms How long media was interrupted, in milliseconds.
+  */
+  virtual void OnConnectionRecovered(const std::string& session_id,
+                                     int64_t freeze_duration_ms) {}
 };
 
 /// An asynchronous class for app to communicate with a conference in MCU.
@@ -287,6 +414,18 @@ class OWT_EXPORT ConferenceClient final
   void Leave(
       std::function<void()> on_success,
       std::function<void(std::unique_ptr<Exception>)> on_failure);
+  /**
+    @brief Leave current conference.
+    @details PeerConnections of all publications and subscriptions are closed
+    asynchronously after sending leave to the server.
+    @param on_released Invoked after all PeerConnections are closed and their
+    media resources are released. It may be invoked before or after
+    |on_success|.
+  */
+  void Leave(
+      std::function<void()> on_success,
+      std::function<void(std::unique_ptr<Exception>)> on_failure,
+      std::function<void()> on_released);
   /**
     @brief Publish the stream to the current room.
     @param stream The stream to be published.
@@ -325,6 +464,25 @@ class OWT_EXPORT ConferenceClient final
       const SubscribeOptions& options,
       std::function<void(std::shared_ptr<ConferenceSubscription>)> on_success,
       std::function<void(std::unique_ptr<Exception>)> on_failure);
+  /**
+    @brief Subscribe a list of streams from the current room.
+    @details Subscription requests of all streams are sent without waiting for
+    previous ones to complete. When subscriptions are multiplexed, all streams
+    are added to the shared PeerConnection with one renegotiation. So
+    subscribing a gallery of streams takes about one signaling round trip
+    instead of one round trip per stream.
+    @param streams The remote streams to be subscribed and options for each of
+    them.
+    @param on_success Triggered when all requests are completed, even if some
+    of them failed. Results are in the same order as |streams|.
+    @param on_failure Triggered if the requests cannot be sent, e.g. signaling
+    channel is offline.
+  */
+  void Subscribe(
+      const std::vector<std::pair<std::shared_ptr<RemoteStream>,
+                                  SubscribeOptions>>& streams,
+      std::function<void(std::vector<SubscribeResult>)> on_success,
+      std::function<void(std::unique_ptr<Exception>)> on_failure);
   /**
     @brief Send messsage to all participants in the conference.
     @param message The message to be sent.
@@ -378,6 +536,8 @@ class OWT_EXPORT ConferenceClient final
   virtual void OnStreamError(
       std::shared_ptr<Stream> stream,
       std::shared_ptr<const Exception> exception) override;
+  virtual void OnConnectionRecovered(const std::string& session_id,
+                                     int64_t freeze_duration_ms) override;
   // Provide access for Publication and Subscription instances.
   /**
     @brief Un-publish the stream from the current room.
@@ -423,6 +583,26 @@ class OWT_EXPORT ConferenceClient final
       std::function<void(
           const std::vector<const webrtc::StatsReport*>& reports)> on_success,
       std::function<void(std::unique_ptr<Exception>)> on_failure);
+  /**
+    @brief Update encoding parameters of a publication's video without
+    renegotiation.
+  */
+  void UpdateEncodingParameters(
+      const std::string& session_id,
+      const std::vector<RtpEncodingParameters>& parameters,
+      std::function<void()> on_success,
+      std::function<void(std::unique_ptr<Exception>)> on_failure);
+  /**
+    @brief Get statistics of signaling requests, including requests in flight
+    and round trip time of acks.
+  */
+  SignalingRequestStats GetSignalingRequestStats() const;
+  /**
+    @brief Get latency statistics of callbacks triggered by signaling acks.
+    @details Callbacks of acks run in order on a dedicated queue. A large queue
+    delay means some callbacks, including application ones, take too long.
+  */
+  SignalingAckCallbackStats GetSignalingAckCallbackStats() const;
   /**
     @brief Mute a session's track specified by |track_kind|.
   */
@@ -463,17 +643,62 @@ class OWT_EXPORT ConferenceClient final
       std::function<void(std::unique_ptr<Exception>)> on_failure);
   PeerConnectionChannelConfiguration GetPeerConnectionChannelConfiguration()
       const;
+  // Return true and mark |stream| as subscribed if it can be subscribed with
+  // |options|. Otherwise, return false with |failure_message|.
+  bool ReserveSubscription(std::shared_ptr<RemoteStream> stream,
+                           const SubscribeOptions& options,
+                           std::string& failure_message);
+  // Return the channel shared by all subscriptions, create it with |config| if
+  // it doesn't exist.
+  std::shared_ptr<ConferencePeerConnectionChannel>
+  GetMultiplexedSubscribeChannel(PeerConnectionChannelConfiguration& config);
+  // Take a channel from the pre-created pool, or create a new one if the pool
+  // is empty. Codec preferences in |config| are applied to the channel.
+  std::shared_ptr<ConferencePeerConnectionChannel> CreatePeerConnectionChannel(
+      PeerConnectionChannelConfiguration& config);
+  // Discard expired channels in the pool and create new ones until the pool is
+  // full.
+  void RefillPeerConnectionPool();
+  // Return a queue for callbacks and events of a new session. Sessions share
+  // |event_queue_| unless a callback executor is configured.
+  std::shared_ptr<rtc::TaskQueue> CreateSessionEventQueue();
+  // Remove all channels, including pooled ones, from this client and return
+  // them.
+  std::vector<std::shared_ptr<ConferencePeerConnectionChannel>>
+  TakePeerConnectionChannels();
+  // Close |pccs| without notifying MCU. |on_closed| is invoked on
+  // |event_queue_| after all of them are closed and released.
+  void ClosePeerConnectionChannels(
+      std::vector<std::shared_ptr<ConferencePeerConnectionChannel>> pccs,
+      std::function<void()> on_closed);
   // Get the |ConferencePeerConnectionChannel| instance associated with specific
   // |session_id|. Return |nullptr| if not found.
   std::shared_ptr<ConferencePeerConnectionChannel>
-  GetConferencePeerConnectionChannel(const std::string& session_id) const;
+  GetConferencePeerConnectionChannel(const std::string& session_id);
   void TriggerOnUserJoined(std::shared_ptr<sio::message> user_info, bool joining = false);
   void TriggerOnUserLeft(std::shared_ptr<sio::message> user_info);
   void TriggerOnStreamAdded(std::shared_ptr<sio::message> stream_info, bool joining = false);
   void TriggerOnStreamRemoved(std::shared_ptr<sio::message> stream_info);
   void TriggerOnStreamUpdated(std::shared_ptr<sio::message> stream_info);
+  // Deactivate simulcast layers of publication |publication_id| which are not
+  // in |layers|, an array of rids subscribed by someone.
+  void OnSubscribedLayersChanged(const std::string& publication_id,
+                                 std::shared_ptr<sio::message> layers);
   void TriggerOnStreamError(std::shared_ptr<Stream> stream,
                             std::shared_ptr<const Exception> exception);
+  // Call |func| with each observer on |event_queue_|. Observers are looked up
+  // when the task runs, so an observer removed before that is not called.
+  void PostToObservers(std::function<void(ConferenceClientObserver&)> func);
+  // Run |task| after room snapshot entries and earlier room events have been
+  // handled.
+  void RunInRoomEventOrder(std::function<void(ConferenceClient&)> task);
+  // Parse pending entries of |conference_info| in batches on |event_queue_|,
+  // until it is no longer the current conference.
+  void ParseRoomSnapshotInBatches(
+      std::shared_ptr<ConferenceInfo> conference_info);
+  // Drop pending entries of current conference, so room snapshot and events
+  // of a conference left are not delivered.
+  void ClearPendingRoomEntries();
 #ifdef OWT_ENABLE_QUIC
   void TriggerOnIncomingStream(const std::string& session_id,
                                owt::quic::WebTransportStreamInterface* stream);
@@ -502,21 +727,44 @@ class OWT_EXPORT ConferenceClient final
   // it's ConferencePeerConnectionChannels or ConferenceWebTransportChannels
   std::shared_ptr<rtc::TaskQueue> event_queue_;
   std::shared_ptr<ConferenceSocketSignalingChannel> signaling_channel_;
-  std::mutex observer_mutex_;
   bool signaling_channel_connected_;
   // Key publish(session) ID from server, value is MediaStream's label
   std::unordered_map<std::string, std::string> publish_id_label_map_;
-  // Store the peer connection channels created.
-  std::vector<std::shared_ptr<ConferencePeerConnectionChannel>>
+  // Store the peer connection channels created. Key is publication ID from
+  // server. Channels waiting for their publication ID are kept in
+  // |pending_publish_pcs_| and moved here on first lookup after the ID is
+  // assigned.
+  std::unordered_map<std::string,
+                     std::shared_ptr<ConferencePeerConnectionChannel>>
       publish_pcs_;
-  mutable std::mutex publish_pcs_mutex_;
-  // Key is subcription ID from server.
   std::vector<std::shared_ptr<ConferencePeerConnectionChannel>>
+      pending_publish_pcs_;
+  mutable std::mutex publish_pcs_mutex_;
+  // Key is subcription ID from server. Same as publications, channels without
+  // a subscription ID yet are kept in |pending_subscribe_pcs_|.
+  std::unordered_map<std::string,
+                     std::shared_ptr<ConferencePeerConnectionChannel>>
       subscribe_pcs_;
+  std::vector<std::shared_ptr<ConferencePeerConnectionChannel>>
+      pending_subscribe_pcs_;
+  // IDs of remote streams being subscribed or already subscribed.
+  std::unordered_set<std::string> subscribed_stream_ids_;
+  // The channel carrying all subscriptions if subscriptions are multiplexed.
+  std::shared_ptr<ConferencePeerConnectionChannel> multiplexed_subscribe_pcc_;
+  // Pre-created channels and their creation time.
+  std::deque<std::pair<std::shared_ptr<ConferencePeerConnectionChannel>,
+                       std::chrono::steady_clock::time_point>>
+      pooled_pcs_;
+  // TimerService::TimerId of the next expiry check of |pooled_pcs_|.
+  uint64_t pool_refresh_timer_;
+  std::mutex pooled_pcs_mutex_;
   // Key is subscription ID, value is streamID.
   std::unordered_map<std::string, std::string> subscribe_id_label_map_;
   mutable std::mutex subscribe_pcs_mutex_;
   // Key is the stream ID(publication ID or mixed stream ID).
+  // Guards |added_streams_| and |added_stream_type_|. They are changed by room
+  // events, and read on application's thread when subscribing.
+  mutable std::mutex added_streams_mutex_;
   std::unordered_map<std::string, std::shared_ptr<RemoteStream>>
       added_streams_;
   std::unordered_map<std::string, StreamType> added_stream_type_;
@@ -525,9 +773,11 @@ class OWT_EXPORT ConferenceClient final
   std::shared_ptr<ConferenceInfo> current_conference_info_;
   // Capturing observer in |event_queue_| is not 100% safe although above queue
   // is excepted to be ended after ConferenceClient is destroyed.
-  std::vector<std::reference_wrapper<ConferenceClientObserver>> observers_;
-  mutable std::mutex stream_update_observer_mutex_;
-  std::vector <std::reference_wrapper<ConferenceStreamUpdateObserver>> stream_update_observers_;
+  ObserverList<ConferenceClientObserver> observers_;
+  ObserverList<ConferenceStreamUpdateObserver> stream_update_observers_;
+  // Keep stream added events in the same order as streams are added to
+  // |current_conference_info_|.
+  std::mutex stream_added_mutex_;
 #ifdef OWT_ENABLE_QUIC
   // Each conference client will be associated with only one quic_transport_channel_ instance.
   std::shared_ptr<ConferenceWebTransportChannel> web_transport_channel_;
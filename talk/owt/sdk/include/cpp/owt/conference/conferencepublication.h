@@ -50,6 +50,12 @@ class OWT_EXPORT ConferencePublication : public Publication, public ConferenceSt
         std::function<void(
             const std::vector<const webrtc::StatsReport*>& reports)> on_success,
         std::function<void(std::unique_ptr<Exception>)> on_failure);
+    /// Update encoding parameters of current publication's video without
+    /// renegotiation.
+    void UpdateEncodingParameters(
+        const std::vector<RtpEncodingParameters>& parameters,
+        std::function<void()> on_success,
+        std::function<void(std::unique_ptr<Exception>)> on_failure) override;
     /// Stop current publication.
     void Stop() override;
     /// Check if the publication is stopped or not
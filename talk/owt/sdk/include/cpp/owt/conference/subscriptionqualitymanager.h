@@ -0,0 +1,115 @@
+// Copyright (C) <2020> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OWT_CONFERENCE_SUBSCRIPTIONQUALITYMANAGER_H_
+#define OWT_CONFERENCE_SUBSCRIPTIONQUALITYMANAGER_H_
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "owt/base/commontypes.h"
+#include "owt/base/stream.h"
+#include "owt/conference/conferencesubscription.h"
+#include "owt/conference/subscribeoptions.h"
+namespace owt {
+namespace conference {
+/// Describes how a subscription is presented to the user.
+struct OWT_EXPORT SubscriptionQualityHint {
+  explicit SubscriptionQualityHint() : renderer_size(0, 0), priority(1) {}
+  /// Size of the view rendering the video. Resolutions larger than the view
+  /// are not chosen. 0x0 means unknown.
+  owt::base::Resolution renderer_size;
+  /// Subscriptions with higher priority get bandwidth before subscriptions
+  /// with lower priority.
+  int priority;
+};
+/// Video quality chosen for a subscription.
+struct OWT_EXPORT SubscriptionQuality {
+  explicit SubscriptionQuality()
+      : resolution(0, 0), frame_rate(0), bitrate_multiplier(1), bitrate(0) {}
+  owt::base::Resolution resolution;
+  double frame_rate;
+  double bitrate_multiplier;
+  /// Estimated bitrate in kbps.
+  uint32_t bitrate;
+};
+/**
+ @brief Chooses video quality of subscriptions within a bandwidth budget.
+ @details Candidate qualities of a subscription are built from the remote
+ stream's publication settings and subscription capabilities. When bandwidth
+ or a subscription changes, each subscription starts from its lowest quality,
+ and subscriptions are upgraded in priority order while the budget allows.
+ Downgrades are applied immediately. An upgrade is applied only if it still
+ fits with a safety margin for several evaluations in a row, so quality
+ doesn't flap when bandwidth fluctuates. Chosen qualities are applied by
+ ConferenceSubscription::ApplyOptions, one update at a time for each
+ subscription. If an update fails, it's requested again at the next
+ evaluation.
+*/
+class OWT_EXPORT SubscriptionQualityManager {
+ public:
+  SubscriptionQualityManager();
+  virtual ~SubscriptionQualityManager();
+  /// Manage the quality of |subscription|, which subscribes |stream|.
+  void AddSubscription(std::shared_ptr<ConferenceSubscription> subscription,
+                       std::shared_ptr<owt::base::RemoteStream> stream,
+                       const SubscriptionQualityHint& hint);
+  /// Update the hint of a subscription, e.g. when its view is resized.
+  void UpdateHint(const std::string& subscription_id,
+                  const SubscriptionQualityHint& hint);
+  /// Stop managing the quality of a subscription.
+  void RemoveSubscription(const std::string& subscription_id);
+  /**
+   @brief Set the available receive bandwidth in kbps.
+   @details It could be obtained from availableIncomingBitrate of the
+   RTCStatsReport's candidate pair, or from a server side estimation. Quality
+   of all subscriptions is evaluated again.
+  */
+  void SetAvailableBandwidth(uint32_t kbps);
+  /// Get the quality applied to a subscription. Returns false if the
+  /// subscription is not managed.
+  bool GetQuality(const std::string& subscription_id,
+                  SubscriptionQuality& quality);
+ private:
+  struct ManagedSubscription {
+    std::weak_ptr<ConferenceSubscription> subscription;
+    std::shared_ptr<owt::base::RemoteStream> stream;
+    SubscriptionQualityHint hint;
+    // Candidate qualities in ascending order of bitrate.
+    std::vector<SubscriptionQuality> levels;
+    // Quality the server confirmed for the subscription.
+    SubscriptionQuality applied;
+    // Index of the quality requested last time in |levels|. It's the size of
+    // |levels| before any quality is requested.
+    size_t current_level;
+    // Consecutive evaluations an upgrade has been possible.
+    int upgrade_count;
+    // ID of the quality update in progress, or 0 if there is none. A
+    // subscription has at most one update in progress.
+    uint64_t request_id;
+    // The hint or the chosen quality changed while an update was in
+    // progress, so it is evaluated again when the update completes.
+    bool reevaluate;
+  };
+  // Shared with callbacks of ConferenceSubscription::ApplyOptions, which may
+  // be invoked after the manager is destroyed.
+  struct State {
+    State() : available_bandwidth(0), next_request_id(1) {}
+    std::mutex mutex;
+    std::unordered_map<std::string, ManagedSubscription> subscriptions;
+    uint32_t available_bandwidth;
+    uint64_t next_request_id;
+  };
+  static void Evaluate(const std::shared_ptr<State>& state);
+  static void OnQualityUpdated(std::weak_ptr<State> weak_state,
+                               const std::string& subscription_id,
+                               uint64_t request_id,
+                               const SubscriptionQuality& quality,
+                               bool succeeded);
+  std::shared_ptr<State> state_;
+};
+}  // namespace conference
+}  // namespace owt
+#endif  // OWT_CONFERENCE_SUBSCRIPTIONQUALITYMANAGER_H_
@@ -63,6 +63,15 @@ class OWT_EXPORT P2PClientObserver {
    signaling server.
    */
   virtual void OnServerDisconnected(){}
+  /**
+   @brief This function will be invoked when the connection with a remote user
+   recovers from disconnected, either by itself or after an automatic ICE
+   restart.
+   @param remote_user_id Remote user's ID
+   @param freeze_duration_ms How long media was interrupted, in milliseconds.
+   */
+  virtual void OnConnectionRecovered(const std::string& remote_user_id,
+                                     int64_t freeze_duration_ms) {}
 
 #ifdef OWT_CLOUD_GAMING
   /**
@@ -260,18 +269,27 @@ class OWT_EXPORT P2PClient final
                                  const std::string& message);
   // Triggered when a new stream is added.
   virtual void OnStreamAdded(std::shared_ptr<owt::base::RemoteStream> stream);
+  // Triggered when ICE connection recovers from disconnected.
+  virtual void OnConnectionRecovered(const std::string& remote_id,
+                                     int64_t freeze_duration_ms);
 
  private:
   void Unpublish(const std::string& target_id,
                  std::shared_ptr<LocalStream> stream,
                  std::function<void()> on_success,
                  std::function<void(std::unique_ptr<Exception>)> on_failure);
+  void UpdateEncodingParameters(
+      const std::string& target_id,
+      std::shared_ptr<LocalStream> stream,
+      const std::vector<RtpEncodingParameters>& parameters,
+      std::function<void()> on_success,
+      std::function<void(std::unique_ptr<Exception>)> on_failure);
   std::shared_ptr<P2PPeerConnectionChannel> GetPeerConnectionChannel(
       const std::string& target_id, bool replace = false);
   bool IsPeerConnectionChannelCreated(const std::string& target_id);
   owt::base::PeerConnectionChannelConfiguration GetPeerConnectionChannelConfiguration();
   // Queue for callbacks and events. Shared among P2PClient and all of it's
-  // P2PPeerConnectionChannel.
+  // P2PPeerConnectionChannel, unless a callback executor is configured.
   std::shared_ptr<rtc::TaskQueue> event_queue_;
   std::shared_ptr<rtc::TaskQueue> signaling_queue_;
   std::shared_ptr<P2PSignalingChannelInterface> signaling_channel_;
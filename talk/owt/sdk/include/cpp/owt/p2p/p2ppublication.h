@@ -28,6 +28,12 @@ class OWT_EXPORT P2PPublication : public Publication {
   void GetStats(
       std::function<void(std::shared_ptr<RTCStatsReport>)> on_success,
       std::function<void(std::unique_ptr<Exception>)> on_failure) override;
+  /// Update encoding parameters of current publication's video without
+  /// renegotiation.
+  void UpdateEncodingParameters(
+      const std::vector<RtpEncodingParameters>& parameters,
+      std::function<void()> on_success,
+      std::function<void(std::unique_ptr<Exception>)> on_failure) override;
   /// Stop current publication.
   void Stop() override;
   /// Pause current publication's audio or/and video basing on |track_kind| provided.
@@ -13,6 +13,7 @@
 #include "webrtc/rtc_base/task_queue.h"
 #include "webrtc/rtc_base/third_party/base64/base64.h"
 #include "talk/owt/sdk/base/eventtrigger.h"
+#include "talk/owt/sdk/base/executortaskqueue.h"
 #include "talk/owt/sdk/base/stringutils.h"
 #include "talk/owt/sdk/include/cpp/owt/base/stream.h"
 #include "talk/owt/sdk/include/cpp/owt/p2p/p2pclient.h"
@@ -37,10 +38,9 @@ P2PClient::P2PClient(
       configuration_(configuration) {
   RTC_CHECK(signaling_channel_);
   signaling_channel_->AddObserver(*this);
+  event_queue_ = owt::base::CreateCallbackQueue(
+      configuration.callback_executor, "P2PClientEventQueue");
   auto task_queue_factory = webrtc::CreateDefaultTaskQueueFactory();
-  event_queue_ =
-      std::make_unique<rtc::TaskQueue>(task_queue_factory->CreateTaskQueue(
-          "P2PClientEventQueue", webrtc::TaskQueueFactory::Priority::NORMAL));
   signaling_queue_ =
       std::make_unique<rtc::TaskQueue>(task_queue_factory->CreateTaskQueue(
           "P2PClientSignalingQueue",
@@ -234,6 +234,27 @@ void P2PClient::GetConnectionStats(
   pcc->GetConnectionStats(on_success, on_failure);
 }
 
+void P2PClient::UpdateEncodingParameters(
+    const std::string& target_id,
+    std::shared_ptr<LocalStream> stream,
+    const std::vector<RtpEncodingParameters>& parameters,
+    std::function<void()> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  if (!IsPeerConnectionChannelCreated(target_id)) {
+    if (on_failure) {
+      event_queue_->PostTask([on_failure] {
+        std::unique_ptr<Exception> e(
+            new Exception(ExceptionType::kP2PClientInvalidState,
+                          "Non-existed peer connection cannot be updated."));
+        on_failure(std::move(e));
+      });
+    }
+    return;
+  }
+  auto pcc = GetPeerConnectionChannel(target_id);
+  pcc->UpdateEncodingParameters(stream, parameters, on_success, on_failure);
+}
+
 void P2PClient::SetLocalId(const std::string& local_id) {
   local_id_ = local_id;
 }
@@ -388,10 +409,19 @@ std::shared_ptr<P2PPeerConnectionChannel> P2PClient::GetPeerConnectionChannel(
   if (pcc_it == pc_channels_.end()) {
     PeerConnectionChannelConfiguration config =
         GetPeerConnectionChannelConfiguration();
+    config.bandwidth_estimate_cache_key = target_id;
+    // Each remote endpoint has its own queue if a callback executor is set,
+    // so a slow callback for one endpoint doesn't delay others.
+    std::shared_ptr<rtc::TaskQueue> pcc_event_queue =
+        configuration_.callback_executor
+            ? owt::base::CreateCallbackQueue(
+                  configuration_.callback_executor,
+                  "P2PPeerConnectionChannelEventQueue")
+            : event_queue_;
     std::shared_ptr<P2PPeerConnectionChannel> pcc =
         std::shared_ptr<P2PPeerConnectionChannel>(new P2PPeerConnectionChannel(
             config, local_id_, target_id, signaling_sender_.get(),
-            event_queue_));
+            pcc_event_queue));
     pcc->AddObserver(pcc_observer_adapter_.get());
     auto pcc_pair =
         std::pair<std::string, std::shared_ptr<P2PPeerConnectionChannel>>(
@@ -441,6 +471,12 @@ void P2PClient::OnMessageReceived(const std::string& remote_id,
                          &P2PClientObserver::OnMessageReceived, remote_id,
                          message);
 }
+void P2PClient::OnConnectionRecovered(const std::string& remote_id,
+                                      int64_t freeze_duration_ms) {
+  EventTrigger::OnEvent2(observers_, event_queue_,
+                         &P2PClientObserver::OnConnectionRecovered, remote_id,
+                         freeze_duration_ms);
+}
 void P2PClient::OnStopped(const std::string& remote_id) {
   // invoked on signaling thread. move to other thread.
   std::thread([this, remote_id]() {
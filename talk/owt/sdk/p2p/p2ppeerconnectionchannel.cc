@@ -1,9 +1,7 @@
 // Copyright (C) <2018> Intel Corporation
 //
 // SPDX-License-Identifier: Apache-2.0
-#include <thread>
 #include <vector>
-#include "talk/owt/sdk/base/eventtrigger.h"
 #include "talk/owt/sdk/base/functionalobserver.h"
 #include "talk/owt/sdk/base/sdputils.h"
 #include "talk/owt/sdk/base/sysinfo.h"
@@ -90,10 +88,12 @@ P2PPeerConnectionChannel::P2PPeerConnectionChannel(
       remote_id_(remote_id),
       session_state_(kSessionStateReady),
       negotiation_needed_(false),
+      ice_restart_needed_(false),
       pending_remote_sdp_(nullptr),
       last_disconnect_(
           std::chrono::time_point<std::chrono::system_clock>::max()),
       reconnect_timeout_(10),
+      reconnect_timer_(owt::base::TimerService::kInvalidTimerId),
       message_seq_num_(0),
       remote_side_supports_plan_b_(false),
       remote_side_supports_remove_stream_(false),
@@ -130,6 +130,7 @@ P2PPeerConnectionChannel::P2PPeerConnectionChannel(
 
 P2PPeerConnectionChannel::~P2PPeerConnectionChannel() {
   ended_ = true;
+  owt::base::TimerService::Get().Cancel(reconnect_timer_);
   ClosePeerConnection();
 }
 void P2PPeerConnectionChannel::Publish(
@@ -291,12 +292,11 @@ void P2PPeerConnectionChannel::ChangeSessionState(SessionState state) {
 }
 void P2PPeerConnectionChannel::AddObserver(
     P2PPeerConnectionChannelObserver* observer) {
-  observers_.push_back(observer);
+  observers_.Add(*observer);
 }
 void P2PPeerConnectionChannel::RemoveObserver(
     P2PPeerConnectionChannelObserver* observer) {
-  observers_.erase(std::remove(observers_.begin(), observers_.end(), observer),
-                   observers_.end());
+  observers_.Remove(*observer);
 }
 void P2PPeerConnectionChannel::CreateOffer() {
   {
@@ -323,6 +323,7 @@ void P2PPeerConnectionChannel::CreateOffer() {
   auto offer_answer_options =
       webrtc::PeerConnectionInterface::RTCOfferAnswerOptions();
   offer_answer_options.use_rtp_mux = !rtp_no_mux;
+  offer_answer_options.ice_restart = ice_restart_needed_.exchange(false);
   peer_connection_->CreateOffer(observer.get(), offer_answer_options);
 }
 void P2PPeerConnectionChannel::CreateAnswer() {
@@ -677,13 +678,17 @@ void P2PPeerConnectionChannel::OnAddStream(
   }
   std::shared_ptr<RemoteStream> remote_stream(
       new RemoteStream(stream.get(), remote_id_));
-  EventTrigger::OnEvent1<P2PPeerConnectionChannelObserver*,
-                         std::allocator<P2PPeerConnectionChannelObserver*>,
-                         void (owt::p2p::P2PPeerConnectionChannelObserver::*)(
-                             std::shared_ptr<RemoteStream>),
-                         std::shared_ptr<RemoteStream>>(
-      observers_, event_queue_,
-      &P2PPeerConnectionChannelObserver::OnStreamAdded, remote_stream);
+  // Observers are looked up when the event is fired, so an observer removed
+  // before that is not called.
+  std::weak_ptr<P2PPeerConnectionChannel> weak_this = weak_from_this();
+  event_queue_->PostTask([weak_this, remote_stream] {
+    auto that = weak_this.lock();
+    if (!that)
+      return;
+    that->observers_.ForEach([&](P2PPeerConnectionChannelObserver& o) {
+      o.OnStreamAdded(remote_stream);
+    });
+  });
   remote_streams_[stream->id()] = remote_stream;
   // Send the ack for the newly added stream tracks.
   Json::Value json_tracks;
@@ -738,11 +743,35 @@ void P2PPeerConnectionChannel::OnNegotiationNeeded() {
     negotiation_needed_ = true;
   }
 }
+void P2PPeerConnectionChannel::RestartIce() {
+  // Called on the timer thread, which should not be blocked by creating an
+  // offer.
+  std::weak_ptr<P2PPeerConnectionChannel> weak_this = weak_from_this();
+  event_queue_->PostTask([weak_this] {
+    auto that = weak_this.lock();
+    if (!that || that->ended_)
+      return;
+    RTC_LOG(LS_INFO) << "Restart ICE.";
+    that->ice_restart_needed_ = true;
+    that->OnNegotiationNeeded();
+  });
+}
+std::weak_ptr<PeerConnectionChannel> P2PPeerConnectionChannel::GetWeakPtr() {
+  return weak_from_this();
+}
+void P2PPeerConnectionChannel::OnIceConnectionRecovered(
+    int64_t freeze_duration_ms) {
+  observers_.ForEach([&](P2PPeerConnectionChannelObserver& o) {
+    o.OnConnectionRecovered(remote_id_, freeze_duration_ms);
+  });
+}
 void P2PPeerConnectionChannel::OnIceConnectionChange(
     webrtc::PeerConnectionInterface::IceConnectionState new_state) {
   if (ended_)
     return;
   RTC_LOG(LS_INFO) << "Ice connection state changed: " << new_state;
+  CheckIceConnectionForRestart(new_state);
+  UpdateBandwidthEstimateCache(new_state);
   switch (new_state) {
     case webrtc::PeerConnectionInterface::kIceConnectionConnected:
     case webrtc::PeerConnectionInterface::kIceConnectionCompleted:
@@ -755,16 +784,32 @@ void P2PPeerConnectionChannel::OnIceConnectionChange(
     case webrtc::PeerConnectionInterface::kIceConnectionDisconnected:
       last_disconnect_ = std::chrono::system_clock::now();
       // Check state after a period of time.
-      std::thread([this]() {
-        std::this_thread::sleep_for(std::chrono::seconds(reconnect_timeout_));
-        if (std::chrono::system_clock::now() - last_disconnect_ >=
-            std::chrono::seconds(reconnect_timeout_)) {
-          RTC_LOG(LS_INFO) << "Detect reconnection failed, stop this session.";
-          Stop(nullptr, nullptr);
-        } else {
-          RTC_LOG(LS_INFO) << "Detect reconnection succeed.";
-        }
-      }).detach();
+      owt::base::TimerService::Get().Cancel(reconnect_timer_);
+      {
+        // Empty if the channel is being destroyed.
+        std::weak_ptr<P2PPeerConnectionChannel> weak_this = weak_from_this();
+        std::shared_ptr<rtc::TaskQueue> event_queue = event_queue_;
+        // Stopping the session sends signaling messages and closes the peer
+        // connection, so it's posted to |event_queue_| instead of running on
+        // the timer thread.
+        reconnect_timer_ = owt::base::TimerService::Get().Schedule(
+            reconnect_timeout_ * 1000, [weak_this, event_queue]() {
+              event_queue->PostTask([weak_this] {
+                auto that = weak_this.lock();
+                if (!that)
+                  return;
+                if (std::chrono::system_clock::now() -
+                        that->last_disconnect_ >=
+                    std::chrono::seconds(that->reconnect_timeout_)) {
+                  RTC_LOG(LS_INFO)
+                      << "Detect reconnection failed, stop this session.";
+                  that->Stop(nullptr, nullptr);
+                } else {
+                  RTC_LOG(LS_INFO) << "Detect reconnection succeed.";
+                }
+              });
+            });
+      }
       break;
     case webrtc::PeerConnectionInterface::kIceConnectionClosed:
       TriggerOnStopped();
@@ -957,10 +1002,8 @@ void P2PPeerConnectionChannel::TriggerOnStopped() {
   local_stop_triggered_ = true;
 
   // P2PClient will likely remove our reference
-  for (std::vector<P2PPeerConnectionChannelObserver*>::iterator it =
-       observers_.begin(); it != observers_.end(); it++) {
-    (*it)->OnStopped(remote_id_);
-  }
+  observers_.ForEach(
+      [&](P2PPeerConnectionChannelObserver& o) { o.OnStopped(remote_id_); });
 }
 
 void P2PPeerConnectionChannel::CleanLastPeerConnection() {
@@ -1016,6 +1059,41 @@ void P2PPeerConnectionChannel::Unpublish(
       webrtc::PeerConnectionInterface::SignalingState::kStable)
     DrainPendingStreams();
 }
+void P2PPeerConnectionChannel::UpdateEncodingParameters(
+    std::shared_ptr<LocalStream> stream,
+    const std::vector<RtpEncodingParameters>& parameters,
+    std::function<void()> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  if (!CheckNullPointer((uintptr_t)stream.get(), on_failure)) {
+    RTC_LOG(LS_WARNING) << "Local stream cannot be nullptr.";
+    return;
+  }
+  RTC_CHECK(stream->MediaStream());
+  std::string stream_id = stream->MediaStream()->id();
+  bool published = false;
+  {
+    std::lock_guard<std::mutex> lock(published_streams_mutex_);
+    published = published_streams_.find(stream_id) != published_streams_.end();
+  }
+  webrtc::RTCError error =
+      published ? SetVideoEncodingParameters(stream_id, parameters)
+                : webrtc::RTCError(webrtc::RTCErrorType::INVALID_PARAMETER,
+                                   "The stream is not published.");
+  if (!error.ok()) {
+    if (on_failure) {
+      std::string message(error.message());
+      event_queue_->PostTask([on_failure, message] {
+        std::unique_ptr<Exception> e(
+            new Exception(ExceptionType::kP2PClientInvalidArgument, message));
+        on_failure(std::move(e));
+      });
+    }
+    return;
+  }
+  if (on_success) {
+    event_queue_->PostTask([on_success] { on_success(); });
+  }
+}
 void P2PPeerConnectionChannel::Stop(
     std::function<void()> on_success,
     std::function<void(std::unique_ptr<Exception>)> on_failure) {
@@ -1288,11 +1366,9 @@ void P2PPeerConnectionChannel::OnDataChannelMessage(
     SendSignalingMessage(ack);
   }
   // Deal with the received text message.
-  for (std::vector<P2PPeerConnectionChannelObserver*>::iterator it =
-           observers_.begin();
-       it != observers_.end(); ++it) {
-    (*it)->OnMessageReceived(remote_id_, message);
-  }
+  observers_.ForEach([&](P2PPeerConnectionChannelObserver& o) {
+    o.OnMessageReceived(remote_id_, message);
+  });
 }
 void P2PPeerConnectionChannel::CreateDataChannel(const std::string& label) {
   webrtc::DataChannelInit config;
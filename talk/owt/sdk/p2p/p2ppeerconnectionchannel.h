@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: Apache-2.0
 #ifndef WOOGEEN_P2P_P2PPEERCONNECTIONCHANNEL_H_
 #define WOOGEEN_P2P_P2PPEERCONNECTIONCHANNEL_H_
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
@@ -10,8 +11,10 @@
 #include <chrono>
 #include "talk/owt/sdk/base/peerconnectiondependencyfactory.h"
 #include "talk/owt/sdk/base/peerconnectionchannel.h"
+#include "talk/owt/sdk/base/timerservice.h"
 #include "talk/owt/sdk/include/cpp/owt/base/stream.h"
 #include "talk/owt/sdk/include/cpp/owt/base/exception.h"
+#include "talk/owt/sdk/include/cpp/owt/base/observerlist.h"
 #include "talk/owt/sdk/include/cpp/owt/p2p/p2psignalingsenderinterface.h"
 #include "talk/owt/sdk/include/cpp/owt/p2p/p2psignalingreceiverinterface.h"
 #include "webrtc/sdk/media_constraints.h"
@@ -36,11 +39,16 @@ class P2PPeerConnectionChannelObserver {
       std::shared_ptr<RemoteStream> stream) = 0;
   // Triggered when the WebRTC session is ended.
   virtual void OnStopped(const std::string& remote_id) = 0;
+  // Triggered when ICE connection recovers from disconnected.
+  virtual void OnConnectionRecovered(const std::string& remote_id,
+                                     int64_t freeze_duration_ms) {}
 };
 // An instance of P2PPeerConnectionChannel manages a session for a specified
 // remote client.
-class P2PPeerConnectionChannel : public P2PSignalingReceiverInterface,
-                                 public PeerConnectionChannel {
+class P2PPeerConnectionChannel
+    : public P2PSignalingReceiverInterface,
+      public PeerConnectionChannel,
+      public std::enable_shared_from_this<P2PPeerConnectionChannel> {
  public:
   explicit P2PPeerConnectionChannel(
       PeerConnectionChannelConfiguration configuration,
@@ -75,6 +83,13 @@ class P2PPeerConnectionChannel : public P2PSignalingReceiverInterface,
   void Unpublish(std::shared_ptr<LocalStream> stream,
                  std::function<void()> on_success,
                  std::function<void(std::unique_ptr<Exception>)> on_failure);
+  // Update encoding parameters of a published stream's video. No
+  // renegotiation is needed.
+  void UpdateEncodingParameters(
+      std::shared_ptr<LocalStream> stream,
+      const std::vector<RtpEncodingParameters>& parameters,
+      std::function<void()> on_success,
+      std::function<void(std::unique_ptr<Exception>)> on_failure);
   // Send message to remote user.
   void Send(const std::string& message,
             bool is_reliable,
@@ -125,6 +140,9 @@ class P2PPeerConnectionChannel : public P2PSignalingReceiverInterface,
   virtual void OnIceGatheringChange(
       webrtc::PeerConnectionInterface::IceGatheringState new_state) override;
   virtual void OnIceCandidate(const webrtc::IceCandidateInterface* candidate) override;
+  virtual void RestartIce() override;
+  virtual void OnIceConnectionRecovered(int64_t freeze_duration_ms) override;
+  virtual std::weak_ptr<PeerConnectionChannel> GetWeakPtr() override;
   // DataChannelObserver
   virtual void OnDataChannelStateChange() override;
   virtual void OnDataChannelMessage(const webrtc::DataBuffer& buffer) override;
@@ -178,7 +196,10 @@ class P2PPeerConnectionChannel : public P2PSignalingReceiverInterface,
   SessionState session_state_;
   // Indicates if negotiation needed event is triggered or received negotiation
   // request from remote side, but haven't send out offer.
-  bool negotiation_needed_;
+  std::atomic<bool> negotiation_needed_;
+  // Next offer restarts ICE. Set on |event_queue_| and read when creating an
+  // offer.
+  std::atomic<bool> ice_restart_needed_;
   // Key is remote media stream's track id, value is type ("mic", "camera",
   // "screen-cast").
   mutable webrtc::Mutex remote_track_source_info_mutex_;
@@ -202,7 +223,7 @@ class P2PPeerConnectionChannel : public P2PSignalingReceiverInterface,
   std::mutex pending_unpublish_streams_mutex_;
   // Shared by |published_streams_| and |publishing_streams_|.
   std::mutex published_streams_mutex_;
-  std::vector<P2PPeerConnectionChannelObserver*> observers_;
+  ObserverList<P2PPeerConnectionChannelObserver> observers_;
   std::unordered_map<std::string, std::function<void()>> publish_success_callbacks_;
   // Store remote SDP if it cannot be set currently.
   std::unique_ptr<webrtc::SessionDescriptionInterface> pending_remote_sdp_;
@@ -210,6 +231,8 @@ class P2PPeerConnectionChannel : public P2PSignalingReceiverInterface,
       last_disconnect_;  // Last time |peer_connection_| changes its state to
                          // "disconnect".
   int reconnect_timeout_;  // Unit: second.
+  // Checks whether ICE reconnected in |reconnect_timeout_|.
+  owt::base::TimerService::TimerId reconnect_timer_;
   int message_seq_num_; // Message ID to be sent through data channel.
   // Messages need to be sent once data channel is ready.
   std::vector<std::tuple<std::shared_ptr<std::string>,
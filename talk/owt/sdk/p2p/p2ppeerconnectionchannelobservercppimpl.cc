@@ -17,5 +17,10 @@ void P2PPeerConnectionChannelObserverCppImpl::OnStopped(
     const std::string& remote_id) {
   peer_client_.OnStopped(remote_id);
 }
+void P2PPeerConnectionChannelObserverCppImpl::OnConnectionRecovered(
+    const std::string& remote_id,
+    int64_t freeze_duration_ms) {
+  peer_client_.OnConnectionRecovered(remote_id, freeze_duration_ms);
+}
 }
 }
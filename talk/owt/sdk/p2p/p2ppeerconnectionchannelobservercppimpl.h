@@ -26,6 +26,9 @@ class P2PPeerConnectionChannelObserverCppImpl
   virtual void OnStreamAdded(std::shared_ptr<RemoteStream> stream) override;
   // Triggered when the WebRTC session is ended.
   virtual void OnStopped(const std::string& remote_id) override;
+  // Triggered when ICE connection recovers from disconnected.
+  virtual void OnConnectionRecovered(const std::string& remote_id,
+                                     int64_t freeze_duration_ms) override;
 
  private:
   P2PClient& peer_client_;
@@ -58,6 +58,26 @@ void P2PPublication::GetStats(
   }
 }
 
+void P2PPublication::UpdateEncodingParameters(
+    const std::vector<RtpEncodingParameters>& parameters,
+    std::function<void()> on_success,
+    std::function<void(std::unique_ptr<Exception>)> on_failure) {
+  auto that = p2p_client_.lock();
+  if (that == nullptr || ended_) {
+    std::string failure_message("Session ended.");
+    if (on_failure != nullptr) {
+      event_queue_->PostTask([on_failure, failure_message]() {
+        std::unique_ptr<Exception> e(
+            new Exception(ExceptionType::kP2PUnknown, failure_message));
+        on_failure(std::move(e));
+      });
+    }
+  } else {
+    that->UpdateEncodingParameters(target_id_, local_stream_, parameters,
+                                   on_success, on_failure);
+  }
+}
+
 /// Stop current publication.
 void P2PPublication::Stop() {
   auto that = p2p_client_.lock();